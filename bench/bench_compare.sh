@@ -0,0 +1,35 @@
+#!/bin/sh
+
+# Compare a benchmark run against the stored baseline.
+#   usage: sh bench/bench_compare.sh <baseline> <results>
+# A metric regresses when it is more than BENCH_TOLERANCE percent
+# (default 25) worse than its baseline; tail percentiles (".p99") are
+# noisier and get twice that. Metrics measured in "us" or "KB" are
+# lower-is-better, everything else (ops/s, MB/s, lines/s) is
+# higher-is-better. Exits non-zero if any metric regressed.
+
+BASELINE=$1
+RESULTS=$2
+TOLERANCE=${BENCH_TOLERANCE:-25}
+
+if [ ! -f "$BASELINE" ]; then
+    echo "No baseline at $BASELINE, run \"make bench_baseline\" to create one"
+    exit 0
+fi
+
+awk -v tol="$TOLERANCE" '
+    /^#/ || NF < 3 { next }
+    FNR == NR { base[$1] = $2; next }
+    !($1 in base) { printf("NEW        %-24s %12s %s\n", $1, $2, $3); next }
+    {
+        b = base[$1]; v = $2
+        if (b == 0) { next }
+        if ($3 == "us" || $3 == "KB") { change = (v - b) / b * 100 } else { change = (b - v) / b * 100 }
+        limit = ($1 ~ /\.p99$/) ? 2 * tol : tol
+        status = (change > limit) ? "REGRESSION" : "ok"
+        if (status == "REGRESSION") { failed = 1 }
+        dir = (change > 0) ? "worse" : "better"
+        printf("%-10s %-24s %12s %-8s (baseline %s, %.1f%% %s)\n", status, $1, v, $3, b, (change > 0) ? change : -change, dir)
+    }
+    END { exit failed }
+' "$BASELINE" "$RESULTS"
@@ -0,0 +1,887 @@
+#define _XOPEN_SOURCE 700
+
+#include <msh.h>
+#include <msh_parse.h>
+#include <ptrie.h>
+#include <msh_dircache.h>
+#include <msh_var.h>
+#include <msh_subst.h>
+#include <msh_glob.h>
+#include <msh_timeout.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/wait.h>
+
+/**
+ * `msh_bench` is the performance suite run by `make bench`. Every
+ * result is printed on its own line as
+ *
+ * ```
+ * <metric> <value> <unit>
+ * ```
+ *
+ * so that `bench/bench_compare.sh` can diff a run against the stored
+ * `bench/baseline.txt`. Lines starting with `#` are comments.
+ */
+
+/* how long each parse shape is hammered for */
+#define BENCH_PARSE_NS     (200 * 1000 * 1000L)
+/* lines in each batch parse */
+#define BENCH_BATCH_LINES  100000
+/* number of launches per pipeline length */
+#define BENCH_LAUNCH_ITERS 200
+/* bytes pushed through the throughput pipeline */
+#define BENCH_PIPE_BYTES   (256L * 1024 * 1024)
+/* bytes in the here-document benchmark's body */
+#define BENCH_HERE_BYTES   (64L * 1024 * 1024)
+/* programs indexed for the completion benchmark */
+#define BENCH_COMPLETE_NAMES 20000
+/* distinct history lines suggestions are picked from */
+#define BENCH_HINT_LINES   300000
+/* entries in the directory completed from */
+#define BENCH_DIR_ENTRIES  100000
+/* entries in the directory globbed, half of them matching */
+#define BENCH_GLOB_ENTRIES 1000000
+/* lines in the script run as text and compiled */
+#define BENCH_SCRIPT_LINES 50000
+/* iterations of the loop benchmark */
+#define BENCH_LOOP_ITERS   100000
+/* rounds of setting and cancelling every deadline */
+#define BENCH_TIMEOUT_ROUNDS 100
+/* a cached file completion must stay under this (us, at p50) */
+#define BENCH_DIR_TARGET_US 1000
+
+static long
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int
+cmp_long(const void *a, const void *b)
+{
+    long x = *(const long *)a, y = *(const long *)b;
+
+    return (x > y) - (x < y);
+}
+
+//nearest-rank percentile over a sorted array
+static long
+percentile(long *sorted, size_t n, double pct)
+{
+    size_t idx = (size_t)(pct / 100.0 * (double)n);
+
+    if (idx >= n) idx = n - 1;
+    return sorted[idx];
+}
+
+//builds "prog | prog | ..." with n stages into buf
+static void
+build_pipeline(char *buf, size_t sz, const char *prog, int n)
+{
+    buf[0] = '\0';
+    for (int i = 0; i < n; i++) {
+        if (i > 0) strncat(buf, " | ", sz - strlen(buf) - 1);
+        strncat(buf, prog, sz - strlen(buf) - 1);
+    }
+}
+
+static void
+bench_parse(void)
+{
+    char pipe16[512];
+    struct {
+        const char *name;
+        const char *line;
+    } shapes[] = {
+        { "simple",   "ls" },
+        { "args",     "ls -l -a -h --color=never /usr/bin /tmp" },
+        { "pipeline", "ps aux | grep msh | sort | uniq -c | wc -l" },
+        { "sequence", "ls ; cd .. ; ls -l ; cd tmp ; pwd ; echo done" },
+        { "redirect", "cmd a b c 2>> err.txt 1> out.txt &" },
+        { "pipe16",   pipe16 },
+    };
+    struct msh_sequence *s;
+
+    build_pipeline(pipe16, sizeof(pipe16), "cat -n", MSH_MAXCMNDS);
+    s = msh_sequence_alloc();
+    if (s == NULL) {
+        fprintf(stderr, "msh_bench: could not allocate sequence\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+        char line[512];
+        struct msh_pipeline *p;
+        long start, end, ops = 0;
+
+        strcpy(line, shapes[i].line);
+        start = now_ns();
+        do {
+            //parse a batch between clock reads to keep timing overhead out
+            for (int j = 0; j < 64; j++) {
+                if (msh_sequence_parse(line, s) != 0) {
+                    fprintf(stderr, "msh_bench: could not parse \"%s\"\n", line);
+                    exit(EXIT_FAILURE);
+                }
+                while ((p = msh_sequence_pipeline(s)) != NULL) {
+                    msh_pipeline_free(p);
+                }
+            }
+            ops += 64;
+            end = now_ns();
+        } while (end - start < BENCH_PARSE_NS);
+
+        printf("parse.%s %.0f ops/s\n", shapes[i].name, (double)ops * 1e9 / (double)(end - start));
+    }
+    msh_sequence_free(s);
+}
+
+//expanding the variables of a parsed pipeline, against parsing it with the values in place
+static void
+bench_expand(void)
+{
+    char line[] = "cat $DIR/${NAME}.log 2>> $DIR/err | grep -e $PATTERN | wc -l";
+    struct msh_sequence *s = msh_sequence_alloc();
+    struct msh_pipeline *p;
+    long start, end, ops = 0;
+
+    if (s == NULL || msh_var_set("DIR", 3, "/var/log/msh") != 0 || msh_var_set("NAME", 4, "session") != 0 ||
+        msh_var_set("PATTERN", 7, "error") != 0 || msh_sequence_parse(line, s) != 0) {
+        fprintf(stderr, "msh_bench: could not set up the expansion\n");
+        exit(EXIT_FAILURE);
+    }
+    p = msh_sequence_pipeline(s);
+    start = now_ns();
+    do {
+        for (int j = 0; j < 64; j++) {
+            if (msh_pipeline_expand(p, msh_var_lookup, NULL) != 0) {
+                fprintf(stderr, "msh_bench: could not expand \"%s\"\n", line);
+                exit(EXIT_FAILURE);
+            }
+        }
+        ops += 64;
+        end = now_ns();
+    } while (end - start < BENCH_PARSE_NS);
+    printf("expand.vars %.0f ops/s\n", (double)ops * 1e9 / (double)(end - start));
+    msh_pipeline_free(p);
+    msh_sequence_free(s);
+}
+
+//the envp handed to each spawn: as cached, and rebuilt after an exported variable changes
+static void
+bench_environ(void)
+{
+    char value[32];
+    long start, end, ops = 0;
+
+    if (msh_var_export("MSH_BENCH", 9) != 0) {
+        fprintf(stderr, "msh_bench: could not export a variable\n");
+        exit(EXIT_FAILURE);
+    }
+    start = now_ns();
+    do {
+        for (int j = 0; j < 64; j++) {
+            if (msh_var_environ() == NULL) {
+                fprintf(stderr, "msh_bench: no environment\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        ops += 64;
+        end = now_ns();
+    } while (end - start < BENCH_PARSE_NS);
+    printf("env.cached %.0f ops/s\n", (double)ops * 1e9 / (double)(end - start));
+
+    ops = 0;
+    start = now_ns();
+    do {
+        for (int j = 0; j < 64; j++) {
+            snprintf(value, sizeof(value), "%d", j);
+            if (msh_var_set("MSH_BENCH", 9, value) != 0 || msh_var_environ() == NULL) {
+                fprintf(stderr, "msh_bench: no environment\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        ops += 64;
+        end = now_ns();
+    } while (end - start < BENCH_PARSE_NS);
+    printf("env.rebuild %.0f ops/s\n", (double)ops * 1e9 / (double)(end - start));
+}
+
+//lines/s of msh_sequence_parse_batch, for 1, 2, 4, ... threads up to the processors
+static void
+bench_parse_batch(void)
+{
+    static char *lines[BENCH_BATCH_LINES];
+    static struct msh_sequence *seqs[BENCH_BATCH_LINES];
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int i = 0; i < BENCH_BATCH_LINES; i++) {
+        char buf[128];
+
+        snprintf(buf, sizeof(buf), "cat f%d | grep -v x%d | sort -n 1> out%d ; ls -l", i, i, i);
+        lines[i] = strdup(buf);
+        seqs[i] = msh_sequence_alloc();
+        if (lines[i] == NULL || seqs[i] == NULL) {
+            fprintf(stderr, "msh_bench: could not allocate the batch\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    printf("# parse.batch: %ld processors online\n", cpus);
+    for (long t = 1; t <= (cpus > 0 ? cpus : 1); t *= 2) {
+        long start = now_ns(), end;
+
+        if (msh_sequence_parse_batch(lines, seqs, NULL, BENCH_BATCH_LINES, (size_t)t) != 0) {
+            fprintf(stderr, "msh_bench: batch parse failed\n");
+            exit(EXIT_FAILURE);
+        }
+        end = now_ns();
+        printf("parse.batch.%02ld %.0f lines/s\n", t, (double)BENCH_BATCH_LINES * 1e9 / (double)(end - start));
+
+        //empty the sequences for the next round, outside the timing
+        for (int i = 0; i < BENCH_BATCH_LINES; i++) {
+            struct msh_pipeline *p;
+
+            while ((p = msh_sequence_pipeline(seqs[i])) != NULL) {
+                msh_pipeline_free(p);
+            }
+        }
+    }
+    for (int i = 0; i < BENCH_BATCH_LINES; i++) {
+        free(lines[i]);
+        msh_sequence_free(seqs[i]);
+    }
+}
+
+//time a single msh_execute of an already parsed pipeline
+static long
+time_execute(const char *line)
+{
+    char buf[512];
+    struct msh_sequence *s;
+    struct msh_pipeline *p;
+    long start, end;
+
+    s = msh_sequence_alloc();
+    strcpy(buf, line);
+    if (s == NULL || msh_sequence_parse(buf, s) != 0 || (p = msh_sequence_pipeline(s)) == NULL) {
+        fprintf(stderr, "msh_bench: could not parse \"%s\"\n", line);
+        exit(EXIT_FAILURE);
+    }
+    start = now_ns();
+    msh_execute(p);
+    end = now_ns();
+    msh_pipeline_free(p);
+    msh_sequence_free(s);
+
+    return end - start;
+}
+
+static void
+bench_launch(void)
+{
+    int stages[] = { 1, 2, 4, 8, 16 };
+    static long samples[BENCH_LAUNCH_ITERS];
+
+    for (size_t i = 0; i < sizeof(stages) / sizeof(stages[0]); i++) {
+        char line[512];
+
+        build_pipeline(line, sizeof(line), "true", stages[i]);
+        for (int j = 0; j < BENCH_LAUNCH_ITERS; j++) {
+            samples[j] = time_execute(line);
+        }
+        qsort(samples, BENCH_LAUNCH_ITERS, sizeof(long), cmp_long);
+        printf("launch.%02d.p50 %.1f us\n", stages[i], percentile(samples, BENCH_LAUNCH_ITERS, 50) / 1e3);
+        printf("launch.%02d.p90 %.1f us\n", stages[i], percentile(samples, BENCH_LAUNCH_ITERS, 90) / 1e3);
+        printf("launch.%02d.p99 %.1f us\n", stages[i], percentile(samples, BENCH_LAUNCH_ITERS, 99) / 1e3);
+    }
+}
+
+//latency of a $(...): a builtin run in the shell, and a program that has to be forked
+static void
+bench_subst(void)
+{
+    static long samples[BENCH_LAUNCH_ITERS];
+    struct {
+        const char *name;
+        const char *pipeline;
+        const char *expected;
+    } shapes[] = {
+        { "builtin", "echo a b", "a b" },
+        { "fork",    "printf a", "a" },
+    };
+
+    for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+        for (int j = 0; j < BENCH_LAUNCH_ITERS; j++) {
+            long start = now_ns();
+            const char *out = msh_subst_run(shapes[i].pipeline, strlen(shapes[i].pipeline), msh_var_lookup, NULL);
+
+            samples[j] = now_ns() - start;
+            if (strcmp(out, shapes[i].expected) != 0) {
+                fprintf(stderr, "msh_bench: $(%s) gave \"%s\"\n", shapes[i].pipeline, out);
+                exit(EXIT_FAILURE);
+            }
+        }
+        qsort(samples, BENCH_LAUNCH_ITERS, sizeof(long), cmp_long);
+        printf("subst.%s.p50 %.1f us\n", shapes[i].name, percentile(samples, BENCH_LAUNCH_ITERS, 50) / 1e3);
+        printf("subst.%s.p99 %.1f us\n", shapes[i].name, percentile(samples, BENCH_LAUNCH_ITERS, 99) / 1e3);
+    }
+}
+
+static void
+bench_pipe(void)
+{
+    char line[256];
+    long ns;
+
+    snprintf(line, sizeof(line), "head -c %ld /dev/zero | cat | cat 1> /dev/null", BENCH_PIPE_BYTES);
+    ns = time_execute(line);
+    printf("pipe.throughput %.1f MB/s\n", (double)BENCH_PIPE_BYTES / (1024.0 * 1024.0) * 1e9 / (double)ns);
+}
+
+//a large here-document handed to a program, once it has been read
+static void
+bench_here(void)
+{
+    static char text[1024];
+    char buf[] = "wc -c 1> /dev/null << END";
+    struct msh_sequence *s = msh_sequence_alloc();
+    struct msh_pipeline *p;
+    long start, ns;
+
+    memset(text, 'x', sizeof(text) - 1);
+    if (s == NULL || msh_sequence_parse(buf, s) != 0) {
+        fprintf(stderr, "msh_bench: could not parse \"%s\"\n", buf);
+        exit(EXIT_FAILURE);
+    }
+    //a line and its newline at a time
+    for (long n = 0; n < BENCH_HERE_BYTES; n += (long)sizeof(text)) {
+        if (msh_sequence_heredoc_line(s, text) != 0) {
+            fprintf(stderr, "msh_bench: out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (msh_sequence_heredoc_line(s, "END") != 0 || (p = msh_sequence_pipeline(s)) == NULL) {
+        fprintf(stderr, "msh_bench: here-document not ended\n");
+        exit(EXIT_FAILURE);
+    }
+    start = now_ns();
+    msh_execute(p);
+    ns = now_ns() - start;
+    msh_pipeline_free(p);
+    msh_sequence_free(s);
+    printf("here.throughput %.1f MB/s\n", (double)BENCH_HERE_BYTES / (1024.0 * 1024.0) * 1e9 / (double)ns);
+}
+
+static void
+count_completion(const char *str, void *data)
+{
+    (void)str;
+    (*(size_t *)data)++;
+}
+
+//completion over a PATH far bigger than any real one
+static void
+bench_complete(void)
+{
+    static long samples[BENCH_LAUNCH_ITERS];
+    const char *prefixes[] = { "g", "gi", "git-", "x86_64-linux-gnu-g" };
+    struct ptrie *pt = ptrie_allocate();
+    char name[64];
+    size_t found = 0;
+
+    if (pt == NULL) {
+        fprintf(stderr, "msh_bench: could not allocate ptrie\n");
+        exit(EXIT_FAILURE);
+    }
+    srand(1);
+    for (int i = 0; i < BENCH_COMPLETE_NAMES; i++) {
+        snprintf(name, sizeof(name), "%s%c%x", prefixes[rand() % 4], 'a' + rand() % 26, rand());
+        ptrie_add(pt, name);
+    }
+
+    for (int j = 0; j < BENCH_LAUNCH_ITERS; j++) {
+        long start = now_ns();
+
+        ptrie_complete(pt, prefixes[j % 4], count_completion, &found, 256);
+        samples[j] = now_ns() - start;
+    }
+    qsort(samples, BENCH_LAUNCH_ITERS, sizeof(long), cmp_long);
+    printf("complete.ptrie.p50 %.1f us\n", percentile(samples, BENCH_LAUNCH_ITERS, 50) / 1e3);
+    printf("complete.ptrie.p99 %.1f us\n", percentile(samples, BENCH_LAUNCH_ITERS, 99) / 1e3);
+    ptrie_free(pt);
+}
+
+//frecency suggestions over a large history: updates and lookups
+static void
+bench_hint(void)
+{
+    static long samples[BENCH_LAUNCH_ITERS];
+    const char *words[] = { "git", "ls", "make", "grep", "cat", "cd", "vim", "ssh" };
+    struct ptrie *pt = ptrie_allocate();
+    char line[128], best[128];
+    long start, update;
+
+    if (pt == NULL) {
+        fprintf(stderr, "msh_bench: could not allocate ptrie\n");
+        exit(EXIT_FAILURE);
+    }
+    srand(2);
+    start = now_ns();
+    for (int i = 0; i < BENCH_HINT_LINES; i++) {
+        snprintf(line, sizeof(line), "%s %s%d %s%d", words[rand() % 8], words[rand() % 8], rand() % 10000,
+                 words[rand() % 8], rand() % 10000);
+        ptrie_add(pt, line);
+        //later uses score higher, as in the history
+        ptrie_set_score(pt, line, (double)i);
+    }
+    update = now_ns() - start;
+
+    for (int j = 0; j < BENCH_LAUNCH_ITERS; j++) {
+        //a keystroke at a time into some line
+        snprintf(line, sizeof(line), "%s %s%d", words[j % 8], words[(j / 8) % 8], j);
+        line[1 + j % 12] = '\0';
+        start = now_ns();
+        ptrie_autocomplete(pt, line, best, sizeof(best));
+        samples[j] = now_ns() - start;
+    }
+    qsort(samples, BENCH_LAUNCH_ITERS, sizeof(long), cmp_long);
+    printf("hint.update %.2f us\n", update / 1e3 / BENCH_HINT_LINES);
+    printf("hint.p50 %.1f us\n", percentile(samples, BENCH_LAUNCH_ITERS, 50) / 1e3);
+    printf("hint.p99 %.1f us\n", percentile(samples, BENCH_LAUNCH_ITERS, 99) / 1e3);
+    ptrie_free(pt);
+}
+
+//file completion in one huge directory, the first time and once cached
+static void
+bench_dircache(void)
+{
+    static long samples[BENCH_LAUNCH_ITERS];
+    char dir[] = "/tmp/msh_bench_dir_XXXXXX", path[128];
+    const struct msh_dir *d;
+    size_t first;
+    long start, cold;
+
+    if (mkdtemp(dir) == NULL) {
+        perror("msh_bench: mkdtemp");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < BENCH_DIR_ENTRIES; i++) {
+        int fd;
+
+        snprintf(path, sizeof(path), "%s/file%06d.txt", dir, i);
+        fd = open(path, O_CREAT | O_WRONLY, 0644);
+        if (fd == -1) {
+            perror("msh_bench: creating files");
+            exit(EXIT_FAILURE);
+        }
+        close(fd);
+    }
+
+    start = now_ns();
+    d = msh_dircache_get(dir);
+    cold = now_ns() - start;
+    if (d == NULL || d->num_entries != BENCH_DIR_ENTRIES) {
+        fprintf(stderr, "msh_bench: could not list %s\n", dir);
+        exit(EXIT_FAILURE);
+    }
+    for (int j = 0; j < BENCH_LAUNCH_ITERS; j++) {
+        char prefix[16];
+
+        snprintf(prefix, sizeof(prefix), "file%04d", j * 5);
+        start = now_ns();
+        d = msh_dircache_get(dir);
+        msh_dircache_prefix(d, prefix, &first);
+        samples[j] = now_ns() - start;
+    }
+    qsort(samples, BENCH_LAUNCH_ITERS, sizeof(long), cmp_long);
+    printf("complete.dir.cold %.1f us\n", cold / 1e3);
+    printf("complete.dir.p50 %.1f us\n", percentile(samples, BENCH_LAUNCH_ITERS, 50) / 1e3);
+    printf("complete.dir.p99 %.1f us\n", percentile(samples, BENCH_LAUNCH_ITERS, 99) / 1e3);
+
+    for (int i = 0; i < BENCH_DIR_ENTRIES; i++) {
+        snprintf(path, sizeof(path), "%s/file%06d.txt", dir, i);
+        unlink(path);
+    }
+    rmdir(dir);
+    msh_dircache_flush();
+
+    if (percentile(samples, BENCH_LAUNCH_ITERS, 50) / 1000 > BENCH_DIR_TARGET_US) {
+        fprintf(stderr, "msh_bench: cached file completion is over its %d us target\n", BENCH_DIR_TARGET_US);
+        exit(EXIT_FAILURE);
+    }
+}
+
+//`*.log` in a directory of a million files, read the first time and cached, against glob(3)
+static void
+bench_glob(void)
+{
+    char dir[] = "/tmp/msh_bench_glob_XXXXXX", path[128], pattern[64];
+    char *args[] = { "ls", pattern, NULL };
+    long start, cold, cached, libc;
+    size_t argc;
+    glob_t g;
+
+    if (mkdtemp(dir) == NULL) {
+        perror("msh_bench: mkdtemp");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < BENCH_GLOB_ENTRIES; i++) {
+        int fd;
+
+        snprintf(path, sizeof(path), "%s/file%07d.%s", dir, i, i & 1 ? "log" : "txt");
+        fd = open(path, O_CREAT | O_WRONLY, 0644);
+        if (fd == -1) {
+            perror("msh_bench: creating files");
+            exit(EXIT_FAILURE);
+        }
+        close(fd);
+    }
+    snprintf(pattern, sizeof(pattern), "%s/*.log", dir);
+
+    start = now_ns();
+    msh_glob_argv(args, &argc);
+    cold = now_ns() - start;
+    start = now_ns();
+    msh_glob_argv(args, &argc);
+    cached = now_ns() - start;
+    start = now_ns();
+    if (glob(pattern, 0, NULL, &g) != 0) {
+        fprintf(stderr, "msh_bench: glob(3) failed\n");
+        exit(EXIT_FAILURE);
+    }
+    libc = now_ns() - start;
+    if (argc != g.gl_pathc + 1) {
+        fprintf(stderr, "msh_bench: %zu matches, glob(3) found %zu\n", argc - 1, g.gl_pathc);
+        exit(EXIT_FAILURE);
+    }
+    globfree(&g);
+    printf("glob.cold %.1f us\n", cold / 1e3);
+    printf("glob.cached %.1f us\n", cached / 1e3);
+    printf("glob.libc %.1f us\n", libc / 1e3);
+
+    for (int i = 0; i < BENCH_GLOB_ENTRIES; i++) {
+        snprintf(path, sizeof(path), "%s/file%07d.%s", dir, i, i & 1 ? "log" : "txt");
+        unlink(path);
+    }
+    rmdir(dir);
+    msh_dircache_flush();
+}
+
+//runs `./msh < script` with a script of `nlines` identical lines
+static void
+bench_expired(struct msh_timeout *t)
+{
+    (void)t;
+}
+
+/*
+ * Deadlines: the cost of setting and cancelling MSH_TIMEOUT_MAX of them
+ * (at random times an hour away, so none expires), per deadline.
+ */
+static void
+bench_timeout(void)
+{
+    static struct msh_timeout timeouts[MSH_TIMEOUT_MAX];
+    long set = 0, cancel = 0;
+
+    msh_timeout_init(bench_expired);
+    srand(1);
+    for (int r = 0; r < BENCH_TIMEOUT_ROUNDS; r++) {
+        long start = now_ns(), base = start + 3600 * 1000000000L;
+
+        for (size_t i = 0; i < MSH_TIMEOUT_MAX; i++) {
+            msh_timeout_set(&timeouts[i], base + (long)rand() * 1000);
+        }
+        set += now_ns() - start;
+        start = now_ns();
+        for (size_t i = 0; i < MSH_TIMEOUT_MAX; i++) {
+            msh_timeout_cancel(&timeouts[(i * 7919) % MSH_TIMEOUT_MAX]);
+        }
+        cancel += now_ns() - start;
+    }
+    printf("timeout.set %.3f us\n", (double)set / 1e3 / BENCH_TIMEOUT_ROUNDS / MSH_TIMEOUT_MAX);
+    printf("timeout.cancel %.3f us\n", (double)cancel / 1e3 / BENCH_TIMEOUT_ROUNDS / MSH_TIMEOUT_MAX);
+}
+
+static void
+bench_script(const char *name, const char *line, int nlines)
+{
+    char path[] = "/tmp/msh_bench_XXXXXX";
+    int fd, devnull, status;
+    FILE *f;
+    pid_t pid;
+    long start, end;
+
+    fd = mkstemp(path);
+    if (fd == -1 || (f = fdopen(fd, "w")) == NULL) {
+        perror("msh_bench: mkstemp");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < nlines; i++) {
+        fprintf(f, "%s\n", line);
+    }
+    fclose(f);
+
+    start = now_ns();
+    pid = fork();
+    if (pid == -1) {
+        perror("msh_bench: fork");
+        exit(EXIT_FAILURE);
+    } else if (pid == 0) {
+        fd = open(path, O_RDONLY);
+        devnull = open("/dev/null", O_WRONLY);
+        if (fd == -1 || devnull == -1) {
+            perror("msh_bench: open");
+            exit(EXIT_FAILURE);
+        }
+        dup2(fd, STDIN_FILENO);
+        dup2(devnull, STDOUT_FILENO);
+        close(fd);
+        close(devnull);
+        execl("./msh", "msh", (char *)NULL);
+        perror("msh_bench: exec ./msh");
+        exit(EXIT_FAILURE);
+    }
+    waitpid(pid, &status, 0);
+    end = now_ns();
+    unlink(path);
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "msh_bench: ./msh failed on the %s script\n", name);
+        exit(EXIT_FAILURE);
+    }
+    printf("script.%s %.0f lines/s\n", name, (double)nlines * 1e9 / (double)(end - start));
+}
+
+//runs `./msh path`, returning the wall time
+static long
+time_msh_script(const char *name, const char *path)
+{
+    int devnull, status;
+    pid_t pid;
+    long start = now_ns();
+
+    pid = fork();
+    if (pid == -1) {
+        perror("msh_bench: fork");
+        exit(EXIT_FAILURE);
+    } else if (pid == 0) {
+        devnull = open("/dev/null", O_WRONLY);
+        if (devnull == -1) {
+            perror("msh_bench: open");
+            exit(EXIT_FAILURE);
+        }
+        dup2(devnull, STDOUT_FILENO);
+        close(devnull);
+        execl("./msh", "msh", path, (char *)NULL);
+        perror("msh_bench: exec ./msh");
+        exit(EXIT_FAILURE);
+    }
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "msh_bench: ./msh failed on the %s script\n", name);
+        exit(EXIT_FAILURE);
+    }
+    return now_ns() - start;
+}
+
+//the same script of builtins run as text and compiled, so parsing is most of the cost
+static void
+bench_compiled(void)
+{
+    char path[] = "/tmp/msh_bench_XXXXXX", compiled[sizeof(path) + 8];
+    size_t line;
+    int fd;
+    FILE *f;
+
+    fd = mkstemp(path);
+    if (fd == -1 || (f = fdopen(fd, "w")) == NULL) {
+        perror("msh_bench: mkstemp");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < BENCH_SCRIPT_LINES; i++) {
+        fprintf(f, "cd . ; cd . a%d b c d ; cd . 2> /dev/null\n", i);
+    }
+    fclose(f);
+    snprintf(compiled, sizeof(compiled), "%s.mshc", path);
+    if (msh_script_compile(path, compiled, &line) != 0) {
+        perror("msh_bench: compile");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("script.text %.0f lines/s\n", (double)BENCH_SCRIPT_LINES * 1e9 / (double)time_msh_script("text", path));
+    printf("script.compiled %.0f lines/s\n",
+           (double)BENCH_SCRIPT_LINES * 1e9 / (double)time_msh_script("compiled", compiled));
+    unlink(path);
+    unlink(compiled);
+}
+
+/*
+ * 100k runs of a builtin, as a loop (five nested loops of ten words,
+ * the body parsed once) and as the same 100k lines written out.
+ */
+static void
+bench_loop(void)
+{
+    char loop[] = "/tmp/msh_bench_XXXXXX", lines[] = "/tmp/msh_bench_XXXXXX";
+    const char *words = "0 1 2 3 4 5 6 7 8 9";
+    int fd;
+    FILE *f;
+
+    fd = mkstemp(loop);
+    if (fd == -1 || (f = fdopen(fd, "w")) == NULL) {
+        perror("msh_bench: mkstemp");
+        exit(EXIT_FAILURE);
+    }
+    fprintf(f, "for a in %s ; do for b in %s ; do for c in %s ; do\n", words, words, words);
+    fprintf(f, "for d in %s ; do for e in %s ; do\n", words, words);
+    fprintf(f, "cd . $a$b$c$d$e\ndone ; done ; done ; done ; done\n");
+    fclose(f);
+    fd = mkstemp(lines);
+    if (fd == -1 || (f = fdopen(fd, "w")) == NULL) {
+        perror("msh_bench: mkstemp");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < BENCH_LOOP_ITERS; i++) {
+        fprintf(f, "cd . %05d\n", i);
+    }
+    fclose(f);
+
+    printf("loop.for %.0f iters/s\n", (double)BENCH_LOOP_ITERS * 1e9 / (double)time_msh_script("loop", loop));
+    printf("loop.lines %.0f iters/s\n", (double)BENCH_LOOP_ITERS * 1e9 / (double)time_msh_script("lines", lines));
+    unlink(loop);
+    unlink(lines);
+}
+
+//the peak resident memory of a running process, in KB
+static long
+peak_rss_kb(pid_t pid)
+{
+    char path[64], line[256];
+    long kb = -1;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "VmHWM: %ld kB", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+
+    return kb;
+}
+
+/*
+ * A script of `echo first`, n builtin lines, `echo last` and a `cat`
+ * that waits on us: how long until the first output, and how much
+ * memory the shell took by the time it got to the end. (The rusage of
+ * the child would include the bench's own memory from before exec.)
+ */
+static void
+bench_stream(const char *name, int n)
+{
+    char path[] = "/tmp/msh_bench_XXXXXX";
+    char buf[64];
+    int fd, in[2], out[2], status;
+    size_t got = 0;
+    long start, first = 0, rss;
+    ssize_t r;
+    FILE *f;
+    pid_t pid;
+
+    fd = mkstemp(path);
+    if (fd == -1 || (f = fdopen(fd, "w")) == NULL) {
+        perror("msh_bench: mkstemp");
+        exit(EXIT_FAILURE);
+    }
+    fprintf(f, "echo first\n");
+    for (int i = 0; i < n; i++) {
+        fprintf(f, "cd . a%d b c d\n", i);
+    }
+    fprintf(f, "echo last\ncat\n");
+    fclose(f);
+    if (pipe(in) == -1 || pipe(out) == -1) {
+        perror("msh_bench: pipe");
+        exit(EXIT_FAILURE);
+    }
+
+    start = now_ns();
+    pid = fork();
+    if (pid == -1) {
+        perror("msh_bench: fork");
+        exit(EXIT_FAILURE);
+    } else if (pid == 0) {
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        close(in[0]);
+        close(in[1]);
+        close(out[0]);
+        close(out[1]);
+        execl("./msh", "msh", path, (char *)NULL);
+        perror("msh_bench: exec ./msh");
+        exit(EXIT_FAILURE);
+    }
+    close(in[0]);
+    close(out[1]);
+    //"first\nlast\n"
+    while (got < 11 && (r = read(out[0], buf + got, sizeof(buf) - got)) > 0) {
+        if (got == 0) {
+            first = now_ns();
+        }
+        got += (size_t)r;
+    }
+    rss = peak_rss_kb(pid);
+    close(in[1]);
+    close(out[0]);
+    waitpid(pid, &status, 0);
+    unlink(path);
+    if (got < 11 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "msh_bench: ./msh failed on the %s script\n", name);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("script.first.%s %.1f us\n", name, (double)(first - start) / 1e3);
+    printf("script.rss.%s %ld KB\n", name, rss);
+}
+
+int
+main(void)
+{
+    printf("# msh benchmark: <metric> <value> <unit>\n");
+    bench_parse();
+    bench_expand();
+    bench_environ();
+    bench_parse_batch();
+    bench_launch();
+    bench_subst();
+    bench_pipe();
+    bench_here();
+    bench_complete();
+    bench_hint();
+    bench_dircache();
+    bench_glob();
+    bench_timeout();
+    bench_script("builtin", "cd .", 20000);
+    bench_script("spawn", "true", 2000);
+    bench_compiled();
+    bench_stream("1k", 1000);
+    bench_stream("1m", 1000000);
+    bench_loop();
+
+    return 0;
+}
@@ -2,6 +2,8 @@
 
 /* Maximum number of background pipelines */
 #define MSH_MAXBACKGROUND 16
+/* Maximum number of pipelines (foreground and background) tracked as jobs */
+#define MSH_MAXJOBS 50
 /* each command can have MSH_MAXARGS or fewer arguments */
 #define MSH_MAXARGS  16
 /* each pipeline has MSH_MAXCMNDS or fewer commands */
@@ -61,6 +63,10 @@ typedef enum {
 	MSH_ERR_SEQ_REDIR_OR_BACKGROUND_MISSING_CMD = -11,
 	/* The sequence still has pipelines, cannot add more  */
 	MSH_ERR_SEQ_BUSY = -12,
+	/* A command substitution isn't closed, e.g. "echo $(ls" */
+	MSH_ERR_UNTERMINATED_SUBST = -13,
+	/* The input ended before a here-document's end word, e.g. "cat << END" */
+	MSH_ERR_UNTERMINATED_HEREDOC = -14,
 } msh_err_t;
 
 /* Return a human-readable string corresponding to an msh error */
@@ -80,12 +86,17 @@ msh_pipeline_err2str(msh_err_t e)
 		"Could not execute program",
 		"Attempted to redirect output to pipe and to file redirection",
 		"A pipeline has a redirection or &, but no command",
-		"Attempted to parse into sequence, when it still has pipelines"
+		"Attempted to parse into sequence, when it still has pipelines",
+		"Command substitution without its closing )",
+		"Here-document without its end"
 	};
 
 	return strs[-e];
 }
 
+/* The names of the builtin commands, `NULL`-terminated */
+extern char *msh_builtin_names[];
+
 /**
  * `msh_init` is called on initialization. You can place anything
  * you'd like here, but for M2, you'll likely want to set up signal
@@ -99,3 +110,17 @@ void msh_init(void);
  * only return after the pipeline completes.
  */
 void msh_execute(struct msh_pipeline *p);
+
+/**
+ * `msh_status` returns the exit status of the last pipeline run in the
+ * foreground: that of its last command (`128` plus the signal if it was
+ * killed or stopped), or `0` for builtins and background pipelines.
+ */
+int msh_status(void);
+
+/**
+ * `msh_forked` is called in a child the shell forked to run pipelines
+ * on its behalf, like the builtins of a substitution. The child leaves
+ * the shell's shared job table to the shell.
+ */
+void msh_forked(void);
@@ -0,0 +1,426 @@
+#define _GNU_SOURCE
+
+#include <msh.h>
+#include <msh_complete.h>
+#include <msh_dircache.h>
+#include <msh_history.h>
+#include <msh_prefetch.h>
+#include <msh_var.h>
+#include <ptrie.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+
+/* PATH directories are checked for changes at most this often */
+#define MSH_COMPLETE_RECHECK_NS 1000000000L
+
+//a PATH directory and the executables we found in it
+struct path_dir {
+    char *path;
+    struct timespec mtime;
+    //sorted, so rescans can be diffed
+    char **names;
+    size_t num_names;
+};
+
+//the index, guarded by lock
+static struct ptrie *programs = NULL;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+//the PATH the indexer should reflect, set by the shell under lock
+static char *requested_path = NULL;
+static int rescan_requested = 0;
+
+//owned by the indexer thread
+static struct path_dir *dirs = NULL;
+static size_t num_dirs = 0;
+static char *indexed_path = NULL;
+
+static int
+cmp_str(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static void
+free_names(char **names, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        free(names[i]);
+    }
+    free(names);
+}
+
+//list the executables in a directory, sorted
+static char **
+scan_dir(const char *path, size_t *n)
+{
+    DIR *dir = opendir(path);
+    struct dirent *d;
+    char **names = NULL;
+    size_t cap = 0;
+
+    *n = 0;
+    if (dir == NULL) {
+        return NULL;
+    }
+    while ((d = readdir(dir)) != NULL) {
+        struct stat st;
+
+        if (d->d_name[0] == '.' || d->d_type == DT_DIR) {
+            continue;
+        }
+        //only regular files we may execute, symlinks followed
+        if (fstatat(dirfd(dir), d->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode) ||
+            faccessat(dirfd(dir), d->d_name, X_OK, 0) != 0) {
+            continue;
+        }
+        if (*n == cap) {
+            char **grown;
+
+            cap = cap ? cap * 2 : 64;
+            grown = realloc(names, cap * sizeof(char *));
+            if (grown == NULL) {
+                break;
+            }
+            names = grown;
+        }
+        names[*n] = strdup(d->d_name);
+        if (names[*n] != NULL) {
+            (*n)++;
+        }
+    }
+    closedir(dir);
+    qsort(names, *n, sizeof(char *), cmp_str);
+
+    return names;
+}
+
+//rescan a directory if it changed, applying only the differences
+static void
+refresh_dir(struct path_dir *pd)
+{
+    struct stat st;
+    char **names;
+    size_t n, i = 0, j = 0;
+
+    if (stat(pd->path, &st) != 0) {
+        st.st_mtim.tv_sec = 0;
+        st.st_mtim.tv_nsec = 0;
+    }
+    if (pd->names != NULL && st.st_mtim.tv_sec == pd->mtime.tv_sec && st.st_mtim.tv_nsec == pd->mtime.tv_nsec) {
+        return;
+    }
+    //the directory is read without holding the lock
+    names = scan_dir(pd->path, &n);
+
+    pthread_mutex_lock(&lock);
+    //merge the two sorted lists
+    while (i < pd->num_names || j < n) {
+        int c = i == pd->num_names ? 1 : j == n ? -1 : strcmp(pd->names[i], names[j]);
+
+        if (c < 0) {
+            ptrie_remove(programs, pd->names[i++]);
+        } else if (c > 0) {
+            ptrie_add(programs, names[j++]);
+        } else {
+            i++;
+            j++;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+
+    free_names(pd->names, pd->num_names);
+    pd->names = names;
+    pd->num_names = n;
+    pd->mtime = st.st_mtim;
+}
+
+//forget the old PATH directories and set up the new ones
+static void
+reset_dirs(const char *path_env)
+{
+    for (size_t i = 0; i < num_dirs; i++) {
+        pthread_mutex_lock(&lock);
+        for (size_t j = 0; j < dirs[i].num_names; j++) {
+            ptrie_remove(programs, dirs[i].names[j]);
+        }
+        pthread_mutex_unlock(&lock);
+        free_names(dirs[i].names, dirs[i].num_names);
+        free(dirs[i].path);
+    }
+    free(dirs);
+    dirs = NULL;
+    num_dirs = 0;
+    free(indexed_path);
+    indexed_path = strdup(path_env);
+
+    for (const char *dir = path_env; dir != NULL; ) {
+        const char *end = strchr(dir, ':');
+        size_t len = end ? (size_t)(end - dir) : strlen(dir);
+        struct path_dir *grown = realloc(dirs, (num_dirs + 1) * sizeof(*dirs));
+
+        if (grown == NULL) {
+            break;
+        }
+        dirs = grown;
+        //an empty entry is the current directory
+        dirs[num_dirs] = (struct path_dir) { .path = len ? strndup(dir, len) : strdup(".") };
+        if (dirs[num_dirs].path != NULL) {
+            num_dirs++;
+        }
+        dir = end ? end + 1 : NULL;
+    }
+}
+
+static void *
+indexer_thread(void *arg)
+{
+    (void)arg;
+
+    while (1) {
+        char *path_env;
+
+        pthread_mutex_lock(&lock);
+        while (!rescan_requested) {
+            pthread_cond_wait(&wake, &lock);
+        }
+        rescan_requested = 0;
+        path_env = strdup(requested_path != NULL ? requested_path : "");
+        pthread_mutex_unlock(&lock);
+        if (path_env == NULL) {
+            continue;
+        }
+
+        if (indexed_path == NULL || strcmp(indexed_path, path_env) != 0) {
+            reset_dirs(path_env);
+        }
+        for (size_t i = 0; i < num_dirs; i++) {
+            refresh_dir(&dirs[i]);
+        }
+        free(path_env);
+    }
+
+    return NULL;
+}
+
+//ask the indexer to catch up with PATH and the directories' contents
+static void
+request_rescan(void)
+{
+    const char *path_env = msh_var_get("PATH", 4);
+
+    pthread_mutex_lock(&lock);
+    if (requested_path == NULL || strcmp(requested_path, path_env ? path_env : "") != 0) {
+        free(requested_path);
+        requested_path = strdup(path_env ? path_env : "");
+    }
+    rescan_requested = 1;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+}
+
+void
+msh_complete_init(void)
+{
+    programs = ptrie_allocate();
+}
+
+//start indexing on the first keystroke, rather than before the first prompt
+static void
+indexer_start(void)
+{
+    static int started = 0;
+    pthread_t indexer;
+    pthread_attr_t attr;
+    sigset_t all, old;
+
+    if (started || programs == NULL) {
+        return;
+    }
+    started = 1;
+    request_rescan();
+
+    //nobody joins the indexer, it lives as long as the shell
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    //signals are the main thread's to handle: cntrl-c, cntrl-z, the deadlines' SIGALRM
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    if (pthread_create(&indexer, &attr, indexer_thread, NULL) != 0) {
+        perror("msh: completion indexer");
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    pthread_attr_destroy(&attr);
+}
+
+struct completion_ctx {
+    linenoiseCompletions *lc;
+    //the line up to the word being completed
+    const char *line;
+    size_t line_len;
+};
+
+static void
+add_completion(const char *word, void *data)
+{
+    struct completion_ctx *ctx = data;
+    char buf[4096];
+
+    snprintf(buf, sizeof(buf), "%.*s%s", (int)ctx->line_len, ctx->line, word);
+    linenoiseAddCompletion(ctx->lc, buf);
+}
+
+static long
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+//is the word starting at buf[start] the program of its command?
+static int
+is_program_position(const char *buf, size_t start)
+{
+    while (start > 0 && buf[start - 1] == ' ') {
+        start--;
+    }
+    return start == 0 || buf[start - 1] == '|' || buf[start - 1] == ';';
+}
+
+//complete a file name from its directory's cached listing
+static void
+complete_file(const char *buf, const char *word, linenoiseCompletions *lc)
+{
+    const char *base = strrchr(word, '/');
+    const struct msh_dir *dir;
+    char dirpath[4096];
+    size_t first, n;
+
+    if (base == NULL) {
+        base = word;
+        strcpy(dirpath, ".");
+    } else {
+        base++;
+        //"/x" lists the root, "a/b/x" lists "a/b"
+        snprintf(dirpath, sizeof(dirpath), "%.*s", base - word > 1 ? (int)(base - word - 1) : 1, word);
+    }
+    dir = msh_dircache_get(dirpath);
+    if (dir == NULL) {
+        return;
+    }
+
+    n = msh_dircache_prefix(dir, base, &first);
+    for (size_t i = first; i < first + n && lc->len < MSH_COMPLETE_MAX; i++) {
+        const char *name = dir->names[i];
+        int is_dir = dir->types[i] == DT_DIR;
+        char line[4096];
+
+        //hidden files only complete when asked for
+        if (name[0] == '.' && base[0] != '.') {
+            continue;
+        }
+        //the filesystem didn't say, or it's a link that may lead to a directory
+        if (dir->types[i] == DT_UNKNOWN || dir->types[i] == DT_LNK) {
+            struct stat st;
+            char path[8192];
+
+            snprintf(path, sizeof(path), "%s/%s", dirpath, name);
+            is_dir = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+        }
+        snprintf(line, sizeof(line), "%.*s%s%s", (int)(base - buf), buf, name, is_dir ? "/" : "");
+        linenoiseAddCompletion(lc, line);
+    }
+}
+
+static void
+add_history_line(const char *line, size_t len, unsigned long count, unsigned long last, void *data)
+{
+    char buf[4096];
+
+    (void)count;
+    (void)last;
+    snprintf(buf, sizeof(buf), "%.*s", (int)len, line);
+    linenoiseAddCompletion(data, buf);
+}
+
+void
+msh_complete(const char *buf, linenoiseCompletions *lc)
+{
+    static long last_check = 0;
+    struct completion_ctx ctx = { .lc = lc, .line = buf };
+    const char *word = strrchr(buf, ' ');
+    size_t found = 0;
+
+    //"!?text" searches the history, each <TAB> steps back to an older line
+    if (strncmp(buf, "!?", 2) == 0) {
+        msh_history_search(buf + 2, add_history_line, lc, MSH_COMPLETE_MAX);
+        return;
+    }
+
+    indexer_start();
+    word = word ? word + 1 : buf;
+    ctx.line_len = (size_t)(word - buf);
+    //arguments, and programs given by path, are files
+    if (!is_program_position(buf, ctx.line_len) || strchr(word, '/') != NULL) {
+        complete_file(buf, word, lc);
+        return;
+    }
+
+    //let the indexer pick up new programs, without waiting for it
+    if (now_ns() - last_check > MSH_COMPLETE_RECHECK_NS) {
+        last_check = now_ns();
+        request_rescan();
+    }
+
+    for (size_t i = 0; msh_builtin_names[i] != NULL; i++) {
+        if (strncmp(msh_builtin_names[i], word, strlen(word)) == 0) {
+            add_completion(msh_builtin_names[i], &ctx);
+            found++;
+        }
+    }
+    //while the indexer holds the trie, only the builtins complete
+    if (programs != NULL && pthread_mutex_trylock(&lock) == 0) {
+        ptrie_complete(programs, word, add_completion, &ctx, MSH_COMPLETE_MAX - found);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+char *
+msh_hint(const char *buf, int *color, int *bold)
+{
+    static char line[4096];
+    size_t len = strlen(buf);
+    int suggested = len > 0 && msh_history_suggest(buf, line, sizeof(line)) == 0;
+    const char *typed = suggested ? line : buf;
+    size_t word = strcspn(typed, " |;");
+
+    indexer_start();
+
+    //the program being typed (or suggested) will probably run soon
+    if (typed[word] != '\0' && word > 0 && word < MSH_PREFETCH_NAMELEN) {
+        char program[MSH_PREFETCH_NAMELEN];
+
+        memcpy(program, typed, word);
+        program[word] = '\0';
+        msh_prefetch_program(program);
+    }
+    if (!suggested || strlen(line) == len) {
+        return NULL;
+    }
+    //dim grey, like the suggestion it is
+    *color = 90;
+    *bold = 0;
+
+    return line + len;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <linenoise.h>
+
+/***
+ * Tab completion for the shell's input. Program names (the first word
+ * of each command) complete from a prefix trie of the builtins and of
+ * every executable in the `PATH` directories. The trie is built by a
+ * background thread, started on the first keystroke so that the first
+ * prompt isn't delayed, and is
+ * kept up to date by rescanning only the directories whose
+ * modification time changed. Every other word completes as a file
+ * name, from listings kept in the directory cache. A line starting
+ * with `!?` completes to the history lines containing the rest of it,
+ * most recent first.
+ */
+
+/* at most this many completions are offered for one <TAB> */
+#define MSH_COMPLETE_MAX 256
+
+/**
+ * `msh_complete_init` sets up completion; the background thread
+ * indexing `PATH` is only started once the user starts typing.
+ */
+void msh_complete_init(void);
+
+/**
+ * `msh_complete` is the `linenoiseSetCompletionCallback` callback.
+ *
+ * - `@buf` - the line typed so far.
+ * - `@lc` - the completions, each a full replacement for the line.
+ */
+void msh_complete(const char *buf, linenoiseCompletions *lc);
+
+/**
+ * `msh_hint` is the `linenoiseSetHintsCallback` callback: it shows the
+ * rest of the history line with the best frecency that starts with
+ * what has been typed. Once the program of the line is known, it is
+ * prefetched.
+ *
+ * - `@buf` - the line typed so far.
+ * - `@color` - set to the hint's color.
+ * - `@bold` - set to whether the hint is bold.
+ * - `@return` - the hint, in a static buffer, or `NULL` for none.
+ */
+char *msh_hint(const char *buf, int *color, int *bold);
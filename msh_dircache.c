@@ -0,0 +1,258 @@
+#define _GNU_SOURCE
+
+#include <msh_dircache.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+
+/* size of each getdents64 batch */
+#define MSH_DIRCACHE_BATCH (64 * 1024)
+/* a listing read this soon after the directory changed may miss a change in the same tick */
+#define MSH_DIRCACHE_RACY_NS (20 * 1000 * 1000L)
+
+//the layout the getdents64 system call fills in
+struct linux_dirent64 {
+    unsigned long d_ino;
+    long d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+//a cached listing, on the LRU list (most recently used first)
+struct cached_dir {
+    struct msh_dir dir;
+    //the directory, whatever path it was reached by
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    //read too soon after it changed to be trusted, so it is read again
+    int racy;
+    //all the names, back to back
+    char *strings;
+    size_t bytes;
+    struct cached_dir *prev, *next;
+};
+
+static struct cached_dir *lru_head = NULL, *lru_tail = NULL;
+static size_t cache_bytes = 0;
+
+static void
+lru_unlink(struct cached_dir *c)
+{
+    if (c->prev) c->prev->next = c->next;
+    else lru_head = c->next;
+    if (c->next) c->next->prev = c->prev;
+    else lru_tail = c->prev;
+    c->prev = c->next = NULL;
+}
+
+static void
+lru_push(struct cached_dir *c)
+{
+    c->prev = NULL;
+    c->next = lru_head;
+    if (lru_head) lru_head->prev = c;
+    lru_head = c;
+    if (lru_tail == NULL) lru_tail = c;
+}
+
+static void
+cached_dir_free(struct cached_dir *c)
+{
+    lru_unlink(c);
+    cache_bytes -= c->bytes;
+    free(c->dir.names);
+    free(c->dir.types);
+    free(c->strings);
+    free(c);
+}
+
+void
+msh_dircache_flush(void)
+{
+    while (lru_head != NULL) {
+        cached_dir_free(lru_head);
+    }
+}
+
+//an entry while reading, before it is sorted
+struct raw_entry {
+    size_t offset;
+    unsigned char type;
+};
+
+//qsort has no context argument, so the strings being sorted are here
+static const char *sort_strings;
+
+static int
+cmp_entry(const void *a, const void *b)
+{
+    return strcmp(sort_strings + ((const struct raw_entry *)a)->offset,
+                  sort_strings + ((const struct raw_entry *)b)->offset);
+}
+
+//read a whole directory; NULL if it can't be read
+static struct cached_dir *
+read_dir(const char *path, const struct stat *st)
+{
+    static char buf[MSH_DIRCACHE_BATCH];
+    struct cached_dir *c = NULL;
+    struct raw_entry *entries = NULL;
+    size_t cap = 0, len = 0, strcap = 0, n = 0;
+    char *strings = NULL;
+    struct timespec now;
+    long nread;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        return NULL;
+    }
+    while ((nread = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+        for (long pos = 0; pos < nread; ) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + pos);
+            size_t namelen = strlen(d->d_name) + 1;
+
+            pos += d->d_reclen;
+            if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0) {
+                continue;
+            }
+            if (n == cap) {
+                struct raw_entry *grown;
+
+                cap = cap ? cap * 2 : 256;
+                grown = realloc(entries, cap * sizeof(*entries));
+                if (grown == NULL) {
+                    goto fail;
+                }
+                entries = grown;
+            }
+            if (len + namelen > strcap) {
+                char *grown;
+
+                strcap = strcap ? strcap * 2 : 4096;
+                if (strcap < len + namelen) strcap = len + namelen;
+                grown = realloc(strings, strcap);
+                if (grown == NULL) {
+                    goto fail;
+                }
+                strings = grown;
+            }
+            memcpy(strings + len, d->d_name, namelen);
+            entries[n].offset = len;
+            entries[n].type = d->d_type;
+            len += namelen;
+            n++;
+        }
+    }
+    if (nread == -1) {
+        goto fail;
+    }
+
+    c = calloc(1, sizeof(*c));
+    if (c == NULL || (c->dir.names = malloc((n + 1) * sizeof(char *))) == NULL ||
+        (c->dir.types = malloc(n + 1)) == NULL) {
+        goto fail;
+    }
+    sort_strings = strings;
+    qsort(entries, n, sizeof(*entries), cmp_entry);
+    for (size_t i = 0; i < n; i++) {
+        c->dir.names[i] = strings + entries[i].offset;
+        c->dir.types[i] = entries[i].type;
+    }
+    c->dir.num_entries = n;
+    c->strings = strings;
+    c->dev = st->st_dev;
+    c->ino = st->st_ino;
+    c->mtime = st->st_mtim;
+    clock_gettime(CLOCK_REALTIME, &now);
+    c->racy = (now.tv_sec - c->mtime.tv_sec) * 1000000000L + (now.tv_nsec - c->mtime.tv_nsec) < MSH_DIRCACHE_RACY_NS;
+    c->bytes = sizeof(*c) + strcap + n * (sizeof(char *) + 1);
+    close(fd);
+    free(entries);
+
+    return c;
+fail:
+    if (c != NULL) {
+        free(c->dir.names);
+        free(c->dir.types);
+        free(c);
+    }
+    close(fd);
+    free(entries);
+    free(strings);
+    return NULL;
+}
+
+const struct msh_dir *
+msh_dircache_get(const char *path)
+{
+    struct cached_dir *c;
+    struct stat st;
+
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return NULL;
+    }
+    //"." is another directory after a cd, so the path isn't what identifies it
+    for (c = lru_head; c != NULL; c = c->next) {
+        if (c->ino == st.st_ino && c->dev == st.st_dev) {
+            break;
+        }
+    }
+    if (c != NULL) {
+        if (!c->racy && c->mtime.tv_sec == st.st_mtim.tv_sec && c->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+            lru_unlink(c);
+            lru_push(c);
+            return &c->dir;
+        }
+        //the directory changed, read it again
+        cached_dir_free(c);
+    }
+
+    c = read_dir(path, &st);
+    if (c == NULL) {
+        return NULL;
+    }
+    lru_push(c);
+    cache_bytes += c->bytes;
+    //evict, but always keep the listing being returned
+    while (cache_bytes > MSH_DIRCACHE_BUDGET && lru_tail != c) {
+        cached_dir_free(lru_tail);
+    }
+
+    return &c->dir;
+}
+
+size_t
+msh_dircache_prefix(const struct msh_dir *dir, const char *prefix, size_t *first)
+{
+    size_t len = strlen(prefix), lo = 0, hi = dir->num_entries, end;
+
+    //the first entry not less than the prefix...
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (strcmp(dir->names[mid], prefix) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    *first = lo;
+    //...up to the first one after every name starting with it
+    hi = dir->num_entries;
+    end = lo;
+    while (end < hi) {
+        size_t mid = end + (hi - end) / 2;
+
+        if (strncmp(dir->names[mid], prefix, len) <= 0) end = mid + 1;
+        else hi = mid;
+    }
+
+    return end - lo;
+}
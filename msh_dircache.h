@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+
+/***
+ * A cache of directory listings. A directory is read once, with large
+ * batched `getdents64` calls, and its sorted listing is reused until
+ * the directory's modification time changes. Listings are found by the
+ * directory's device and inode, not its path, and one read in the same
+ * timestamp tick as a change to the directory isn't reused. Listings
+ * are evicted least recently used first once the cache outgrows its
+ * memory budget.
+ */
+
+/* memory the cached listings may use before eviction */
+#define MSH_DIRCACHE_BUDGET (32 * 1024 * 1024)
+
+struct msh_dir {
+    /* the entries' names, sorted, without "." and ".." */
+    char **names;
+    /* the `d_type` of each entry (`DT_UNKNOWN` if the filesystem didn't say) */
+    unsigned char *types;
+    size_t num_entries;
+};
+
+/**
+ * `msh_dircache_get` returns the listing of a directory.
+ *
+ * - `@path` - the directory.
+ * - `@return` - the listing, borrowed from the cache and only valid
+ *     until the next `msh_dircache_get`, or `NULL` if the directory
+ *     couldn't be read.
+ */
+const struct msh_dir *msh_dircache_get(const char *path);
+
+/**
+ * `msh_dircache_prefix` finds the entries starting with `prefix`.
+ *
+ * - `@dir` - a listing from `msh_dircache_get`.
+ * - `@prefix` - the prefix to look for.
+ * - `@first` - set to the index of the first matching entry.
+ * - `@return` - the number of matching entries, which are consecutive.
+ */
+size_t msh_dircache_prefix(const struct msh_dir *dir, const char *prefix, size_t *first);
+
+/**
+ * `msh_dircache_flush` forgets every cached listing.
+ */
+void msh_dircache_flush(void);
@@ -1,64 +1,74 @@
 //found on stack overflow to get rid of errors
 #define _XOPEN_SOURCE 700
+//for wait4
+#define _DEFAULT_SOURCE
+//for memfd_create and its seals
+#define _GNU_SOURCE
 
 #include <msh.h>
-#include <msh_parse.h>
+//the shell reads the parsed commands in place, in the parser's own layout
+#include <msh_parse_internal.h>
+#include <msh_path.h>
+#include <msh_histogram.h>
+#include <msh_stats.h>
+#include <msh_log.h>
+#include <msh_shm.h>
+#include <msh_history.h>
+#include <msh_prefetch.h>
+#include <msh_var.h>
+#include <msh_glob.h>
+#include <msh_split.h>
+#include <msh_memo.h>
+#include <msh_update.h>
+#include <msh_timeout.h>
 
 #include <signal.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <stdio.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
 
-/**
- * A sequence of pipelines. Pipelines are separated by ";"s, enabling
- * a sequence to define a sequence of pipelines that execute one after
- * the other. A pipeline can run in the background, which enables us
- * to move on an execute the next pipeline.
- */
-struct msh_sequence {
-	struct msh_pipeline *pipelines[MSH_MAXCMNDS];
-    size_t num_pipelines;
-};
+extern char **environ;
 
-/**
- * A pipeline is a sequence of commands, separated by "|"s. The output
- * of a preceding command (before the "|") gets passed to the input of
- * the next (after the "|").
- */
-struct msh_pipeline {
-	struct msh_command *commands[MSH_MAXCMNDS];
-    size_t num_commands;
-    int background;
-};
-
-/**
- * Each command corresponds to either a program (in the `PATH`
- * environment variable, see `echo $PATH`), or a builtin command like
- * `cd`. Commands are passed arguments.
- */
-struct msh_command {
-	char *program;
-    char *args[MSH_MAXARGS];
-    int numberArgs;
-    int final;
-    void *data;
-    msh_free_data_fn_t fn;
-    char *stdout_file;
-    char *stderr_file;
+//one process of a job, filled in when it is reaped
+struct job_stage {
+    pid_t pid;
+    int status;
+    struct rusage ru;
+    //reaped, so its pid may be another process's by now
+    int done;
 };
 
 struct jobs {
     pid_t pid;
-    char command[256];
+    //the pipeline's input, owned by the job
+    char *command;
+    //stages not reaped yet
     int waiting;
+    //the slot is in use
     int working;
+    //run with & (or moved there by cntrl-z, then also stopped)
+    int background;
+    int stopped;
+    //creation order, for the jobs builtin
+    unsigned long id;
+    struct timespec start;
+    size_t num_stages;
+    struct job_stage stages[MSH_MAXCMNDS];
+    //its deadline, and the SIGTERM it sent when it expired
+    struct msh_timeout timeout;
+    long grace_ns;
+    int timed_out;
 };
 
-struct jobs jobs[50];
+struct jobs jobs[MSH_MAXJOBS];
 volatile pid_t waiting = 0;
 
 //track the pids running
@@ -69,13 +79,496 @@ size_t foreground_num_pids = 0;
 pid_t background_pids[20];
 size_t num_background_pids = 0;
 
+//set by cntrl-c so loops over many pipelines (bench) can stop
+volatile sig_atomic_t sigint_received = 0;
+
+/* slots for children we started and haven't reaped, a power of two */
+#define MSH_CHILD_SLOTS 512
+
+//a started child, found by pid when it is reaped
+struct child {
+    pid_t pid;
+    long start_ns;
+    struct msh_stat *stat;
+    //the job it belongs to, if it could be tracked
+    struct jobs *job;
+    size_t stage;
+};
+
+//open addressing on the pid, 0 marks a free slot
+static struct child children[MSH_CHILD_SLOTS];
+static size_t num_children = 0;
+//the shell itself, as opposed to a forked child calling exit
+static pid_t shell_pid = 0;
+
+static long
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+//the job table is shared once the first job starts, unless MSH_JOBSHM=0
+static int shm_wanted = 0;
+
+//mirror the job into the shared memory job table for mshtop
+static void
+job_publish(struct jobs *job)
+{
+    pid_t pids[MSH_MAXCMNDS];
+    int state;
+
+    if (!job->working) {
+        state = MSH_SHM_FREE;
+    } else if (job->stopped) {
+        state = MSH_SHM_STOPPED;
+    } else {
+        state = job->background ? MSH_SHM_BACKGROUND : MSH_SHM_FOREGROUND;
+    }
+    for (size_t i = 0; i < job->num_stages; i++) {
+        pids[i] = job->stages[i].pid;
+    }
+    //the region is only created once there is a job to show, off the startup path
+    if (shm_wanted) {
+        shm_wanted = 0;
+        if (msh_shm_open() != 0) {
+            perror("msh: shared job table");
+        }
+    }
+    msh_shm_publish((size_t)(job - jobs), state,
+                    (int64_t)job->start.tv_sec * 1000000000 + job->start.tv_nsec,
+                    pids, job->num_stages, job->command);
+}
+
+//take a free job slot for the pipeline, NULL if they're all in use
+static struct jobs *
+job_start(struct msh_pipeline *p)
+{
+    static unsigned long next_id = 0;
+    char *input = msh_pipeline_input(p);
+
+    for (size_t i = 0; i < MSH_MAXJOBS; i++) {
+        struct jobs *job = &jobs[i];
+
+        if (!job->working) {
+            job->command = strdup(input != NULL ? input : "");
+            if (job->command == NULL) {
+                return NULL;
+            }
+            job->working = 1;
+            job->waiting = 0;
+            job->num_stages = 0;
+            job->pid = 0;
+            job->background = msh_pipeline_background(p);
+            job->stopped = 0;
+            job->timed_out = 0;
+            job->id = next_id++;
+            clock_gettime(CLOCK_REALTIME, &job->start);
+
+            return job;
+        }
+    }
+
+    return NULL;
+}
+
+/* timed out background jobs the next jobs reports, the latest ones */
+#define MSH_TIMEOUT_REPORTS 8
+
+static char *timed_out[MSH_TIMEOUT_REPORTS];
+static size_t num_timed_out = 0;
+
+//all of a job's processes are reaped: log it and free the slot
+static void
+job_finished(struct jobs *job)
+{
+    struct msh_log_stage stages[MSH_MAXCMNDS];
+    struct timespec end;
+
+    clock_gettime(CLOCK_REALTIME, &end);
+    for (size_t i = 0; i < job->num_stages; i++) {
+        struct rusage *ru = &job->stages[i].ru;
+
+        stages[i] = (struct msh_log_stage) {
+            .pid = job->stages[i].pid,
+            .status = job->stages[i].status,
+            .utime_us = ru->ru_utime.tv_sec * 1000000L + ru->ru_utime.tv_usec,
+            .stime_us = ru->ru_stime.tv_sec * 1000000L + ru->ru_stime.tv_usec,
+            .maxrss_kb = ru->ru_maxrss,
+            .minflt = ru->ru_minflt,
+            .majflt = ru->ru_majflt,
+            .nvcsw = ru->ru_nvcsw,
+            .nivcsw = ru->ru_nivcsw,
+        };
+    }
+    msh_log_pipeline(job->command, &job->start, &end, stages, job->num_stages);
+
+    msh_timeout_cancel(&job->timeout);
+    //a background job that timed out is reported by the next jobs
+    if (job->timed_out && job->background) {
+        if (num_timed_out == MSH_TIMEOUT_REPORTS) {
+            free(timed_out[0]);
+            memmove(timed_out, timed_out + 1, (MSH_TIMEOUT_REPORTS - 1) * sizeof(char *));
+            num_timed_out--;
+        }
+        timed_out[num_timed_out++] = job->command;
+    } else {
+        free(job->command);
+    }
+    job->command = NULL;
+    job->working = 0;
+    job_publish(job);
+}
+
+//remember when a child started, which program it runs and its job
+static void
+child_started(pid_t pid, char *program, long start, struct jobs *job)
+{
+    size_t idx = (size_t)pid & (MSH_CHILD_SLOTS - 1);
+    sigset_t old;
+
+    //keep the table at most half full, untracked children aren't counted
+    if (num_children >= MSH_CHILD_SLOTS / 2) {
+        return;
+    }
+    //an expiring deadline looks at the job's stages
+    msh_timeout_hold(&old);
+    while (children[idx].pid != 0) {
+        idx = (idx + 1) & (MSH_CHILD_SLOTS - 1);
+    }
+    children[idx].pid = pid;
+    children[idx].start_ns = start;
+    children[idx].stat = msh_stats_lookup(program);
+    children[idx].job = job;
+    if (job != NULL) {
+        children[idx].stage = job->num_stages++;
+        job->stages[children[idx].stage].pid = pid;
+        job->stages[children[idx].stage].done = 0;
+        job->pid = pid;
+        job->waiting++;
+    }
+    num_children++;
+    msh_timeout_release(&old);
+}
+
+//account a reaped child and forget it
+static void
+child_reaped(pid_t pid, int status, struct rusage *ru)
+{
+    size_t idx = (size_t)pid & (MSH_CHILD_SLOTS - 1);
+
+    while (children[idx].pid != 0 && children[idx].pid != pid) {
+        idx = (idx + 1) & (MSH_CHILD_SLOTS - 1);
+    }
+    if (children[idx].pid == 0) {
+        return;
+    }
+    msh_stats_record(children[idx].stat, now_ns() - children[idx].start_ns, ru, status);
+    struct jobs *job = children[idx].job;
+    if (job != NULL) {
+        sigset_t old;
+
+        msh_timeout_hold(&old);
+        job->stages[children[idx].stage].status = status;
+        job->stages[children[idx].stage].ru = *ru;
+        job->stages[children[idx].stage].done = 1;
+        if (--job->waiting == 0) {
+            job_finished(job);
+        }
+        msh_timeout_release(&old);
+    }
+
+    //backward-shift deletion keeps the probe chains intact
+    size_t hole = idx;
+    children[hole].pid = 0;
+    for (size_t next = (hole + 1) & (MSH_CHILD_SLOTS - 1); children[next].pid != 0;
+         next = (next + 1) & (MSH_CHILD_SLOTS - 1)) {
+        size_t home = (size_t)children[next].pid & (MSH_CHILD_SLOTS - 1);
+
+        //move the entry if its home isn't between the hole and it
+        if (((next - home) & (MSH_CHILD_SLOTS - 1)) >= ((next - hole) & (MSH_CHILD_SLOTS - 1))) {
+            children[hole] = children[next];
+            children[next].pid = 0;
+            hole = next;
+        }
+    }
+    num_children--;
+
+    //a finished background process can no longer be brought back
+    for (size_t i = 0; i < num_background_pids; i++) {
+        if (background_pids[i] == pid) {
+            memmove(&background_pids[i], &background_pids[i + 1], (num_background_pids - i - 1) * sizeof(pid_t));
+            num_background_pids--;
+            break;
+        }
+    }
+}
+
+//a job's deadline expired: SIGTERM its processes, and SIGKILL them after the grace period
+static void
+job_expired(struct msh_timeout *t)
+{
+    struct jobs *job = (struct jobs *)((char *)t - offsetof(struct jobs, timeout));
+    int sig = job->timed_out ? SIGKILL : SIGTERM;
+
+    for (size_t i = 0; i < job->num_stages; i++) {
+        if (!job->stages[i].done) {
+            kill(job->stages[i].pid, sig);
+            //a stopped process only acts on it once continued
+            kill(job->stages[i].pid, SIGCONT);
+        }
+    }
+    if (!job->timed_out) {
+        job->timed_out = 1;
+        msh_timeout_set(t, t->deadline_ns + job->grace_ns);
+    }
+}
+
+//reap whatever background children have exited, without blocking
+static void
+reap_background(void)
+{
+    struct rusage ru;
+    int status;
+    pid_t pid;
+
+    while ((pid = wait4(-1, &status, WNOHANG, &ru)) > 0) {
+        child_reaped(pid, status, &ru);
+    }
+}
+
+//block until a foreground child exits (returning its wait status), or is moved to the background (-1)
+static int
+wait_foreground(pid_t pid)
+{
+    struct rusage ru;
+    int status;
+
+    while (wait4(pid, &status, 0, &ru) == -1) {
+        if (errno != EINTR) {
+            perror("waitpid");
+            return -1;
+        }
+        //cntrl-c terminated it so keep waiting, cntrl-z suspended it
+        if (foreground_num_pids == 0) {
+            return -1;
+        }
+    }
+    child_reaped(pid, status, &ru);
+
+    return status;
+}
+
+//the exit status of the last foreground pipeline
+static int last_status = 0;
+//whether it was cut short (killed, stopped or timed out) rather than exiting
+static int last_cut_short = 0;
+//pipelines update found up to date, for the jobs builtin
+static unsigned long skipped_pipelines = 0;
+//the deadline timeout gives the pipeline it runs, 0 for none
+static long next_timeout_ns = 0;
+
+int
+msh_status(void)
+{
+    return last_status;
+}
+
 /**
  * `msh_execute` is called with the parsed pipeline for the shell to
  * execute. If the pipeline doesn't run in the background, this will
  * only return after the pipeline completes.
  */
+struct history_lines {
+    const char **lines;
+    int *lens;
+    unsigned long *counts;
+    size_t num;
+};
+
+static void
+collect_history(const char *line, size_t len, unsigned long count, unsigned long last, void *data)
+{
+    struct history_lines *h = data;
+
+    (void)last;
+    h->lines[h->num] = line;
+    h->lens[h->num] = (int)len;
+    h->counts[h->num++] = count;
+}
+
+/**
+ * `history [-s TEXT] [N]` prints the `N` most recently used distinct
+ * lines (containing `TEXT`), oldest first, with how often each was
+ * entered.
+ */
+static void
+builtin_history(struct msh_command *command)
+{
+    struct history_lines h = { 0 };
+    const char *text = "";
+    long n = 20;
+    int i = 1;
+
+    if (i + 1 < command->numberArgs && strcmp(command->args[i], "-s") == 0) {
+        text = command->args[i + 1];
+        i += 2;
+    }
+    if (i < command->numberArgs) {
+        char *end;
+
+        n = strtol(command->args[i++], &end, 10);
+        if (*end != '\0' || n <= 0) {
+            i = 0;
+        }
+    }
+    if (i != command->numberArgs) {
+        fprintf(stderr, "usage: history [-s TEXT] [N]\n");
+        return;
+    }
+
+    h.lines = malloc((size_t)n * sizeof(char *));
+    h.lens = malloc((size_t)n * sizeof(int));
+    h.counts = malloc((size_t)n * sizeof(unsigned long));
+    if (h.lines == NULL || h.lens == NULL || h.counts == NULL) {
+        perror("history");
+    } else {
+        msh_history_search(text, collect_history, &h, (size_t)n);
+        while (h.num > 0) {
+            h.num--;
+            printf("%5lu  %.*s\n", h.counts[h.num], h.lens[h.num], h.lines[h.num]);
+        }
+        fflush(stdout);
+    }
+    free(h.lines);
+    free(h.lens);
+    free(h.counts);
+}
+
+//every builtin, for completion
+char *msh_builtin_names[] = { "bench", "bg", "cd", "echo", "exit", "export", "fg", "history", "jobs", "memo",
+                              "prefetch", "pwd", "stats", "timeout", "unset", "update", NULL };
+
+static int
+is_builtin(const char *program)
+{
+    for (char **name = msh_builtin_names; *name != NULL; name++) {
+        if (strcmp(*name, program) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//NAME=value ... sets the variables, if each argument is an assignment
+static int
+builtin_assign(struct msh_command *command)
+{
+    for (int i = 0; i < command->numberArgs; i++) {
+        if (msh_var_assignment(command->args[i]) == 0) {
+            return 0;
+        }
+    }
+    for (int i = 0; i < command->numberArgs; i++) {
+        size_t len = msh_var_assignment(command->args[i]);
+
+        if (msh_var_set(command->args[i], len, command->args[i] + len + 1) != 0) {
+            perror("msh: variable");
+        }
+    }
+    return 1;
+}
+
+//the leading NAME=value arguments of a command that runs a program
+static size_t
+num_prefixes(struct msh_command *command)
+{
+    int n = 0;
+
+    while (n < command->numberArgs && msh_var_assignment(command->args[n]) > 0) {
+        n++;
+    }
+    return n < command->numberArgs ? (size_t)n : 0;
+}
+
+//export NAME[=value]..., or list the environment
+static void
+builtin_export(struct msh_command *command)
+{
+    char **env;
+
+    if (command->numberArgs == 1) {
+        env = msh_var_environ();
+        for (size_t i = 0; env != NULL && env[i] != NULL; i++) {
+            printf("export %s\n", env[i]);
+        }
+        fflush(stdout);
+        return;
+    }
+    for (int i = 1; i < command->numberArgs; i++) {
+        char *arg = command->args[i];
+        size_t len = msh_var_name(arg);
+
+        if (len == 0 || (arg[len] != '\0' && arg[len] != '=')) {
+            fprintf(stderr, "export: %s: not a valid name\n", arg);
+            continue;
+        }
+        if (arg[len] == '=' && msh_var_set(arg, len, arg + len + 1) != 0) {
+            perror("export");
+            continue;
+        }
+        if (msh_var_export(arg, len) != 0) {
+            perror("export");
+        }
+    }
+}
+
+//echo [-n] ARG... and pwd, which are only builtins without redirections
+static int
+builtin_output(struct msh_command *command)
+{
+    char cwd[4096];
+    int i = 1;
+
+    if (command->stdout_file != NULL || command->stderr_file != NULL || command->data != NULL) {
+        return 0;
+    }
+    if (strcmp(command->program, "pwd") == 0) {
+        if (getcwd(cwd, sizeof(cwd)) == NULL) {
+            perror("pwd");
+            last_status = 1;
+            return 1;
+        }
+        puts(cwd);
+    } else if (strcmp(command->program, "echo") == 0) {
+        if (command->numberArgs > 1 && strcmp(command->args[1], "-n") == 0) {
+            i++;
+        }
+        for (int j = i; j < command->numberArgs; j++) {
+            if (j > i) {
+                putchar(' ');
+            }
+            fputs(command->args[j], stdout);
+        }
+        if (i == 1) {
+            putchar('\n');
+        }
+    } else {
+        return 0;
+    }
+    //in order with the output of the programs run next
+    fflush(stdout);
+
+    return 1;
+}
+
 //execute built-in commands
 int execute_builtin(struct msh_command *command) {
+    if (builtin_assign(command) || builtin_output(command)) {
+        return 1;
+    }
     //check if the command is cd
     if (strcmp(command->program, "cd") == 0) {
         //check that there sat least one argument for cd
@@ -87,7 +580,7 @@ int execute_builtin(struct msh_command *command) {
         char *path = command->args[1];
         //handle the ~
         if (path[0] == '~') {
-            const char *home = getenv("HOME");
+            const char *home = msh_var_get("HOME", 4);
             if (home == NULL) {
                 fprintf(stderr, "cd: HOME not set\n");
                 return 1;
@@ -136,10 +629,7 @@ int execute_builtin(struct msh_command *command) {
         foreground_pids[foreground_num_pids++] = pid;
         num_background_pids--;
 
-        int status;
-        if (waitpid(pid, &status, 0) == -1) {
-            perror("fg");
-        }
+        wait_foreground(pid);
 
         return 1;
 
@@ -160,6 +650,102 @@ int execute_builtin(struct msh_command *command) {
         }
         foreground_num_pids--;
 
+        return 1;
+    } else if (strcmp(command->program, "jobs") == 0) {
+        //background and suspended pipelines, oldest first
+        struct jobs *listed[MSH_MAXJOBS];
+        size_t n = 0;
+
+        reap_background();
+        for (size_t i = 0; i < MSH_MAXJOBS; i++) {
+            if (jobs[i].working && jobs[i].background) {
+                size_t j = n++;
+
+                //insertion sort on the creation order
+                while (j > 0 && listed[j - 1]->id > jobs[i].id) {
+                    listed[j] = listed[j - 1];
+                    j--;
+                }
+                listed[j] = &jobs[i];
+            }
+        }
+        for (size_t i = 0; i < n; i++) {
+            //shown without the trailing &
+            int len = (int)strlen(listed[i]->command);
+
+            while (len > 0 && (listed[i]->command[len - 1] == '&' || listed[i]->command[len - 1] == ' ')) {
+                len--;
+            }
+            printf("[%zu] %.*s%s\n", i, len, listed[i]->command, listed[i]->timed_out ? " (timed out)" : "");
+        }
+        //and the ones that were ended since the last time
+        for (size_t i = 0; i < num_timed_out; i++) {
+            int len = (int)strlen(timed_out[i]);
+
+            while (len > 0 && (timed_out[i][len - 1] == '&' || timed_out[i][len - 1] == ' ')) {
+                len--;
+            }
+            printf("[-] %.*s (timed out)\n", len, timed_out[i]);
+            free(timed_out[i]);
+        }
+        num_timed_out = 0;
+        if (skipped_pipelines > 0) {
+            printf("(%lu skipped as up to date)\n", skipped_pipelines);
+        }
+        fflush(stdout);
+
+        return 1;
+    } else if (strcmp(command->program, "stats") == 0) {
+        //stats [N] prints the N programs that took the most time
+        long n = 10;
+
+        if (command->numberArgs > 1) {
+            char *end;
+
+            n = strtol(command->args[1], &end, 10);
+            if (*end != '\0' || n <= 0) {
+                fprintf(stderr, "usage: stats [N]\n");
+                return 1;
+            }
+        }
+        reap_background();
+        msh_stats_print(stdout, (size_t)n);
+        fflush(stdout);
+
+        return 1;
+    } else if (strcmp(command->program, "history") == 0) {
+        builtin_history(command);
+
+        return 1;
+    } else if (strcmp(command->program, "prefetch") == 0) {
+        //prefetch [on|off]
+        if (command->numberArgs > 2 || (command->numberArgs == 2 && strcmp(command->args[1], "on") != 0 &&
+                                        strcmp(command->args[1], "off") != 0)) {
+            fprintf(stderr, "usage: prefetch [on|off]\n");
+            return 1;
+        }
+        if (command->numberArgs == 2) {
+            msh_prefetch_enable(strcmp(command->args[1], "on") == 0);
+        }
+        msh_prefetch_print(stdout);
+        fflush(stdout);
+
+        return 1;
+    } else if (strcmp(command->program, "export") == 0) {
+        builtin_export(command);
+
+        return 1;
+    } else if (strcmp(command->program, "unset") == 0) {
+        for (int i = 1; i < command->numberArgs; i++) {
+            size_t len = msh_var_name(command->args[i]);
+
+            if (len == 0 || command->args[i][len] != '\0') {
+                fprintf(stderr, "unset: %s: not a valid name\n", command->args[i]);
+            } else {
+                msh_var_unset(command->args[i], len);
+            }
+        }
+
         return 1;
     }
     return 0;
@@ -167,6 +753,194 @@ int execute_builtin(struct msh_command *command) {
 
 
 
+/**
+ * `bench [-n N] [-w W] <pipeline>` runs the rest of the pipeline `W`
+ * times to warm up, then `N` times while recording the wall time of
+ * each run in a histogram. The pipeline is only parsed once, and the
+ * programs are resolved once through the path cache.
+ */
+static void
+builtin_bench(struct msh_pipeline *p)
+{
+    static struct msh_histogram hist;
+    struct msh_command *command = p->commands[0];
+    long runs = 10, warmup = 1;
+    int i;
+
+    //parse the options, each takes a number
+    for (i = 1; i < command->numberArgs && command->args[i][0] == '-'; i += 2) {
+        char *end;
+        long val;
+
+        if (i + 1 >= command->numberArgs) {
+            fprintf(stderr, "bench: %s needs a number\n", command->args[i]);
+            return;
+        }
+        val = strtol(command->args[i + 1], &end, 10);
+        if (*end != '\0' || val < 0) {
+            fprintf(stderr, "bench: invalid count %s\n", command->args[i + 1]);
+            return;
+        }
+        if (strcmp(command->args[i], "-n") == 0 && val > 0) {
+            runs = val;
+        } else if (strcmp(command->args[i], "-w") == 0) {
+            warmup = val;
+        } else {
+            fprintf(stderr, "usage: bench [-n N] [-w W] <pipeline>\n");
+            return;
+        }
+    }
+    if (p->background) {
+        fprintf(stderr, "bench: cannot benchmark a background pipeline\n");
+        return;
+    }
+    //the remaining args are the command to run
+    if (msh_command_shift(command, i) != 0 || strcmp(command->program, "bench") == 0) {
+        fprintf(stderr, "usage: bench [-n N] [-w W] <pipeline>\n");
+        return;
+    }
+
+    sigint_received = 0;
+    for (long w = 0; w < warmup && !sigint_received; w++) {
+        msh_execute(p);
+    }
+    msh_histogram_init(&hist);
+    for (long n = 0; n < runs && !sigint_received; n++) {
+        long start = now_ns();
+
+        msh_execute(p);
+        msh_histogram_record(&hist, (uint64_t)(now_ns() - start));
+    }
+
+    //report like time(1) does, on stderr
+    fprintf(stderr, "bench: %s: %llu runs, %ld warmup\n", command->program,
+            (unsigned long long)hist.count, warmup);
+    fprintf(stderr, "  p50   %12.1f us\n", msh_histogram_percentile(&hist, 50.0) / 1e3);
+    fprintf(stderr, "  p90   %12.1f us\n", msh_histogram_percentile(&hist, 90.0) / 1e3);
+    fprintf(stderr, "  p99   %12.1f us\n", msh_histogram_percentile(&hist, 99.0) / 1e3);
+    fprintf(stderr, "  p99.9 %12.1f us\n", msh_histogram_percentile(&hist, 99.9) / 1e3);
+    fprintf(stderr, "  max   %12.1f us\n", hist.max / 1e3);
+}
+
+/**
+ * `memo <pipeline>` replays the output and status the pipeline had when
+ * it last ran with the same arguments, inputs, environment and working
+ * directory, or runs it and stores them.
+ */
+static void
+builtin_memo(struct msh_pipeline *p)
+{
+    struct msh_command *command = p->commands[0];
+    struct msh_memo_capture capture;
+    struct msh_memo_key key;
+    int status;
+
+    if (p->background) {
+        fprintf(stderr, "memo: cannot memoize a background pipeline\n");
+        return;
+    }
+    if (msh_command_shift(command, 1) != 0 || strcmp(command->program, "memo") == 0) {
+        fprintf(stderr, "usage: memo <pipeline>\n");
+        return;
+    }
+    //what writes its own files has to run each time
+    if (msh_memo_key(p, &key) != 0) {
+        msh_execute(p);
+        return;
+    }
+    if (msh_memo_replay(&key, &status)) {
+        last_status = status;
+        return;
+    }
+    if (msh_memo_capture_start(&capture) != 0) {
+        msh_execute(p);
+        return;
+    }
+    sigint_received = 0;
+    msh_execute(p);
+    //a run that exited is stored with its status, whatever it is, but not one that was interrupted,
+    //killed, stopped or timed out
+    msh_memo_capture_end(&capture, last_cut_short || sigint_received ? NULL : &key, last_status);
+}
+
+/**
+ * `update <pipeline>` runs the rest of the pipeline only if the files
+ * it writes to are missing or older than what it reads, like `make`.
+ */
+static void
+builtin_update(struct msh_pipeline *p)
+{
+    struct msh_command *command = p->commands[0];
+
+    if (msh_command_shift(command, 1) != 0 || strcmp(command->program, "update") == 0) {
+        fprintf(stderr, "usage: update <pipeline>\n");
+        return;
+    }
+    if (!msh_update_fresh(p)) {
+        msh_execute(p);
+        return;
+    }
+    //accounted to each program, as the runs it saved
+    for (size_t i = 0; i < p->num_commands; i++) {
+        msh_stats_skip(msh_stats_lookup(p->commands[i]->args[num_prefixes(p->commands[i])]));
+    }
+    skipped_pipelines++;
+    last_status = 0;
+}
+
+/**
+ * `timeout DURATION <pipeline>` runs the rest of the pipeline with a
+ * deadline: once it has passed, its processes get SIGTERM, then SIGKILL
+ * if they're still running after the grace period.
+ */
+static void
+builtin_timeout(struct msh_pipeline *p)
+{
+    struct msh_command *command = p->commands[0];
+    long ns = command->numberArgs > 2 ? msh_timeout_parse(command->args[1]) : -1;
+
+    if (ns < 0 || msh_command_shift(command, 2) != 0 || strcmp(command->program, "timeout") == 0) {
+        fprintf(stderr, "usage: timeout DURATION <pipeline>\n");
+        return;
+    }
+    next_timeout_ns = ns;
+    msh_execute(p);
+    next_timeout_ns = 0;
+}
+
+/*
+ * A here-string or here-document as a sealed memory file, read from its
+ * start: the child reads it like a file, and it can't be changed under it.
+ */
+static int
+here_open(const char *here)
+{
+    size_t len = strlen(here), off = 0;
+    int fd = memfd_create("msh-here", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+    if (fd == -1) {
+        perror("msh: here-document");
+        return -1;
+    }
+    while (off < len) {
+        ssize_t w = write(fd, here + off, len - off);
+
+        if (w <= 0) {
+            perror("msh: here-document");
+            close(fd);
+            return -1;
+        }
+        off += (size_t)w;
+    }
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0 ||
+        lseek(fd, 0, SEEK_SET) != 0) {
+        perror("msh: here-document");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
 void
 msh_execute(struct msh_pipeline *p)
 {
@@ -175,14 +949,97 @@ msh_execute(struct msh_pipeline *p)
 		return;
 	}
 
+    //account the background children that finished meanwhile
+    reap_background();
+    last_cut_short = 0;
+
+    //bench runs the rest of the pipeline many times
+    if (strcmp(p->commands[0]->program, "bench") == 0) {
+        builtin_bench(p);
+        return;
+    }
+    //memo replays the rest of the pipeline if nothing it reads changed
+    if (strcmp(p->commands[0]->program, "memo") == 0) {
+        builtin_memo(p);
+        return;
+    }
+    //update skips the rest of the pipeline if its outputs are up to date
+    if (strcmp(p->commands[0]->program, "update") == 0) {
+        builtin_update(p);
+        return;
+    }
+    //timeout gives the rest of the pipeline a deadline
+    if (strcmp(p->commands[0]->program, "timeout") == 0) {
+        builtin_timeout(p);
+        return;
+    }
+
+    //check the predictions, and warm up the programs likely to follow
+    for (size_t i = 0; i < p->num_commands; i++) {
+        msh_prefetch_observe(p->commands[i]->args[num_prefixes(p->commands[i])]);
+    }
+
     //if theres only one command
     if (p->num_commands == 1) {
-        struct msh_command *cmd = p->commands[0];
+        struct msh_command *cmd = p->commands[0], shifted;
+        size_t prefixes = num_prefixes(cmd);
+        struct timespec start, end;
+
+        //a builtin runs without its prefixes, they're only for programs
+        if (prefixes > 0) {
+            memcpy(&shifted, cmd, sizeof(shifted));
+            shifted.numberArgs -= (int)prefixes;
+            memmove(shifted.args, cmd->args + prefixes, (size_t)shifted.numberArgs * sizeof(char *));
+            shifted.args[shifted.numberArgs] = NULL;
+            shifted.program = shifted.args[0];
+            cmd = &shifted;
+        }
+        //a builtin's patterns are expanded too, as far as its arguments go
+        if (is_builtin(cmd->program)) {
+            size_t argc;
+            char **globbed = msh_glob_argv(cmd->args, &argc);
+
+            if (globbed != NULL && globbed != cmd->args) {
+                if (argc >= MSH_MAXARGS) {
+                    fprintf(stderr, "%s: too many arguments\n", cmd->program);
+                    last_status = 1;
+                    return;
+                }
+                if (cmd != &shifted) {
+                    memcpy(&shifted, cmd, sizeof(shifted));
+                    cmd = &shifted;
+                }
+                memcpy(shifted.args, globbed, (argc + 1) * sizeof(char *));
+                shifted.numberArgs = (int)argc;
+                shifted.program = shifted.args[0];
+            }
+        }
+        clock_gettime(CLOCK_REALTIME, &start);
+        last_status = 0;
         if (execute_builtin(cmd)) {
+            //builtins are logged too, without any processes
+            clock_gettime(CLOCK_REALTIME, &end);
+            msh_log_pipeline(msh_pipeline_input(p) ? msh_pipeline_input(p) : "", &start, &end, NULL, 0);
             return;
         }
     }
 
+    //track the pipeline until all of its processes are reaped
+    struct jobs *job = job_start(p);
+    //its deadline, from timeout or the default of background pipelines
+    long timeout_ns = next_timeout_ns;
+
+    next_timeout_ns = 0;
+    if (timeout_ns == 0 && p->background) {
+        const char *deflt = msh_var_get("MSH_TIMEOUT", 11);
+
+        timeout_ns = deflt != NULL ? msh_timeout_parse(deflt) : 0;
+        if (timeout_ns < 0) {
+            fprintf(stderr, "msh: MSH_TIMEOUT: invalid duration %s\n", deflt);
+            timeout_ns = 0;
+        }
+    }
+
     //store pids of child process
     pid_t pids[MSH_MAXCMNDS];
     //count number of childeren
@@ -190,10 +1047,27 @@ msh_execute(struct msh_pipeline *p)
     //initial input
     int inputfd = STDIN_FILENO;
     int pipefd[2];
+    //the environment, shared by the children until one lays its prefixes over it
+    char **env = msh_var_environ();
+
+    if (env == NULL) {
+        env = environ;
+    }
+    //commands too long for one exec are split up only if asked to, MSH_SPLIT=fan-out
+    const char *split = msh_var_get("MSH_SPLIT", 9), *split_size = msh_var_get("MSH_SPLIT_SIZE", 14);
+    size_t fanout = split != NULL ? strtoul(split, NULL, 10) : 0;
 
     //execute commands
     for (size_t i = 0; i < p->num_commands; i++) {
         struct msh_command *command = p->commands[i];
+        size_t prefixes = num_prefixes(command);
+        char **argv = msh_glob_argv(command->args + prefixes, NULL);
+
+        //the patterns are expanded in the parent, where the directory listings are cached
+        if (argv == NULL) {
+            fprintf(stderr, "msh: out of memory expanding %s\n", command->args[prefixes]);
+            argv = command->args + prefixes;
+        }
 
         //create a pipe if its not the last command
         if (i < p->num_commands - 1) {
@@ -203,6 +1077,12 @@ msh_execute(struct msh_pipeline *p)
             }
         }
 
+        //written once by the parent, however many bytes there are
+        char *here = msh_command_here(command, NULL);
+        int here_fd = here != NULL ? here_open(here) : -1;
+        //resolved in the parent so the cache outlives the child
+        char *path = msh_path_resolve(argv[0]);
+        long start = now_ns();
         pid_t pid = fork();
 
         //fork error
@@ -212,8 +1092,17 @@ msh_execute(struct msh_pipeline *p)
             //child process
         } else if (pid == 0) {
 
+            //a here-string or here-document is the input
+            if (here != NULL) {
+                if (here_fd == -1 || dup2(here_fd, STDIN_FILENO) == -1) {
+                    exit(1);
+                }
+                close(here_fd);
+                if (inputfd != STDIN_FILENO) {
+                    close(inputfd);
+                }
             //handle input redirection and use c->data to store stdin filename
-            if (command->data != NULL) {
+            } else if (command->data != NULL) {
                 char *stdin_file = (char *)command->data;
                 int fd = open(stdin_file, O_RDONLY);
                 if (fd == -1) {
@@ -304,13 +1193,41 @@ msh_execute(struct msh_pipeline *p)
                 }
             }
             
+            if (prefixes > 0 && env != environ) {
+                msh_var_overlay(env, command->args, prefixes);
+            }
+            if (fanout > 0) {
+                size_t limit = msh_split_limit(env, split_size != NULL ? strtoul(split_size, NULL, 10) : 0);
+
+                if (msh_split_needed(argv, limit)) {
+                    //every invocation gets the arguments before the first pattern
+                    size_t fixed = 1;
+
+                    while (command->args[prefixes + fixed] != NULL && !msh_glob_pattern(command->args[prefixes + fixed])) {
+                        fixed++;
+                    }
+                    if (command->args[prefixes + fixed] == NULL) {
+                        fixed = 1;
+                    }
+                    exit(msh_split_run(path, argv, fixed, env, limit, fanout));
+                }
+            }
             //execute command and print if theres an error
-            execvp(command->program, command->args);
+            //a stale or missing resolution falls back on the PATH walk
+            if (path != NULL) {
+                execve(path, argv, env);
+            }
+            environ = env;
+            execvp(argv[0], argv);
             perror("execvp");
             exit(1);
         } else {
             //add child pid
             pids[num_pids++] = pid;
+            child_started(pid, argv[0], start, job);
+            if (here_fd != -1) {
+                close(here_fd);
+            }
 
             //close the input if its not the standard input
             if (inputfd != STDIN_FILENO) {
@@ -325,20 +1242,60 @@ msh_execute(struct msh_pipeline *p)
         }
     }
 
+    //none of the children could be tracked, so nothing will finish the job
+    if (job != NULL && job->waiting == 0) {
+        job_finished(job);
+        job = NULL;
+    }
+    if (job != NULL) {
+        job_publish(job);
+    }
+    if (timeout_ns > 0 && job != NULL) {
+        const char *grace = msh_var_get("MSH_TIMEOUT_GRACE", 17);
+
+        job->grace_ns = grace != NULL ? msh_timeout_parse(grace) : -1;
+        if (job->grace_ns < 0) {
+            job->grace_ns = MSH_TIMEOUT_GRACE_NS;
+        }
+        if (msh_timeout_set(&job->timeout, now_ns() + timeout_ns) != 0) {
+            fprintf(stderr, "msh: too many deadlines, %s runs without one\n", job->command);
+        }
+    } else if (timeout_ns > 0 && num_pids > 0) {
+        fprintf(stderr, "msh: no job slot left, the pipeline runs without a deadline\n");
+    }
+
     //loop to copy the pids
     for (size_t i = 0; i < num_pids && i < MSH_MAXCMNDS; i++) {
         foreground_pids[i] = pids[i];
     }
     foreground_num_pids = num_pids;
 
-    //wait for child processes
+    //wait for child processes, until cntrl-z moves them to the background
+    last_status = 0;
     if (!p->background) {
-        for (size_t i = 0; i < num_pids; i++) {
-            int status;
-            if (waitpid(pids[i], &status, 0) == -1) {
-                perror("waitpid");
+        for (size_t i = 0; i < num_pids && foreground_num_pids > 0; i++) {
+            int status = wait_foreground(pids[i]);
+
+            //the pipeline's status is its last command's, like sh
+            if (i == num_pids - 1 && status != -1) {
+                last_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+                last_cut_short = WIFSIGNALED(status);
             }
         }
+        if (foreground_num_pids == 0 && num_pids > 0) {
+            last_status = 128 + SIGTSTP;
+            last_cut_short = 1;
+        } else if (job != NULL && job->timed_out) {
+            //like timeout(1)
+            last_status = 124;
+            last_cut_short = 1;
+        }
+        //cntrl-z stopped the waiting, the job lives on in the background
+        if (job != NULL && job->working && job->waiting > 0) {
+            job->background = 1;
+            job->stopped = 1;
+            job_publish(job);
+        }
         foreground_num_pids = 0;
     } else {
         //check if bg works
@@ -363,6 +1320,7 @@ msh_execute(struct msh_pipeline *p)
 //works for cntrl-c
 void sigint_handler()
 {
+    sigint_received = 1;
     //end foreground processes
     for (size_t i = 0; i < foreground_num_pids; i++) {
         kill(foreground_pids[i], SIGTERM);
@@ -382,9 +1340,51 @@ void sigtstp_handler()
     foreground_num_pids = 0;
 }
 
+//when the shell (not a failed child) exits, dump the stats table
+//and flush the execution log
+static void
+shell_atexit(void)
+{
+    const char *path = getenv("MSH_STATS_FILE");
+
+    if (getpid() != shell_pid) {
+        return;
+    }
+    if (path != NULL && msh_stats_dump(path) != 0) {
+        perror("stats dump");
+    }
+    msh_log_close();
+    msh_shm_close();
+}
+
+void
+msh_forked(void)
+{
+    //its jobs aren't the shell's, it doesn't publish them
+    shm_wanted = 0;
+    msh_shm_forget();
+}
+
 void
 msh_init(void)
 {
+    const char *log_path = getenv("MSH_EXECLOG");
+
+    shell_pid = getpid();
+    atexit(shell_atexit);
+    //log every pipeline if asked to
+    if (log_path != NULL && msh_log_open(log_path) != 0) {
+        perror("msh: execution log");
+    }
+    //publish the jobs for mshtop, unless MSH_JOBSHM=0
+    shm_wanted = getenv("MSH_JOBSHM") == NULL || strcmp(getenv("MSH_JOBSHM"), "0") != 0;
+
+    //deadlines expire from SIGALRM
+    if (msh_timeout_init(job_expired) != 0) {
+        perror("sigaction SIGALRM");
+        exit(1);
+    }
+
     //handler for SIGINT
     struct sigaction saint;
     saint.sa_handler = sigint_handler;
@@ -0,0 +1,449 @@
+#define _GNU_SOURCE
+
+#include <msh_glob.h>
+#include <msh_dircache.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+/* the longest path a pattern expands into */
+#define MSH_GLOB_PATH 4096
+/* a part of a pattern (between '/'s) longer than a name matches nothing */
+#define MSH_GLOB_PART 256
+/* bracket expressions in a part */
+#define MSH_GLOB_CLASSES 32
+/* parts with wildcards in a pattern */
+#define MSH_GLOB_DEPTH 32
+
+enum { TOK_LIT, TOK_ANY, TOK_CLASS, TOK_STAR };
+
+struct token {
+    int kind;
+    //where the literal is in the part, or which class it is
+    unsigned int start, len;
+};
+
+//a part of a pattern, compiled
+struct matcher {
+    char text[MSH_GLOB_PART];
+    //every name matched starts with it
+    char prefix[MSH_GLOB_PART];
+    //and is at least this long
+    size_t min_len;
+    //the literal the part ends with, if it doesn't end in a wildcard
+    const struct token *suffix;
+    //names starting with '.' are only matched by a part that does too
+    int dot;
+    struct token toks[MSH_GLOB_PART];
+    size_t ntoks;
+    uint64_t classes[MSH_GLOB_CLASSES][4];
+    size_t nclasses;
+};
+
+//the paths found, back to back, and where each starts
+static char *found = NULL;
+static size_t found_len = 0, found_cap = 0;
+static size_t *offsets = NULL;
+static size_t num_found = 0, offsets_cap = 0;
+//the expansion handed out
+static char **argv = NULL;
+static size_t argv_cap = 0;
+
+//the ']' closing the bracket expression at open, or 0
+static size_t
+class_end(const char *part, size_t open, size_t len)
+{
+    size_t i = open + 1;
+
+    if (i < len && (part[i] == '!' || part[i] == '^')) {
+        i++;
+    }
+    //a ']' right after the '[' is one of its characters
+    if (i < len && part[i] == ']') {
+        i++;
+    }
+    while (i < len && part[i] != ']') {
+        i++;
+    }
+    return i < len ? i : 0;
+}
+
+static int
+part_is_pattern(const char *part, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (part[i] == '*' || part[i] == '?' || (part[i] == '[' && class_end(part, i, len) != 0)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int
+msh_glob_pattern(const char *arg)
+{
+    while (*arg != '\0') {
+        const char *slash = strchr(arg, '/');
+        size_t len = slash != NULL ? (size_t)(slash - arg) : strlen(arg);
+
+        if (part_is_pattern(arg, len)) {
+            return 1;
+        }
+        arg += slash != NULL ? len + 1 : len;
+    }
+    return 0;
+}
+
+static void
+class_set(uint64_t *set, unsigned char ch)
+{
+    set[ch >> 6] |= 1ULL << (ch & 63);
+}
+
+//fill in the class of the bracket expression from open to close
+static void
+class_compile(uint64_t *set, const char *part, size_t open, size_t close)
+{
+    size_t i = open + 1;
+    int negate = part[i] == '!' || part[i] == '^';
+
+    memset(set, 0, 4 * sizeof(uint64_t));
+    i += negate;
+    for (; i < close; i++) {
+        unsigned char lo = (unsigned char)part[i], hi = lo;
+
+        //a '-' at either end is itself
+        if (i + 2 < close && part[i + 1] == '-') {
+            hi = (unsigned char)part[i + 2];
+            i += 2;
+        }
+        for (unsigned int ch = lo; ch <= hi; ch++) {
+            class_set(set, (unsigned char)ch);
+        }
+    }
+    if (negate) {
+        for (int w = 0; w < 4; w++) {
+            set[w] = ~set[w];
+        }
+    }
+}
+
+//compile a part, -1 if it is too long to match anything (or too complex)
+static int
+compile(const char *part, size_t len, struct matcher *m)
+{
+    size_t i = 0;
+
+    if (len >= MSH_GLOB_PART) {
+        return -1;
+    }
+    memcpy(m->text, part, len);
+    m->text[len] = '\0';
+    m->prefix[0] = '\0';
+    m->min_len = 0;
+    m->suffix = NULL;
+    m->dot = part[0] == '.';
+    m->ntoks = m->nclasses = 0;
+    while (i < len) {
+        struct token *t = &m->toks[m->ntoks];
+        size_t close;
+
+        if (part[i] == '*') {
+            //"**" is just "*"
+            if (m->ntoks == 0 || t[-1].kind != TOK_STAR) {
+                *t = (struct token) { .kind = TOK_STAR };
+                m->ntoks++;
+            }
+            i++;
+        } else if (part[i] == '?') {
+            *t = (struct token) { .kind = TOK_ANY };
+            m->ntoks++;
+            m->min_len++;
+            i++;
+        } else if (part[i] == '[' && (close = class_end(part, i, len)) != 0) {
+            if (m->nclasses == MSH_GLOB_CLASSES) {
+                return -1;
+            }
+            class_compile(m->classes[m->nclasses], part, i, close);
+            *t = (struct token) { .kind = TOK_CLASS, .start = (unsigned int)m->nclasses++ };
+            m->ntoks++;
+            m->min_len++;
+            i = close + 1;
+        } else {
+            //literal characters are matched a run at a time
+            if (m->ntoks == 0 || t[-1].kind != TOK_LIT) {
+                *t = (struct token) { .kind = TOK_LIT, .start = (unsigned int)i };
+                m->ntoks++;
+            }
+            m->toks[m->ntoks - 1].len++;
+            m->min_len++;
+            i++;
+        }
+    }
+    if (m->ntoks > 0 && m->toks[0].kind == TOK_LIT) {
+        memcpy(m->prefix, m->text, m->toks[0].len);
+        m->prefix[m->toks[0].len] = '\0';
+    }
+    if (m->ntoks > 0 && m->toks[m->ntoks - 1].kind == TOK_LIT) {
+        m->suffix = &m->toks[m->ntoks - 1];
+    }
+    return 0;
+}
+
+static int
+token_matches(const struct matcher *m, const struct token *t, const char *s, size_t n)
+{
+    switch (t->kind) {
+    case TOK_LIT:
+        return n >= t->len && memcmp(s, m->text + t->start, t->len) == 0;
+    case TOK_ANY:
+        return n > 0;
+    default:
+        return n > 0 && (m->classes[t->start][(unsigned char)*s >> 6] >> ((unsigned char)*s & 63)) & 1;
+    }
+}
+
+/*
+ * Match a name against the tokens. A mismatch only ever goes back to
+ * the last '*', which takes one more character, so a name is matched
+ * in at most (name length) x (tokens) steps, whatever the pattern.
+ */
+static int
+matches(const struct matcher *m, const char *name)
+{
+    size_t len = strlen(name), i = 0, t = 0, star_t = 0, star_i = 0;
+    int star = 0;
+
+    if (len < m->min_len || (name[0] == '.' && !m->dot)) {
+        return 0;
+    }
+    if (m->suffix != NULL && memcmp(name + len - m->suffix->len, m->text + m->suffix->start, m->suffix->len) != 0) {
+        return 0;
+    }
+    while (t < m->ntoks || i < len) {
+        if (t < m->ntoks) {
+            const struct token *k = &m->toks[t];
+
+            if (k->kind == TOK_STAR) {
+                //a '*' at the end takes whatever is left
+                if (t + 1 == m->ntoks) {
+                    return 1;
+                }
+                star = 1;
+                star_t = ++t;
+                star_i = i;
+                continue;
+            }
+            if (token_matches(m, k, name + i, len - i)) {
+                i += k->kind == TOK_LIT ? k->len : 1;
+                t++;
+                continue;
+            }
+        }
+        if (!star || star_i == len) {
+            return 0;
+        }
+        i = ++star_i;
+        t = star_t;
+    }
+    return 1;
+}
+
+//add the path dir + name, -1 if out of memory
+static int
+found_add(const char *dir, size_t dlen, const char *name)
+{
+    size_t nlen = strlen(name), need = found_len + dlen + nlen + 1;
+
+    if (need > found_cap) {
+        size_t cap = found_cap ? found_cap : 4096;
+        char *grown;
+
+        while (cap < need) {
+            cap *= 2;
+        }
+        grown = realloc(found, cap);
+        if (grown == NULL) {
+            return -1;
+        }
+        found = grown;
+        found_cap = cap;
+    }
+    if (num_found == offsets_cap) {
+        size_t cap = offsets_cap ? offsets_cap * 2 : 256;
+        size_t *grown = realloc(offsets, cap * sizeof(size_t));
+
+        if (grown == NULL) {
+            return -1;
+        }
+        offsets = grown;
+        offsets_cap = cap;
+    }
+    offsets[num_found++] = found_len;
+    memcpy(found + found_len, dir, dlen);
+    memcpy(found + found_len + dlen, name, nlen + 1);
+    found_len = need;
+
+    return 0;
+}
+
+/*
+ * Expand the rest of the pattern under the directory path[0, plen)
+ * (which ends in a '/', unless it is the current directory).
+ */
+static int
+walk(char *path, size_t plen, const char *rest, int depth)
+{
+    const struct msh_dir *dir;
+    const char *slash;
+    struct matcher m;
+    size_t len, first, count, nlen = 0;
+    char *names;
+    int ret = 0;
+
+    //the parts without wildcards are taken as they are
+    while (1) {
+        slash = strchr(rest, '/');
+        len = slash != NULL ? (size_t)(slash - rest) : strlen(rest);
+        if (*rest == '\0' || part_is_pattern(rest, len)) {
+            break;
+        }
+        if (plen + len + 1 >= MSH_GLOB_PATH) {
+            return 0;
+        }
+        memcpy(path + plen, rest, len);
+        plen += len;
+        if (slash != NULL) {
+            path[plen++] = '/';
+        }
+        rest += slash != NULL ? len + 1 : len;
+    }
+    path[plen] = '\0';
+    if (*rest == '\0') {
+        struct stat st;
+
+        //only the listings were looked at, so what follows them has to exist
+        return lstat(path, &st) == 0 ? found_add(path, plen, "") : 0;
+    }
+    if (depth == MSH_GLOB_DEPTH || compile(rest, len, &m) != 0) {
+        return 0;
+    }
+    dir = msh_dircache_get(plen > 0 ? path : ".");
+    if (dir == NULL) {
+        return 0;
+    }
+    count = msh_dircache_prefix(dir, m.prefix, &first);
+    if (slash == NULL) {
+        for (size_t i = first; i < first + count; i++) {
+            if (matches(&m, dir->names[i]) && found_add(path, plen, dir->names[i]) != 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    //the listing only lasts until the next directory is read, so the matches are kept first
+    for (size_t i = first; i < first + count; i++) {
+        nlen += matches(&m, dir->names[i]) ? strlen(dir->names[i]) + 1 : 0;
+    }
+    if (nlen == 0) {
+        return 0;
+    }
+    names = malloc(nlen);
+    if (names == NULL) {
+        return -1;
+    }
+    nlen = 0;
+    for (size_t i = first; i < first + count; i++) {
+        if (matches(&m, dir->names[i])) {
+            size_t n = strlen(dir->names[i]) + 1;
+
+            memcpy(names + nlen, dir->names[i], n);
+            nlen += n;
+        }
+    }
+    for (size_t off = 0; off < nlen && ret == 0; off += strlen(names + off) + 1) {
+        size_t n = strlen(names + off);
+
+        if (plen + n + 1 >= MSH_GLOB_PATH) {
+            continue;
+        }
+        memcpy(path + plen, names + off, n);
+        path[plen + n] = '/';
+        ret = walk(path, plen + n + 1, slash + 1, depth + 1);
+    }
+    free(names);
+
+    return ret;
+}
+
+static int
+cmp_found(const void *a, const void *b)
+{
+    return strcmp(found + *(const size_t *)a, found + *(const size_t *)b);
+}
+
+char **
+msh_glob_argv(char **args, size_t *argc)
+{
+    char path[MSH_GLOB_PATH];
+    size_t n = 0;
+    int any = 0;
+
+    while (args[n] != NULL) {
+        any |= msh_glob_pattern(args[n++]);
+    }
+    if (!any) {
+        if (argc != NULL) {
+            *argc = n;
+        }
+        return args;
+    }
+
+    found_len = num_found = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_t before = num_found;
+        int sorted = 1;
+
+        if (msh_glob_pattern(args[i]) && walk(path, 0, args[i], 0) != 0) {
+            return NULL;
+        }
+        //a pattern matching nothing is kept as it was written
+        if (num_found == before && found_add(args[i], strlen(args[i]), "") != 0) {
+            return NULL;
+        }
+        //the listings are sorted, so only patterns with wildcards in several parts need this
+        for (size_t k = before + 1; k < num_found && sorted; k++) {
+            sorted = strcmp(found + offsets[k - 1], found + offsets[k]) <= 0;
+        }
+        if (!sorted) {
+            qsort(offsets + before, num_found - before, sizeof(size_t), cmp_found);
+        }
+    }
+    if (num_found + 1 > argv_cap) {
+        size_t cap = argv_cap ? argv_cap : 64;
+        char **grown;
+
+        while (cap < num_found + 1) {
+            cap *= 2;
+        }
+        grown = realloc(argv, cap * sizeof(char *));
+        if (grown == NULL) {
+            return NULL;
+        }
+        argv = grown;
+        argv_cap = cap;
+    }
+    //the paths may have moved while they were found, so they're only pointed at now
+    for (size_t k = 0; k < num_found; k++) {
+        argv[k] = found + offsets[k];
+    }
+    argv[num_found] = NULL;
+    if (argc != NULL) {
+        *argc = num_found;
+    }
+
+    return argv;
+}
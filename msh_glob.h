@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+
+/***
+ * Pathname expansion: an argument with a `*`, `?` or `[...]` in it is
+ * replaced by the paths it matches, sorted, or kept as it is if it
+ * matches nothing. Names starting with a `.` are only matched by a
+ * pattern that starts with one too.
+ *
+ * Each part of a pattern is compiled once, into the literal prefix of
+ * its names and a list of tokens matched without ever backtracking more
+ * than to the last `*`. The prefix narrows the directory's sorted
+ * listing (from the directory cache, so a directory is read once for
+ * all the patterns of a line, and the lines after it) down to a binary
+ * search before anything is matched.
+ */
+
+/**
+ * `msh_glob_argv` expands the patterns among a command's arguments.
+ *
+ * - `@args` - the `NULL`-terminated arguments.
+ * - `@argc` - if not `NULL`, set to the number of arguments returned.
+ * - `@return` - `args` itself if none of them is a pattern, or else
+ *     the `NULL`-terminated expansion, borrowed until the next call.
+ *     `NULL` if out of memory.
+ */
+char **msh_glob_argv(char **args, size_t *argc);
+
+/**
+ * `msh_glob_pattern` tells if an argument is a pattern.
+ *
+ * - `@arg` - the argument.
+ * - `@return` - `1` if it has a `*`, `?` or `[...]`, `0` otherwise.
+ */
+int msh_glob_pattern(const char *arg);
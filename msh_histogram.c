@@ -0,0 +1,82 @@
+#include <msh_histogram.h>
+
+#include <string.h>
+
+//index of the bucket holding v
+static size_t
+bucket_index(uint64_t v)
+{
+    int magnitude;
+
+    //small values get one exact bucket each
+    if (v < MSH_HIST_SUBBUCKETS) {
+        return (size_t)v;
+    }
+    //keep the top MSH_HIST_SUBBITS bits of the value
+    magnitude = 63 - __builtin_clzll(v);
+    v >>= magnitude - MSH_HIST_SUBBITS + 1;
+
+    return (size_t)(magnitude - MSH_HIST_SUBBITS + 2) * (MSH_HIST_SUBBUCKETS / 2)
+        + (size_t)(v - MSH_HIST_SUBBUCKETS / 2);
+}
+
+//largest value that lands in bucket idx
+static uint64_t
+bucket_highest(size_t idx)
+{
+    size_t half = MSH_HIST_SUBBUCKETS / 2;
+    uint64_t sub;
+    int shift;
+
+    if (idx < MSH_HIST_SUBBUCKETS) {
+        return idx;
+    }
+    shift = (int)(idx / half) - 1;
+    sub = idx % half + half;
+
+    return ((sub + 1) << shift) - 1;
+}
+
+void
+msh_histogram_init(struct msh_histogram *h)
+{
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+void
+msh_histogram_record(struct msh_histogram *h, uint64_t v)
+{
+    h->counts[bucket_index(v)]++;
+    h->count++;
+    h->total += v;
+    if (v < h->min) h->min = v;
+    if (v > h->max) h->max = v;
+}
+
+uint64_t
+msh_histogram_percentile(struct msh_histogram *h, double pct)
+{
+    uint64_t target, seen = 0;
+
+    if (h->count == 0) {
+        return 0;
+    }
+    if (pct >= 100.0) {
+        return h->max;
+    }
+    //rank of the sample we're looking for, at least the first one
+    target = (uint64_t)(pct / 100.0 * (double)h->count + 0.5);
+    if (target == 0) target = 1;
+
+    for (size_t i = 0; i < MSH_HIST_NBUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= target) {
+            uint64_t v = bucket_highest(i);
+
+            return v > h->max ? h->max : v;
+        }
+    }
+
+    return h->max;
+}
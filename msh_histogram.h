@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+/***
+ * An HDR-style latency histogram. Values are bucketed log-linearly:
+ * every power-of-two range is split into the same number of linear
+ * sub-buckets, so any recorded value is reported with a relative
+ * error below `2 / MSH_HIST_SUBBUCKETS` (1/64) while the whole 64-bit
+ * range fits in a fixed array. Recording is a handful of integer ops and
+ * never allocates.
+ */
+
+/* bits kept of each value; as the top one is always set, a power of two has half as many sub-buckets */
+#define MSH_HIST_SUBBITS     7
+#define MSH_HIST_SUBBUCKETS  (1 << MSH_HIST_SUBBITS)
+#define MSH_HIST_NBUCKETS    ((64 - MSH_HIST_SUBBITS + 2) * (MSH_HIST_SUBBUCKETS / 2))
+
+struct msh_histogram {
+    uint64_t counts[MSH_HIST_NBUCKETS];
+    uint64_t count;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+};
+
+/**
+ * `msh_histogram_init` resets `h` to hold no samples.
+ */
+void msh_histogram_init(struct msh_histogram *h);
+
+/**
+ * `msh_histogram_record` adds the sample `v` to `h`.
+ */
+void msh_histogram_record(struct msh_histogram *h, uint64_t v);
+
+/**
+ * `msh_histogram_percentile` returns the value at or below which
+ * `pct` percent of the recorded samples fall.
+ *
+ * - `@h` - the histogram being queried.
+ * - `@pct` - the percentile, in `[0, 100]`.
+ * - `@return` - the highest value equivalent to the bucket holding
+ *     the percentile (clamped to the exact `max`), or `0` if `h` is
+ *     empty.
+ */
+uint64_t msh_histogram_percentile(struct msh_histogram *h, double pct);
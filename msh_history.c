@@ -0,0 +1,515 @@
+#define _GNU_SOURCE
+
+#include <msh_history.h>
+#include <ptrie.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+/* buckets of the trigram index, must be a power of two */
+#define MSH_HISTORY_TRIGRAMS (1 << 16)
+/* lines the indexer adds each time it takes the lock */
+#define MSH_HISTORY_BATCH 4096
+/* a use of a line counts half as much once this many bytes of history follow it */
+#define MSH_HISTORY_HALFLIFE (64 * 1024)
+/* longer lines aren't suggested */
+#define MSH_HISTORY_HINTMAX 1024
+
+//a distinct line
+struct hist_entry {
+    //into the mapped file, or malloced for lines added this session
+    const char *line;
+    size_t len;
+    unsigned long count;
+    unsigned long last;
+    //the log of the sum, over every use, of 2^(when / half-life)
+    double frecency;
+};
+
+//the entries whose lines contain a trigram (or one hashing alike)
+struct posting {
+    uint32_t *ids;
+    uint32_t num, cap;
+};
+
+//the index is shared with the thread indexing the file, guarded by lock
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct hist_entry *entries = NULL;
+static size_t num_entries = 0, cap_entries = 0;
+//open addressing on the lines, holding entry index + 1 (0 is empty)
+static uint32_t *table = NULL;
+static size_t table_size = 0;
+static struct posting trigrams[MSH_HISTORY_TRIGRAMS];
+/*
+ * The distinct lines, scored by frecency, for suggestions. Instead of
+ * decaying every score as time passes, each use is weighted by how
+ * late it came, growing exponentially; all scores would decay alike,
+ * so this ranks the same, and scores only ever go up.
+ */
+static struct ptrie *hints = NULL;
+//lines in the file are timed by their offset, lines entered since by
+//where they are appended, so the order doesn't depend on when the
+//indexer gets to a line
+static unsigned long seq = 0;
+
+static char *map = NULL;
+static size_t map_len = 0;
+static int hist_fd = -1;
+static pthread_t indexer;
+static int indexer_running = 0;
+//lines entered while the indexer held the lock, recorded once it is free
+static struct pending_line {
+    char *line;
+    size_t len;
+    unsigned long when;
+} *pending = NULL;
+static size_t num_pending = 0, cap_pending = 0;
+static _Atomic int stopping = 0;
+
+static unsigned long
+hash_line(const char *s, size_t len)
+{
+    unsigned long h = 14695981039346656037UL;
+
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211UL;
+    }
+    return h;
+}
+
+static size_t
+trigram_bucket(const char *s)
+{
+    uint32_t t = (uint32_t)(unsigned char)s[0] << 16 | (uint32_t)(unsigned char)s[1] << 8 | (unsigned char)s[2];
+
+    return (t * 2654435761U) >> 16 & (MSH_HISTORY_TRIGRAMS - 1);
+}
+
+static int
+table_grow(void)
+{
+    size_t size = table_size ? table_size * 2 : 1024;
+    uint32_t *t = calloc(size, sizeof(uint32_t));
+
+    if (t == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < num_entries; i++) {
+        size_t slot = hash_line(entries[i].line, entries[i].len) & (size - 1);
+
+        while (t[slot] != 0) {
+            slot = (slot + 1) & (size - 1);
+        }
+        t[slot] = (uint32_t)i + 1;
+    }
+    free(table);
+    table = t;
+    table_size = size;
+
+    return 0;
+}
+
+static void
+index_trigrams(uint32_t id, const char *line, size_t len)
+{
+    for (size_t i = 0; i + 3 <= len; i++) {
+        struct posting *p = &trigrams[trigram_bucket(line + i)];
+
+        //a line adds itself to each list once
+        if (p->num > 0 && p->ids[p->num - 1] == id) {
+            continue;
+        }
+        if (p->num == p->cap) {
+            uint32_t cap = p->cap ? p->cap * 2 : 8;
+            uint32_t *ids = realloc(p->ids, cap * sizeof(uint32_t));
+
+            if (ids == NULL) {
+                return;
+            }
+            p->ids = ids;
+            p->cap = cap;
+        }
+        p->ids[p->num++] = id;
+    }
+}
+
+//log(e^a + e^b), without overflowing
+static double
+log_add(double a, double b)
+{
+    double hi = a > b ? a : b, lo = a > b ? b : a;
+
+    return hi + log1p(exp(lo - hi));
+}
+
+//rank a use of e at time when among the suggestions
+static void
+hint_update(struct hist_entry *e, unsigned long when, int is_new)
+{
+    char line[MSH_HISTORY_HINTMAX];
+    double weight = (double)when * M_LN2 / MSH_HISTORY_HALFLIFE;
+
+    e->frecency = is_new ? weight : log_add(e->frecency, weight);
+    if (hints == NULL || e->len >= sizeof(line)) {
+        return;
+    }
+    memcpy(line, e->line, e->len);
+    line[e->len] = '\0';
+    if (is_new && ptrie_add(hints, line) != 0) {
+        return;
+    }
+    ptrie_set_score(hints, line, e->frecency);
+}
+
+//count a use of a line at time `when`; new lines are stored with `line` as is
+static struct hist_entry *
+record(const char *line, size_t len, unsigned long when)
+{
+    size_t slot;
+    struct hist_entry *e;
+
+    if (num_entries * 2 >= table_size && table_grow() != 0) {
+        return NULL;
+    }
+    slot = hash_line(line, len) & (table_size - 1);
+    while (table[slot] != 0) {
+        e = &entries[table[slot] - 1];
+        if (e->len == len && memcmp(e->line, line, len) == 0) {
+            e->count++;
+            if (when > e->last) {
+                e->last = when;
+            }
+            hint_update(e, when, 0);
+            return e;
+        }
+        slot = (slot + 1) & (table_size - 1);
+    }
+
+    if (num_entries == cap_entries) {
+        size_t cap = cap_entries ? cap_entries * 2 : 1024;
+        struct hist_entry *grown = realloc(entries, cap * sizeof(*entries));
+
+        if (grown == NULL) {
+            return NULL;
+        }
+        entries = grown;
+        cap_entries = cap;
+    }
+    e = &entries[num_entries];
+    *e = (struct hist_entry) { .line = line, .len = len, .count = 1, .last = when };
+    table[slot] = (uint32_t)++num_entries;
+    index_trigrams((uint32_t)(num_entries - 1), line, len);
+    hint_update(e, when, 1);
+
+    return e;
+}
+
+//index the mapped file, a batch of lines at a time
+static void *
+indexer_thread(void *arg)
+{
+    size_t off = 0;
+
+    (void)arg;
+    //the lowest priority that still gets a share of a busy cpu: the shell may wait on the lock
+    setpriority(PRIO_PROCESS, (id_t)gettid(), 19);
+    while (off < map_len && !atomic_load(&stopping)) {
+        pthread_mutex_lock(&lock);
+        for (int i = 0; i < MSH_HISTORY_BATCH && off < map_len; i++) {
+            const char *nl = memchr(map + off, '\n', map_len - off);
+            size_t len = nl ? (size_t)(nl - (map + off)) : map_len - off;
+
+            if (len > 0) {
+                record(map + off, len, off);
+            }
+            off += len + 1;
+        }
+        pthread_mutex_unlock(&lock);
+    }
+
+    return NULL;
+}
+
+int
+msh_history_open(const char *path)
+{
+    struct stat st;
+
+    hints = ptrie_allocate();
+    if (path == NULL) {
+        return 0;
+    }
+    hist_fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (hist_fd == -1 || fstat(hist_fd, &st) == -1) {
+        perror("msh history");
+        goto fail;
+    }
+    seq = (unsigned long)st.st_size;
+    if (st.st_size == 0) {
+        return 0;
+    }
+    //the lines are indexed where they lie in the mapping, by msh_history_index
+    map_len = (size_t)st.st_size;
+    map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, hist_fd, 0);
+    if (map == MAP_FAILED) {
+        perror("msh history mmap");
+        map = NULL;
+        goto fail;
+    }
+    return 0;
+fail:
+    if (hist_fd != -1) {
+        close(hist_fd);
+    }
+    hist_fd = -1;
+    return -1;
+}
+
+void
+msh_history_index(void)
+{
+    static int started = 0;
+    sigset_t all, old;
+
+    if (map == NULL || started) {
+        return;
+    }
+    started = 1;
+    //the indexer takes none of the shell's signals, they interrupt the main thread
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    if (pthread_create(&indexer, NULL, indexer_thread, NULL) != 0) {
+        perror("msh history indexer");
+        indexer_thread(NULL);
+    } else {
+        indexer_running = 1;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+size_t
+msh_history_tail(msh_history_visit_fn_t fn, void *data, size_t max)
+{
+    size_t end = map_len, found = 0;
+    const char *prev = NULL;
+    size_t prev_len = 0;
+
+    //walk back from the end, only touching the file's last pages
+    while (end > 0 && found < max) {
+        const char *nl;
+        size_t start, len;
+
+        if (map[end - 1] == '\n') {
+            end--;
+        }
+        nl = memrchr(map, '\n', end);
+        start = nl ? (size_t)(nl - map) + 1 : 0;
+        len = end - start;
+        if (len > 0 && (prev == NULL || prev_len != len || memcmp(prev, map + start, len) != 0)) {
+            fn(map + start, len, 1, start, data);
+            prev = map + start;
+            prev_len = len;
+            found++;
+        }
+        end = start;
+    }
+
+    return found;
+}
+
+//record the lines the shell didn't wait for the lock to record, with the lock held
+static void
+record_pending(void)
+{
+    for (size_t i = 0; i < num_pending; i++) {
+        struct hist_entry *e = record(pending[i].line, pending[i].len, pending[i].when);
+
+        if (e == NULL || e->line != pending[i].line) {
+            free(pending[i].line);
+        }
+    }
+    num_pending = 0;
+}
+
+void
+msh_history_add(const char *line)
+{
+    size_t len = strlen(line);
+    char *copy, *buf;
+    struct hist_entry *e;
+
+    //without a history (input that isn't a terminal), nothing would ever read the lines back
+    if (len == 0 || hints == NULL) {
+        return;
+    }
+    copy = malloc(len + 1);
+    if (copy == NULL) {
+        return;
+    }
+    memcpy(copy, line, len + 1);
+    //the shell never waits for the indexer, the line waits instead
+    if (pthread_mutex_trylock(&lock) != 0) {
+        struct pending_line *grown = pending;
+
+        if (num_pending == cap_pending) {
+            cap_pending = cap_pending ? cap_pending * 2 : 16;
+            grown = realloc(pending, cap_pending * sizeof(*pending));
+        }
+        if (grown != NULL) {
+            pending = grown;
+            pending[num_pending++] = (struct pending_line) { .line = copy, .len = len, .when = seq };
+        } else {
+            free(copy);
+        }
+    } else {
+        record_pending();
+        e = record(copy, len, seq);
+        pthread_mutex_unlock(&lock);
+        //the entry kept an older copy of the line
+        if (e == NULL || e->line != copy) {
+            free(copy);
+        }
+    }
+    seq += len + 1;
+
+    if (hist_fd == -1) {
+        return;
+    }
+    //one write, so appends from other shells land between lines
+    buf = malloc(len + 1);
+    if (buf == NULL) {
+        return;
+    }
+    memcpy(buf, line, len);
+    buf[len] = '\n';
+    if (write(hist_fd, buf, len + 1) != (ssize_t)(len + 1)) {
+        perror("msh history write");
+        close(hist_fd);
+        hist_fd = -1;
+    }
+    free(buf);
+}
+
+static int
+cmp_recent(const void *a, const void *b)
+{
+    unsigned long x = entries[*(const uint32_t *)a].last, y = entries[*(const uint32_t *)b].last;
+
+    return (x < y) - (x > y);
+}
+
+size_t
+msh_history_search(const char *text, msh_history_visit_fn_t fn, void *data, size_t max)
+{
+    size_t len = strlen(text), num_candidates, found = 0;
+    const uint32_t *candidates = NULL;
+    uint32_t *matches;
+
+    pthread_mutex_lock(&lock);
+    record_pending();
+    num_candidates = num_entries;
+    //only lines in the shortest list of the text's trigrams can match
+    for (size_t i = 0; i + 3 <= len; i++) {
+        struct posting *p = &trigrams[trigram_bucket(text + i)];
+
+        if (candidates == NULL || p->num < num_candidates) {
+            candidates = p->ids;
+            num_candidates = p->num;
+        }
+    }
+    matches = num_candidates ? malloc(num_candidates * sizeof(uint32_t)) : NULL;
+    if (matches == NULL) {
+        pthread_mutex_unlock(&lock);
+        return 0;
+    }
+    for (size_t i = 0; i < num_candidates; i++) {
+        uint32_t id = candidates ? candidates[i] : (uint32_t)i;
+
+        if (memmem(entries[id].line, entries[id].len, text, len) != NULL) {
+            matches[found++] = id;
+        }
+    }
+    qsort(matches, found, sizeof(uint32_t), cmp_recent);
+    if (found > max) {
+        found = max;
+    }
+    for (size_t i = 0; i < found; i++) {
+        struct hist_entry *e = &entries[matches[i]];
+
+        fn(e->line, e->len, e->count, e->last, data);
+    }
+    pthread_mutex_unlock(&lock);
+    free(matches);
+
+    return found;
+}
+
+int
+msh_history_suggest(const char *prefix, char *buf, size_t sz)
+{
+    int ret;
+
+    //a keystroke never waits for the indexer
+    if (hints == NULL || pthread_mutex_trylock(&lock) != 0) {
+        return -1;
+    }
+    record_pending();
+    ret = ptrie_autocomplete(hints, prefix, buf, sz);
+    pthread_mutex_unlock(&lock);
+
+    return ret;
+}
+
+void
+msh_history_close(void)
+{
+    if (indexer_running) {
+        atomic_store(&stopping, 1);
+        pthread_join(indexer, NULL);
+        indexer_running = 0;
+    }
+    for (size_t i = 0; i < num_pending; i++) {
+        free(pending[i].line);
+    }
+    free(pending);
+    pending = NULL;
+    num_pending = cap_pending = 0;
+    for (size_t i = 0; i < num_entries; i++) {
+        //lines outside the mapping were added this session
+        if (map == NULL || entries[i].line < map || entries[i].line >= map + map_len) {
+            free((char *)entries[i].line);
+        }
+    }
+    for (size_t i = 0; i < MSH_HISTORY_TRIGRAMS; i++) {
+        free(trigrams[i].ids);
+        trigrams[i] = (struct posting) { 0 };
+    }
+    free(entries);
+    free(table);
+    ptrie_free(hints);
+    hints = NULL;
+    entries = NULL;
+    table = NULL;
+    num_entries = cap_entries = table_size = 0;
+    if (map != NULL) {
+        munmap(map, map_len);
+        map = NULL;
+    }
+    if (hist_fd != -1) {
+        close(hist_fd);
+        hist_fd = -1;
+    }
+}
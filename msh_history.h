@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stddef.h>
+
+/***
+ * The command history. It is kept in an append-only file that is
+ * mapped into memory at startup, so a large history loads without
+ * being read or copied; a background thread indexes the mapped lines
+ * while the shell is already taking input. Each distinct line is
+ * indexed once, with the
+ * number of times it was used and when it was last used, and a
+ * trigram index over the distinct lines makes substring searches touch
+ * only the lines that can match. The distinct lines are also kept in a
+ * prefix trie ranked by frecency (how often and how recently they were
+ * used), to suggest the rest of a line as it is typed. Every line is appended with a single
+ * `O_APPEND` write, so several shells can share the file.
+ */
+
+/**
+ * `msh_history_visit_fn_t` is called for each line found by a search.
+ * The line is not `\0`-terminated.
+ *
+ * - `@line` - the line.
+ * - `@len` - the length of the line.
+ * - `@count` - how many times the line was entered.
+ * - `@last` - when the line was last entered, as a number increasing
+ *     over the whole history.
+ * - `@data` - the caller's data.
+ */
+typedef void (*msh_history_visit_fn_t)(const char *line, size_t len, unsigned long count, unsigned long last, void *data);
+
+/**
+ * `msh_history_open` loads the history.
+ *
+ * - `@path` - the history file (created if missing), or `NULL` to
+ *     keep the history in memory only.
+ * - `@return` - `0` on success, `-1` if the file couldn't be used (the
+ *     history is then kept in memory only).
+ */
+int msh_history_open(const char *path);
+
+/**
+ * `msh_history_index` starts indexing the opened file on a background
+ * thread, the first time it is called. It is left until the shell is
+ * otherwise ready for input, as the thread competes with the rest of
+ * the startup for a single cpu. The thread runs niced, and the shell
+ * never waits for it to record a line.
+ */
+void msh_history_index(void);
+
+/**
+ * `msh_history_add` records an entered line, appending it to the
+ * file. Lines are dropped if `msh_history_open` wasn't called.
+ */
+void msh_history_add(const char *line);
+
+/**
+ * `msh_history_tail` walks the lines of the history file from its
+ * end, skipping repeats of the line just visited. It only reads the
+ * end of the file, so it doesn't wait for the index.
+ *
+ * - `@fn` - called for each line, most recent first.
+ * - `@data` - passed to `fn`.
+ * - `@max` - stop after this many lines.
+ * - `@return` - the number of lines passed to `fn`.
+ */
+size_t msh_history_tail(msh_history_visit_fn_t fn, void *data, size_t max);
+
+/**
+ * `msh_history_search` finds the distinct lines that contain `text`,
+ * most recently used first. Until the file is fully indexed, only the
+ * lines indexed so far are found.
+ *
+ * - `@text` - the substring to look for, `""` matches every line.
+ * - `@fn` - called for each line found.
+ * - `@data` - passed to `fn`.
+ * - `@max` - stop after this many lines.
+ * - `@return` - the number of lines passed to `fn`.
+ */
+size_t msh_history_search(const char *text, msh_history_visit_fn_t fn, void *data, size_t max);
+
+/**
+ * `msh_history_suggest` finds the line starting with `prefix` with the
+ * best frecency. It doesn't wait while the history is being indexed.
+ *
+ * - `@prefix` - what has been typed so far.
+ * - `@buf` - where the line is copied.
+ * - `@sz` - the size of `buf`.
+ * - `@return` - `0` on success, `-1` if there is no suggestion.
+ */
+int msh_history_suggest(const char *prefix, char *buf, size_t sz);
+
+/**
+ * `msh_history_close` unmaps the file and frees the index.
+ */
+void msh_history_close(void);
@@ -0,0 +1,204 @@
+#define _GNU_SOURCE
+
+#include <msh_log.h>
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+
+/* bytes in the ring, must be a power of two */
+#define MSH_LOG_RING (1 << 20)
+
+static char ring[MSH_LOG_RING];
+//free-running byte counters: head is written by the shell, tail by the writer
+static _Atomic size_t head = 0;
+static _Atomic size_t tail = 0;
+static _Atomic int stopping = 0;
+static unsigned long dropped = 0;
+
+static int log_fd = -1;
+//wakes the writer up, a non-blocking write from the shell
+static int wake_fd = -1;
+static pthread_t writer;
+
+//write all of buf, the writer is the only one touching log_fd
+static void
+write_all(const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(log_fd, buf, len);
+
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            perror("msh log write");
+            return;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+static void *
+writer_thread(void *arg)
+{
+    (void)arg;
+
+    while (1) {
+        uint64_t ignored;
+        size_t t = atomic_load_explicit(&tail, memory_order_relaxed);
+        size_t h = atomic_load_explicit(&head, memory_order_acquire);
+
+        if (t == h) {
+            if (atomic_load(&stopping)) {
+                break;
+            }
+            //sleep until the shell queues something, the eventfd itself
+            //is non-blocking so that the shell's side never waits
+            struct pollfd pfd = { .fd = wake_fd, .events = POLLIN };
+            if (poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+                perror("msh log wait");
+                break;
+            }
+            if (read(wake_fd, &ignored, sizeof(ignored)) == -1 && errno != EAGAIN) {
+                perror("msh log wait");
+                break;
+            }
+            continue;
+        }
+
+        //the queued bytes may wrap around the end of the ring
+        size_t off = t & (MSH_LOG_RING - 1);
+        size_t len = h - t;
+        if (off + len > MSH_LOG_RING) {
+            len = MSH_LOG_RING - off;
+        }
+        write_all(&ring[off], len);
+        atomic_store_explicit(&tail, t + len, memory_order_release);
+    }
+
+    return NULL;
+}
+
+int
+msh_log_open(const char *path)
+{
+    sigset_t all, old;
+    struct stat st;
+
+    log_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (log_fd == -1) {
+        return -1;
+    }
+    //a new log starts with its magic
+    if (fstat(log_fd, &st) == 0 && st.st_size == 0) {
+        write_all(MSH_LOG_MAGIC, MSH_LOG_MAGICLEN);
+    }
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd == -1) {
+        close(log_fd);
+        log_fd = -1;
+        return -1;
+    }
+    //blocked in the writer, so SIGALRM and cntrl-c always reach the main thread
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    errno = pthread_create(&writer, NULL, writer_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (errno != 0) {
+        close(wake_fd);
+        close(log_fd);
+        log_fd = wake_fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+//copy len bytes into the ring at byte counter pos, wrapping around
+static void
+ring_put(size_t pos, const void *src, size_t len)
+{
+    size_t off = pos & (MSH_LOG_RING - 1);
+    size_t first = len < MSH_LOG_RING - off ? len : MSH_LOG_RING - off;
+
+    if (len == 0) {
+        return;
+    }
+    memcpy(&ring[off], src, first);
+    memcpy(&ring[0], (const char *)src + first, len - first);
+}
+
+void
+msh_log_pipeline(const char *input, struct timespec *start, struct timespec *end,
+                 struct msh_log_stage *stages, size_t n)
+{
+    static const char zeros[8] = { 0 };
+    struct msh_log_record rec;
+    size_t input_len, stages_len, body, len, h;
+
+    if (log_fd == -1) {
+        return;
+    }
+    input_len = strlen(input);
+    if (input_len > UINT16_MAX) input_len = UINT16_MAX;
+
+    //records are padded so the next header stays aligned
+    stages_len = n * sizeof(struct msh_log_stage);
+    body = sizeof(rec) + stages_len + input_len;
+    len = (body + 7) & ~(size_t)7;
+
+    //never wait for the writer, drop the record if there's no room
+    h = atomic_load_explicit(&head, memory_order_relaxed);
+    if (len > MSH_LOG_RING - (h - atomic_load_explicit(&tail, memory_order_acquire))) {
+        dropped++;
+        return;
+    }
+
+    rec.len = (uint32_t)len;
+    rec.num_stages = (uint16_t)n;
+    rec.input_len = (uint16_t)input_len;
+    rec.start_ns = (int64_t)start->tv_sec * 1000000000 + start->tv_nsec;
+    rec.end_ns = (int64_t)end->tv_sec * 1000000000 + end->tv_nsec;
+
+    ring_put(h, &rec, sizeof(rec));
+    ring_put(h + sizeof(rec), stages, stages_len);
+    ring_put(h + sizeof(rec) + stages_len, input, input_len);
+    ring_put(h + body, zeros, len - body);
+    atomic_store_explicit(&head, h + len, memory_order_release);
+
+    //an eventfd write only fails when the counter would overflow
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+        perror("msh log wake");
+    }
+}
+
+void
+msh_log_close(void)
+{
+    uint64_t one = 1;
+
+    if (log_fd == -1) {
+        return;
+    }
+    atomic_store(&stopping, 1);
+    if (write(wake_fd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+        perror("msh log wake");
+    }
+    pthread_join(writer, NULL);
+    if (dropped > 0) {
+        fprintf(stderr, "msh: %lu execution log records dropped\n", dropped);
+    }
+    close(wake_fd);
+    close(log_fd);
+    log_fd = wake_fd = -1;
+}
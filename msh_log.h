@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+/***
+ * The execution log: an append-only binary file with one record per
+ * pipeline the shell runs. Records are handed to a background writer
+ * thread through a lock-free single-producer/single-consumer ring, so
+ * the shell never waits on log I/O; if the ring is full the record is
+ * dropped (and counted) instead.
+ *
+ * File layout (host byte order):
+ *
+ * ```
+ * "MSHLOG1\n"
+ * record*  where record = msh_log_record, msh_log_stage[num_stages],
+ *          the input string (input_len bytes, not NUL-terminated),
+ *          then padding to a multiple of 8 bytes
+ * ```
+ *
+ * `tools/mshlog` converts a log to JSON lines.
+ */
+
+#define MSH_LOG_MAGIC    "MSHLOG1\n"
+#define MSH_LOG_MAGICLEN 8
+
+struct msh_log_record {
+    //total bytes in the record, this header and padding included
+    uint32_t len;
+    uint16_t num_stages;
+    uint16_t input_len;
+    //CLOCK_REALTIME nanoseconds
+    int64_t start_ns;
+    int64_t end_ns;
+};
+
+struct msh_log_stage {
+    int32_t pid;
+    //the wait status, decode it with the W* macros
+    int32_t status;
+    int64_t utime_us;
+    int64_t stime_us;
+    int64_t maxrss_kb;
+    int64_t minflt;
+    int64_t majflt;
+    int64_t nvcsw;
+    int64_t nivcsw;
+};
+
+/**
+ * `msh_log_open` starts logging to `path`, appending to it if it
+ * already exists.
+ *
+ * - `@return` - `0` on success, `-1` (with `errno` set) otherwise.
+ */
+int msh_log_open(const char *path);
+
+/**
+ * `msh_log_pipeline` queues the record of one finished pipeline. It
+ * never blocks, and does nothing if the log isn't open.
+ *
+ * - `@input` - the pipeline's input string.
+ * - `@start` - when the pipeline started (`CLOCK_REALTIME`).
+ * - `@end` - when its last process was reaped.
+ * - `@stages` - per-command exit status and resource usage.
+ * - `@n` - the number of `stages`, `0` for builtins.
+ */
+void msh_log_pipeline(const char *input, struct timespec *start, struct timespec *end,
+                      struct msh_log_stage *stages, size_t n);
+
+/**
+ * `msh_log_close` writes out the queued records and stops the writer.
+ */
+void msh_log_close(void);
@@ -0,0 +1,419 @@
+#include <msh.h>
+#include <msh_parse.h>
+#include <msh_loop.h>
+#include <msh_var.h>
+#include <msh_subst.h>
+#include <msh_glob.h>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+//set by the cntrl-c handler
+extern volatile sig_atomic_t sigint_received;
+
+struct loop;
+
+//a step of a loop's body: a pipeline, or a loop
+struct node {
+    struct node *next;
+    struct msh_pipeline *p;
+    struct loop *loop;
+};
+
+struct loop {
+    int is_while;
+    //the `for` command, or the `while` condition
+    struct msh_pipeline *head;
+    struct node *body, **tail;
+    //the `do` hasn't been read yet
+    int want_do;
+    //it is read up to its `done`, but not run
+    int bad;
+};
+
+//the loops being read, innermost last
+static struct loop *reading[MSH_LOOP_DEPTH];
+static size_t num_reading = 0;
+
+//the variables of the loops running, innermost last, in front of the shell's
+struct binding {
+    const char *name;
+    size_t len;
+    const char *value;
+};
+static struct binding bindings[MSH_LOOP_DEPTH];
+static size_t num_bindings = 0;
+
+//the lookup of every pipeline the shell runs: loop variables, substitutions, then the shell's
+static const char *
+loop_lookup(const char *name, size_t len, void *data)
+{
+    if (name[0] == '(') {
+        return msh_subst_run(name + 1, len - 2, loop_lookup, data);
+    }
+    for (size_t i = num_bindings; i > 0; i--) {
+        if (bindings[i - 1].len == len && memcmp(bindings[i - 1].name, name, len) == 0) {
+            return bindings[i - 1].value;
+        }
+    }
+    return msh_var_lookup(name, len, data);
+}
+
+static void
+loop_free(struct loop *l)
+{
+    struct node *n, *next;
+
+    for (n = l->body; n != NULL; n = next) {
+        next = n->next;
+        if (n->loop != NULL) {
+            loop_free(n->loop);
+        } else {
+            msh_pipeline_free(n->p);
+        }
+        free(n);
+    }
+    msh_pipeline_free(l->head);
+    free(l);
+}
+
+static size_t
+num_args(struct msh_command *c)
+{
+    char **args = msh_command_args(c);
+    size_t n = 0;
+
+    while (args[n] != NULL) {
+        n++;
+    }
+    return n;
+}
+
+//is this pipeline just the keyword, e.g. a `done`?
+static int
+just(struct msh_pipeline *p, const char *word)
+{
+    struct msh_command *c = msh_pipeline_command(p, 0);
+
+    return msh_pipeline_command(p, 1) == NULL && !msh_pipeline_background(p) &&
+        strcmp(msh_command_program(c), word) == 0 && num_args(c) == 1;
+}
+
+static int
+valid_name(const char *name)
+{
+    if (!isalpha((unsigned char)*name) && *name != '_') {
+        return 0;
+    }
+    while (isalnum((unsigned char)*name) || *name == '_') {
+        name++;
+    }
+    return *name == '\0';
+}
+
+static void run_loop(struct loop *l);
+
+//expand the pipeline's variables, and run it
+static void
+run_one(struct msh_pipeline *p)
+{
+    if (msh_pipeline_expand(p, loop_lookup, NULL) != 0) {
+        fprintf(stderr, "msh: out of memory expanding %s\n", msh_pipeline_input(p));
+        return;
+    }
+    msh_execute(p);
+}
+
+static void
+run_body(struct loop *l)
+{
+    for (struct node *n = l->body; n != NULL && !sigint_received; n = n->next) {
+        if (n->loop != NULL) {
+            run_loop(n->loop);
+        } else {
+            run_one(n->p);
+        }
+    }
+}
+
+//n words and their strings, in one allocation
+static char **
+copy_words(char **words, size_t n)
+{
+    size_t size = (n + 1) * sizeof(char *);
+    char **copy, *str;
+
+    for (size_t i = 0; i < n; i++) {
+        size += strlen(words[i]) + 1;
+    }
+    copy = malloc(size);
+    if (copy == NULL) {
+        return NULL;
+    }
+    str = (char *)(copy + n + 1);
+    for (size_t i = 0; i < n; i++) {
+        size_t len = strlen(words[i]) + 1;
+
+        copy[i] = memcpy(str, words[i], len);
+        str += len;
+    }
+    copy[n] = NULL;
+
+    return copy;
+}
+
+static void
+run_loop(struct loop *l)
+{
+    struct msh_command *c;
+    char **args, **words;
+    size_t num_words;
+
+    if (l->is_while) {
+        while (!sigint_received) {
+            run_one(l->head);
+            if (msh_status() != 0) {
+                break;
+            }
+            run_body(l);
+        }
+        return;
+    }
+    //the words may use the variables of the loops around it
+    if (msh_pipeline_expand(l->head, loop_lookup, NULL) != 0) {
+        fprintf(stderr, "msh: out of memory expanding %s\n", msh_pipeline_input(l->head));
+        return;
+    }
+    c = msh_pipeline_command(l->head, 0);
+    args = msh_command_args(c);
+    //then their patterns, into a copy as the body's expansions reuse the arena
+    words = msh_glob_argv(args + 3, &num_words);
+    if (words != NULL && words != args + 3) {
+        words = copy_words(words, num_words);
+    }
+    if (words == NULL) {
+        fprintf(stderr, "msh: out of memory expanding %s\n", msh_pipeline_input(l->head));
+        return;
+    }
+    bindings[num_bindings] = (struct binding) { .name = args[1], .len = strlen(args[1]) };
+    num_bindings++;
+    for (size_t i = 0; words[i] != NULL && !sigint_received; i++) {
+        bindings[num_bindings - 1].value = words[i];
+        run_body(l);
+    }
+    num_bindings--;
+    if (words != args + 3) {
+        free(words);
+    }
+}
+
+//start reading a loop, its head is `for ...` or `while ...`
+static void
+loop_open(struct msh_pipeline *p, int is_while)
+{
+    struct msh_command *c = msh_pipeline_command(p, 0);
+    struct loop *l;
+
+    if (num_reading == MSH_LOOP_DEPTH) {
+        fprintf(stderr, "msh: loops nested more than %d deep\n", MSH_LOOP_DEPTH);
+        msh_pipeline_free(p);
+        //the rest is read as the body of the innermost loop, which won't run
+        reading[num_reading - 1]->bad = 1;
+        return;
+    }
+    l = calloc(1, sizeof(*l));
+    if (l == NULL) {
+        perror("msh: loop");
+        msh_pipeline_free(p);
+        return;
+    }
+    l->is_while = is_while;
+    l->head = p;
+    l->tail = &l->body;
+    l->want_do = 1;
+    if (is_while) {
+        if (msh_command_shift(c, 1) != 0) {
+            fprintf(stderr, "usage: while PIPELINE; do PIPELINE; ...; done\n");
+            l->bad = 1;
+        }
+    } else if (msh_pipeline_command(p, 1) != NULL || msh_pipeline_background(p) || num_args(c) < 3 ||
+               !valid_name(msh_command_args(c)[1]) || strcmp(msh_command_args(c)[2], "in") != 0) {
+        fprintf(stderr, "usage: for NAME in WORD...; do PIPELINE; ...; done\n");
+        l->bad = 1;
+    }
+    reading[num_reading++] = l;
+}
+
+//the loop's `done` was read
+static void
+loop_close(void)
+{
+    struct loop *l = reading[--num_reading];
+    struct node *n;
+
+    if (l->want_do) {
+        fprintf(stderr, "msh: done before do\n");
+        l->bad = 1;
+    }
+    if (num_reading == 0) {
+        //the outermost loop is read, run it
+        sigint_received = 0;
+        if (!l->bad) {
+            run_loop(l);
+        }
+        loop_free(l);
+        return;
+    }
+    n = calloc(1, sizeof(*n));
+    if (n == NULL) {
+        perror("msh: loop");
+        reading[num_reading - 1]->bad = 1;
+        loop_free(l);
+        return;
+    }
+    //a bad inner loop spoils the loops around it
+    if (l->bad) {
+        reading[num_reading - 1]->bad = 1;
+    }
+    n->loop = l;
+    *reading[num_reading - 1]->tail = n;
+    reading[num_reading - 1]->tail = &n->next;
+}
+
+void
+msh_loop_run(struct msh_pipeline *p)
+{
+    struct loop *l = num_reading > 0 ? reading[num_reading - 1] : NULL;
+    const char *program = msh_command_program(msh_pipeline_command(p, 0));
+    struct node *n;
+
+    //the body starts after the `do`, on the same pipeline or the next
+    if (l != NULL && l->want_do) {
+        l->want_do = 0;
+        if (strcmp(program, "do") != 0) {
+            fprintf(stderr, "msh: expected do, got %s\n", program);
+            l->bad = 1;
+            msh_pipeline_free(p);
+            return;
+        }
+        if (just(p, "do")) {
+            msh_pipeline_free(p);
+            return;
+        }
+        if (msh_command_shift(msh_pipeline_command(p, 0), 1) != 0) {
+            l->bad = 1;
+            msh_pipeline_free(p);
+            return;
+        }
+        program = msh_command_program(msh_pipeline_command(p, 0));
+    }
+
+    if (strcmp(program, "for") == 0 || strcmp(program, "while") == 0) {
+        loop_open(p, program[0] == 'w');
+        return;
+    }
+    if (strcmp(program, "done") == 0 || strcmp(program, "do") == 0) {
+        if (l == NULL || !just(p, "done")) {
+            fprintf(stderr, "msh: %s outside of a loop\n", program);
+            if (l != NULL) {
+                l->bad = 1;
+            }
+        } else {
+            loop_close();
+        }
+        msh_pipeline_free(p);
+        return;
+    }
+    if (l == NULL) {
+        run_one(p);
+        msh_pipeline_free(p);
+        return;
+    }
+
+    n = calloc(1, sizeof(*n));
+    if (n == NULL) {
+        perror("msh: loop");
+        l->bad = 1;
+        msh_pipeline_free(p);
+        return;
+    }
+    n->p = p;
+    *l->tail = n;
+    l->tail = &n->next;
+}
+
+//give the copy parsed into s the body of a here-document, a line at a time
+static msh_err_t
+heredoc_copy(struct msh_sequence *s, const char *body)
+{
+    char *end = strdup(msh_sequence_heredoc(s));
+    msh_err_t err = end == NULL ? MSH_ERR_NOMEM : 0;
+
+    while (err == 0 && *body != '\0') {
+        const char *nl = strchr(body, '\n');
+        size_t len = nl != NULL ? (size_t)(nl - body) : strlen(body);
+        char *line = strndup(body, len);
+
+        err = line != NULL ? msh_sequence_heredoc_line(s, line) : MSH_ERR_NOMEM;
+        free(line);
+        body += nl != NULL ? len + 1 : len;
+    }
+    if (err == 0) {
+        err = msh_sequence_heredoc_line(s, end);
+    }
+    free(end);
+
+    return err;
+}
+
+void
+msh_loop_run_borrowed(struct msh_pipeline *p)
+{
+    const char *program = msh_command_program(msh_pipeline_command(p, 0));
+    struct msh_command *c;
+    struct msh_sequence *s;
+    struct msh_pipeline *copy;
+    msh_err_t err;
+
+    if (num_reading == 0 && strcmp(program, "for") != 0 && strcmp(program, "while") != 0 &&
+        strcmp(program, "do") != 0 && strcmp(program, "done") != 0) {
+        run_one(p);
+        return;
+    }
+    //a loop keeps its pipelines, so it gets its own (parsed from the pipeline's input)
+    s = msh_sequence_alloc();
+    err = s != NULL ? msh_sequence_parse(msh_pipeline_input(p), s) : MSH_ERR_NOMEM;
+    //the input doesn't hold the bodies of its here-documents
+    for (size_t i = 0; err == 0 && (c = msh_pipeline_command(p, i)) != NULL; i++) {
+        int doc;
+        char *here = msh_command_here(c, &doc);
+
+        if (here != NULL && doc && msh_sequence_heredoc(s) != NULL) {
+            err = heredoc_copy(s, here);
+        }
+    }
+    if (err != 0 || (copy = msh_sequence_pipeline(s)) == NULL) {
+        fprintf(stderr, "msh: cannot copy %s\n", msh_pipeline_input(p));
+        msh_sequence_free(s);
+        return;
+    }
+    msh_sequence_free(s);
+    msh_loop_run(copy);
+}
+
+int
+msh_loop_finish(void)
+{
+    if (num_reading == 0) {
+        return 0;
+    }
+    fprintf(stderr, "msh: loop without done\n");
+    while (num_reading > 0) {
+        loop_free(reading[--num_reading]);
+    }
+
+    return -1;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <msh.h>
+
+/***
+ * Loops:
+ *
+ * ```
+ * for NAME in WORD...; do PIPELINE; ...; done
+ * while PIPELINE; do PIPELINE; ...; done
+ * ```
+ *
+ * `for` runs the body once for each word with `$NAME` (or `${NAME}`)
+ * set to it, `while` runs it for as long as its pipeline succeeds. The
+ * `do`, the body, and the `done` may be spread over any number of
+ * lines, and loops nest. A loop's pipelines are parsed once, when they
+ * are read, and only their variables are expanded again on each
+ * iteration. Cntrl-c stops every running loop.
+ */
+
+/* loops nest this deep at most */
+#define MSH_LOOP_DEPTH 16
+
+/**
+ * `msh_loop_run` expands the pipeline's variables and runs it, unless
+ * it is part of a loop, in which case the loop is run once its `done`
+ * is read.
+ *
+ * - `@p` - the pipeline, passed to the loops, which free it.
+ */
+void msh_loop_run(struct msh_pipeline *p);
+
+/**
+ * `msh_loop_run_borrowed` is `msh_loop_run` for a pipeline the loops
+ * don't own (e.g. from a compiled script): it is copied if a loop has
+ * to keep it.
+ */
+void msh_loop_run_borrowed(struct msh_pipeline *p);
+
+/**
+ * `msh_loop_finish` is called at the end of the input: a loop still
+ * missing its `done` is dropped.
+ *
+ * - `@return` - `0`, or `-1` if a loop was dropped.
+ */
+int msh_loop_finish(void);
@@ -1,13 +1,24 @@
 #include <msh.h>
 #include <msh_parse.h>
+#include <msh_complete.h>
+#include <msh_history.h>
+#include <msh_prefetch.h>
+#include <msh_script.h>
+#include <msh_loop.h>
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <malloc.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
 
 #include <linenoise.h>
 
+/* lines at the end of the history file that the up arrow walks */
+#define HISTORY_RECALL 1024
+
 char *
 msh_input(void)
 {
@@ -20,34 +31,232 @@ msh_input(void)
 
 		return NULL;
 	}
-	if (line) linenoiseHistoryAdd(line);
+	if (line) {
+		linenoiseHistoryAdd(line);
+		msh_history_add(line);
+	}
 
 	return line;
 }
 
+struct loaded_history {
+	char **lines;
+	size_t num;
+};
+
+static void
+load_history_line(const char *line, size_t len, unsigned long count, unsigned long last, void *data)
+{
+	struct loaded_history *h = data;
+
+	(void)count;
+	(void)last;
+	h->lines[h->num++] = strndup(line, len);
+}
+
+/*
+ * Interactive shells keep their history in `$MSH_HISTFILE` (by
+ * default `~/.msh_history`); the up arrow walks the end of it. Only
+ * the last `HISTORY_RECALL` lines are read, straight from the file's
+ * mapping, so that a large history doesn't hold the prompt back; all
+ * of it is searched with "!?".
+ */
+static void
+history_init(void)
+{
+	char path[4096];
+	const char *file = getenv("MSH_HISTFILE"), *home = getenv("HOME");
+	struct loaded_history h = { 0 };
+
+	if (!isatty(STDIN_FILENO)) return;
+	if (file == NULL && home != NULL) {
+		snprintf(path, sizeof(path), "%s/.msh_history", home);
+		file = path;
+	}
+	/* without a file, the history (and its suggestions) is this session's */
+	if (file == NULL || file[0] == '\0') file = NULL;
+	if (msh_history_open(file) != 0 || file == NULL) return;
+
+	h.lines = malloc(HISTORY_RECALL * sizeof(char *));
+	if (h.lines == NULL) return;
+	msh_history_tail(load_history_line, &h, HISTORY_RECALL);
+	/* found most recent first, linenoise wants them oldest first */
+	while (h.num > 0) {
+		char *line = h.lines[--h.num];
+
+		if (line) {
+			char program[MSH_PREFETCH_NAMELEN];
+
+			linenoiseHistoryAdd(line);
+			/* the history also teaches which program follows which */
+			if (sscanf(line, "%63s", program) == 1) msh_prefetch_learn(program);
+		}
+		free(line);
+	}
+	free(h.lines);
+}
+
+/*
+ * The hints are asked for on each keystroke: the first one starts
+ * indexing the history file, as it does the programs in PATH.
+ */
+static char *
+history_hint(const char *buf, int *color, int *bold)
+{
+	msh_history_index();
+
+	return msh_hint(buf, color, bold);
+}
+
+/*
+ * `--startup-profile` times each phase up to the first prompt. They're
+ * printed once it is reached, so that writing them isn't timed too.
+ */
+static int startup_profile = 0;
+static long startup_start, startup_last;
+static struct {
+	const char *name;
+	long ns;
+} startup_phases[8];
+static size_t startup_num_phases = 0;
+
+static long
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void
+startup_phase(const char *name)
+{
+	long now;
+
+	if (!startup_profile || startup_num_phases == 8) return;
+	now = now_ns();
+	startup_phases[startup_num_phases].name = name;
+	startup_phases[startup_num_phases++].ns = now - startup_last;
+	startup_last = now;
+}
+
+static void
+startup_report(void)
+{
+	long total = now_ns() - startup_start;
+
+	for (size_t i = 0; i < startup_num_phases; i++) {
+		fprintf(stderr, "startup: %-12s %9.1f us\n", startup_phases[i].name, (double)startup_phases[i].ns / 1e3);
+	}
+	fprintf(stderr, "startup: %-12s %9.1f us\n", "total", (double)total / 1e3);
+}
+
+/* `msh --compile SCRIPT -o OUT` */
+static int
+script_compile(const char *src, const char *out)
+{
+	size_t line;
+	msh_err_t err = msh_script_compile(src, out, &line);
+
+	if (err == 0) return EXIT_SUCCESS;
+	if (line > 0) {
+		fprintf(stderr, "MSH Error: %s:%zu: %s\n", src, line, msh_pipeline_err2str(err));
+	} else {
+		perror(src);
+	}
+
+	return EXIT_FAILURE;
+}
+
+/*
+ * `msh FILE` runs a script. A compiled script (see `--compile`) is run
+ * straight from its mapping, unless the script it came from changed
+ * since, in which case that script is run instead.
+ */
+static int
+script_run(const char *path)
+{
+	char source[4096];
+	struct msh_compiled *c = msh_compiled_open(path, source, sizeof(source));
+
+	if (c == NULL && errno == ESTALE) return msh_script_run(source);
+	if (c == NULL && errno == ENOEXEC) return msh_script_run(path);
+	if (c == NULL) {
+		perror(path);
+		return EXIT_FAILURE;
+	}
+	for (size_t i = 0; i < msh_compiled_count(c); i++) {
+		struct msh_pipeline *p = msh_compiled_pipeline(c, i);
+
+		if (p == NULL) {
+			fprintf(stderr, "msh: %s: corrupt pipeline %zu\n", path, i);
+			msh_compiled_close(c);
+			return EXIT_FAILURE;
+		}
+		msh_loop_run_borrowed(p);
+	}
+	msh_compiled_close(c);
+
+	return msh_loop_finish() == 0 ? 0 : EXIT_FAILURE;
+}
+
 int
 main(int argc, char *argv[])
 {
 	struct msh_sequence *s;
+	struct msh_allocator *pool;
+	const char *script = NULL;
 
-	if (argc > 1) {
-		fprintf(stderr, "Usage: %s\n", argv[0]);
+	startup_start = startup_last = now_ns();
+	if (argc == 2 && strcmp(argv[1], "--startup-profile") == 0) {
+		startup_profile = 1;
+	} else if (argc == 5 && strcmp(argv[1], "--compile") == 0 && strcmp(argv[3], "-o") == 0) {
+		return script_compile(argv[2], argv[4]);
+	} else if (argc == 2 && argv[1][0] != '-') {
+		script = argv[1];
+	} else if (argc > 1) {
+		fprintf(stderr, "Usage: %s [--startup-profile | --compile SCRIPT -o OUT | SCRIPT]\n", argv[0]);
 
 		return EXIT_FAILURE;
 	}
+	if (script != NULL) {
+		msh_init();
+
+		return script_run(script);
+	}
 	/*
 	 * See `ln/README.markdown` for linenoise usage. If you don't
 	 * see the `ln` directory, do a `make`.
+	 *
+	 * Only what the first prompt needs is done here: the end of the
+	 * history file is read for the up arrow, but it and PATH are only
+	 * indexed once the user starts typing, and the job table is shared
+	 * once a job starts.
 	 */
 	linenoiseHistorySetMaxLen(1<<16);
+	history_init();
+	startup_phase("history");
+	/* programs in PATH are indexed in the background */
+	msh_complete_init();
+	linenoiseSetCompletionCallback(msh_complete);
+	/* and previous lines are suggested as they are typed */
+	linenoiseSetHintsCallback(history_hint);
+	startup_phase("completion");
 
 	msh_init();
+	startup_phase("msh_init");
 
 	s = msh_sequence_alloc();
 	if (s == NULL) {
 		printf("MSH Error: Could not allocate msh sequence at initialization\n");
 		return EXIT_FAILURE;
 	}
+	/* every line is parsed from recycled pipelines and commands */
+	pool = msh_pool_create(NULL);
+	msh_sequence_allocator(s, pool);
+	startup_phase("parser");
+	if (startup_profile) startup_report();
 
 	/* Lets keep getting inputs! */
 	while (1) {
@@ -59,6 +268,17 @@ main(int argc, char *argv[])
 		if (!str) break; /* you must maintain this behavior: an empty command exits */
 
 		err = msh_sequence_parse(str, s);
+		/* a here-document's body is typed on the lines that follow */
+		while (err == 0 && msh_sequence_heredoc(s) != NULL) {
+			char *line = linenoise("> ");
+
+			if (line == NULL) {
+				err = MSH_ERR_UNTERMINATED_HEREDOC;
+				break;
+			}
+			err = msh_sequence_heredoc_line(s, line);
+			free(line);
+		}
 		if (err != 0) {
 			printf("MSH Error: %s\n", msh_pipeline_err2str(err));
 			free(str);
@@ -68,13 +288,14 @@ main(int argc, char *argv[])
 
 		/* dequeue pipelines and sequentially execute them */
 		while ((p = msh_sequence_pipeline(s)) != NULL) {
-			msh_execute(p);
-			msh_pipeline_free(p);
+			msh_loop_run(p);
 		}
 		free(str);
 	}
 
+	msh_loop_finish();
 	msh_sequence_free(s);
+	msh_pool_destroy(pool);
 
 	return 0;
 }
@@ -0,0 +1,402 @@
+#define _GNU_SOURCE
+
+#include <msh.h>
+#include <msh_parse.h>
+#include <msh_memo.h>
+#include <msh_glob.h>
+#include <msh_path.h>
+#include <msh_var.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+#define MEMO_MAGIC "MSHM"
+//holds the bytes the entries take up
+#define MEMO_SIZE_FILE "size"
+
+//what an entry starts with, its output and error follow
+struct memo_header {
+    char magic[4];
+    int32_t status;
+    uint64_t out_len;
+    uint64_t err_len;
+};
+
+//FNV-1a, 128 bits wide
+typedef unsigned __int128 hash_t;
+
+static void
+hash_bytes(hash_t *h, const void *data, size_t len)
+{
+    const hash_t prime = ((hash_t)0x0000000001000000ULL << 64) | 0x000000000000013BULL;
+    const unsigned char *p = data;
+
+    for (size_t i = 0; i < len; i++) {
+        *h ^= p[i];
+        *h *= prime;
+    }
+}
+
+//a string, with its end so that "ab" "c" isn't "a" "bc"
+static void
+hash_str(hash_t *h, const char *str)
+{
+    hash_bytes(h, str != NULL ? str : "", str != NULL ? strlen(str) + 1 : 0);
+    hash_bytes(h, "\n", 1);
+}
+
+//what a file is, without reading it: changing it changes its size or time
+static void
+hash_file(hash_t *h, const char *path)
+{
+    struct stat st;
+
+    if (path == NULL || stat(path, &st) != 0) {
+        hash_bytes(h, "-", 1);
+        return;
+    }
+    hash_bytes(h, &st.st_dev, sizeof(st.st_dev));
+    hash_bytes(h, &st.st_ino, sizeof(st.st_ino));
+    hash_bytes(h, &st.st_size, sizeof(st.st_size));
+    hash_bytes(h, &st.st_mtim, sizeof(st.st_mtim));
+}
+
+int
+msh_memo_key(struct msh_pipeline *p, struct msh_memo_key *key)
+{
+    hash_t h = ((hash_t)0x6c62272e07bb0142ULL << 64) | 0x62b821756295c58dULL;
+    char cwd[4096];
+    struct msh_command *c;
+    char **env;
+
+    for (size_t i = 0; (c = msh_pipeline_command(p, i)) != NULL; i++) {
+        char *out, *err, **argv;
+
+        msh_command_file_outputs(c, &out, &err);
+        if (out != NULL || err != NULL) {
+            return -1;
+        }
+        argv = msh_glob_argv(msh_command_args(c), NULL);
+        if (argv == NULL) {
+            return -1;
+        }
+        hash_bytes(&h, "|", 1);
+        for (size_t j = 0, program = 1; argv[j] != NULL; j++) {
+            hash_str(&h, argv[j]);
+            //the program is the first argument that isn't an assignment
+            if (program && strchr(argv[j], '=') == NULL) {
+                hash_file(&h, msh_path_resolve(argv[j]));
+                program = 0;
+            }
+            //an argument naming a file (or a directory) is read by the program, most likely
+            hash_file(&h, argv[j]);
+        }
+        hash_str(&h, msh_command_getdata(c));
+        hash_file(&h, msh_command_getdata(c));
+        hash_str(&h, msh_command_here(c, NULL));
+    }
+    for (env = msh_var_environ(); env != NULL && *env != NULL; env++) {
+        hash_str(&h, *env);
+    }
+    hash_str(&h, getcwd(cwd, sizeof(cwd)));
+    for (int i = 0; i < 16; i++) {
+        key->hash[i] = (unsigned char)(h >> (8 * i));
+    }
+
+    return 0;
+}
+
+//the store, created if it doesn't exist yet
+static const char *
+memo_dir(void)
+{
+    static char dir[4096];
+    const char *set = msh_var_get("MSH_MEMO_DIR", 12), *home;
+
+    if (set != NULL && *set != '\0') {
+        snprintf(dir, sizeof(dir), "%s", set);
+    } else if ((home = msh_var_get("HOME", 4)) != NULL) {
+        snprintf(dir, sizeof(dir), "%s/.cache/msh/memo", home);
+    } else {
+        return NULL;
+    }
+    //each directory on the way, like mkdir -p
+    for (char *s = dir + 1; ; s++) {
+        if (*s == '/' || *s == '\0') {
+            char ch = *s;
+
+            *s = '\0';
+            if (mkdir(dir, 0700) != 0 && errno != EEXIST) {
+                return NULL;
+            }
+            *s = ch;
+            if (ch == '\0') {
+                break;
+            }
+        }
+    }
+    return dir;
+}
+
+static void
+entry_path(char *path, size_t sz, const char *dir, const struct msh_memo_key *key)
+{
+    size_t len = (size_t)snprintf(path, sz, "%s/", dir);
+
+    for (int i = 0; i < 16 && len + 3 <= sz; i++, len += 2) {
+        snprintf(path + len, 3, "%02x", key->hash[i]);
+    }
+}
+
+//copy len bytes at off of in to out
+static int
+copy_range(int in, off_t off, size_t len, int out)
+{
+    off_t end = off + (off_t)len;
+
+    while (off < end) {
+        ssize_t n = sendfile(out, in, &off, (size_t)(end - off));
+
+        //not to a file opened for appending, copied through a buffer then
+        if (n == -1 && errno == EINVAL) {
+            char buf[65536];
+            size_t want = (size_t)(end - off) < sizeof(buf) ? (size_t)(end - off) : sizeof(buf);
+
+            n = pread(in, buf, want, off);
+            if (n > 0 && write(out, buf, (size_t)n) != n) {
+                n = -1;
+            }
+            off += n > 0 ? n : 0;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int
+msh_memo_replay(const struct msh_memo_key *key, int *status)
+{
+    const char *dir = memo_dir();
+    struct memo_header hdr;
+    char path[4200];
+    int fd;
+
+    if (dir == NULL) {
+        return 0;
+    }
+    entry_path(path, sizeof(path), dir, key);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return 0;
+    }
+    if (read(fd, &hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr) || memcmp(hdr.magic, MEMO_MAGIC, 4) != 0) {
+        close(fd);
+        return 0;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    copy_range(fd, sizeof(hdr), hdr.out_len, STDOUT_FILENO);
+    copy_range(fd, (off_t)(sizeof(hdr) + hdr.out_len), hdr.err_len, STDERR_FILENO);
+    close(fd);
+    //used just now, so it is the last to be evicted
+    utimensat(AT_FDCWD, path, NULL, 0);
+    *status = hdr.status;
+
+    return 1;
+}
+
+int
+msh_memo_capture_start(struct msh_memo_capture *c)
+{
+    c->fds[0] = memfd_create("msh-memo-out", MFD_CLOEXEC);
+    c->fds[1] = memfd_create("msh-memo-err", MFD_CLOEXEC);
+    fflush(stdout);
+    fflush(stderr);
+    c->saved[0] = dup(STDOUT_FILENO);
+    c->saved[1] = dup(STDERR_FILENO);
+    if (c->fds[0] == -1 || c->fds[1] == -1 || c->saved[0] == -1 || c->saved[1] == -1 ||
+        dup2(c->fds[0], STDOUT_FILENO) == -1 || dup2(c->fds[1], STDERR_FILENO) == -1) {
+        perror("memo");
+        for (int i = 0; i < 2; i++) {
+            if (c->saved[i] != -1) {
+                dup2(c->saved[i], i + 1);
+                close(c->saved[i]);
+            }
+            if (c->fds[i] != -1) {
+                close(c->fds[i]);
+            }
+        }
+        return -1;
+    }
+    return 0;
+}
+
+//an entry of the store, for eviction
+struct memo_entry {
+    struct timespec used;
+    off_t size;
+    char name[40];
+};
+
+static int
+cmp_used(const void *a, const void *b)
+{
+    const struct timespec *x = &((const struct memo_entry *)a)->used, *y = &((const struct memo_entry *)b)->used;
+
+    if (x->tv_sec != y->tv_sec) {
+        return x->tv_sec < y->tv_sec ? -1 : 1;
+    }
+    return x->tv_nsec < y->tv_nsec ? -1 : x->tv_nsec > y->tv_nsec;
+}
+
+//remove the least recently used entries until the store is within budget, returning its size
+static off_t
+memo_evict(const char *dir, off_t budget)
+{
+    off_t total = 0;
+    struct memo_entry *entries = NULL, *grown;
+    size_t n = 0, cap = 0;
+    struct dirent *d;
+    DIR *dp;
+
+    dp = opendir(dir);
+    if (dp == NULL) {
+        return -1;
+    }
+    while ((d = readdir(dp)) != NULL) {
+        struct stat st;
+
+        if (strlen(d->d_name) != 32 || fstatat(dirfd(dp), d->d_name, &st, 0) != 0) {
+            continue;
+        }
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            grown = realloc(entries, cap * sizeof(*entries));
+            if (grown == NULL) {
+                break;
+            }
+            entries = grown;
+        }
+        entries[n].used = st.st_mtim;
+        entries[n].size = st.st_size;
+        memcpy(entries[n].name, d->d_name, 33);
+        total += st.st_size;
+        n++;
+    }
+    if (total > budget) {
+        qsort(entries, n, sizeof(*entries), cmp_used);
+        for (size_t i = 0; i < n && total > budget; i++) {
+            if (unlinkat(dirfd(dp), entries[i].name, 0) == 0) {
+                total -= entries[i].size;
+            }
+        }
+    }
+    closedir(dp);
+    free(entries);
+
+    return total;
+}
+
+/*
+ * The store's size is kept in a file beside the entries, so that a new
+ * entry only lists them when they outgrow the budget. An unknown size
+ * (no file yet, or an entry removed by hand making it negative) is
+ * counted again.
+ */
+static void
+memo_account(const char *dir, off_t delta)
+{
+    const char *set = msh_var_get("MSH_MEMO_SIZE", 13);
+    off_t budget = set != NULL ? (off_t)strtoll(set, NULL, 10) : MSH_MEMO_BUDGET;
+    int64_t total = -1;
+    char path[4200];
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/" MEMO_SIZE_FILE, dir);
+    fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        return;
+    }
+    //other shells may be storing into the same directory
+    flock(fd, LOCK_EX);
+    if (pread(fd, &total, sizeof(total), 0) == (ssize_t)sizeof(total) && total >= 0) {
+        total += delta;
+    } else {
+        total = -1;
+    }
+    if (total < 0 || total > budget) {
+        total = memo_evict(dir, budget);
+    }
+    if (total >= 0 && pwrite(fd, &total, sizeof(total), 0) != (ssize_t)sizeof(total)) {
+        perror("memo");
+    }
+    close(fd);
+}
+
+//write the entry beside its name and rename it, so it is never seen half written
+static void
+memo_store(const struct msh_memo_key *key, struct msh_memo_capture *c, int status, off_t out_len, off_t err_len)
+{
+    const char *dir = memo_dir();
+    struct memo_header hdr = { .status = status, .out_len = (uint64_t)out_len, .err_len = (uint64_t)err_len };
+    off_t size = (off_t)sizeof(hdr) + out_len + err_len;
+    char path[4200], tmp[4300];
+    struct stat old;
+    int fd;
+
+    if (dir == NULL) {
+        return;
+    }
+    memcpy(hdr.magic, MEMO_MAGIC, 4);
+    entry_path(path, sizeof(path), dir, key);
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        return;
+    }
+    //an entry stored meanwhile (by another shell) is replaced
+    if (stat(path, &old) == 0) {
+        size -= old.st_size;
+    }
+    if (write(fd, &hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr) || copy_range(c->fds[0], 0, (size_t)out_len, fd) != 0 ||
+        copy_range(c->fds[1], 0, (size_t)err_len, fd) != 0 || close(fd) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return;
+    }
+    memo_account(dir, size);
+}
+
+void
+msh_memo_capture_end(struct msh_memo_capture *c, const struct msh_memo_key *key, int status)
+{
+    off_t len[2];
+
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < 2; i++) {
+        struct stat st;
+
+        dup2(c->saved[i], i + 1);
+        close(c->saved[i]);
+        len[i] = fstat(c->fds[i], &st) == 0 ? st.st_size : 0;
+    }
+    if (key != NULL) {
+        memo_store(key, c, status, len[0], len[1]);
+    }
+    copy_range(c->fds[0], 0, (size_t)len[0], STDOUT_FILENO);
+    copy_range(c->fds[1], 0, (size_t)len[1], STDERR_FILENO);
+    close(c->fds[0]);
+    close(c->fds[1]);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <msh_parse.h>
+
+/***
+ * Memoized pipelines, `memo <pipeline>`: the output of a pipeline
+ * that has run before, with nothing it reads changed since, is
+ * replayed instead of running it again.
+ *
+ * A pipeline is identified by a 128-bit hash of its arguments (with
+ * their patterns expanded), the identity (device, inode, size and
+ * modification time) of each program run and each argument naming a
+ * file or directory, its `<` input and here-documents, the exported
+ * environment, and the working directory. The store is a directory of
+ * entries named by that hash, each holding the standard output, the
+ * standard error and the exit status. Entries are touched when used,
+ * and the least recently used are removed once the store outgrows its
+ * budget. Its size is kept up to date in a `size` file beside them, so
+ * the entries are only listed then.
+ *
+ * `MSH_MEMO_DIR` sets the store (`~/.cache/msh/memo` otherwise), and
+ * `MSH_MEMO_SIZE` its budget in bytes.
+ */
+
+/* bytes the store may hold unless MSH_MEMO_SIZE says otherwise */
+#define MSH_MEMO_BUDGET (64 * 1024 * 1024)
+
+struct msh_memo_key {
+    unsigned char hash[16];
+};
+
+/**
+ * `msh_memo_key` hashes a pipeline and what it reads.
+ *
+ * - `@p` - the pipeline, expanded.
+ * - `@key` - set to its hash.
+ * - `@return` - `0`, or `-1` if it can't be memoized because it
+ *     writes to files of its own (redirections) rather than to the
+ *     shell's output.
+ */
+int msh_memo_key(struct msh_pipeline *p, struct msh_memo_key *key);
+
+/**
+ * `msh_memo_replay` writes a stored output out again.
+ *
+ * - `@key` - the pipeline's hash.
+ * - `@status` - set to the pipeline's exit status, on a hit.
+ * - `@return` - `1` if it was stored (and replayed), `0` if not.
+ */
+int msh_memo_replay(const struct msh_memo_key *key, int *status);
+
+/* the shell's output, while it is being captured */
+struct msh_memo_capture {
+    int fds[2];
+    int saved[2];
+};
+
+/**
+ * `msh_memo_capture_start` sends the standard output and error of
+ * whatever runs next to memory files.
+ *
+ * - `@return` - `0`, or `-1` if they couldn't be (which is reported).
+ */
+int msh_memo_capture_start(struct msh_memo_capture *c);
+
+/**
+ * `msh_memo_capture_end` puts the standard output and error back,
+ * stores what was captured under the key, and writes it out.
+ *
+ * - `@key` - the pipeline's hash, or `NULL` to only write it out (the
+ *     pipeline didn't finish as it should, and its output may be cut
+ *     short).
+ * - `@status` - the pipeline's exit status.
+ */
+void msh_memo_capture_end(struct msh_memo_capture *c, const struct msh_memo_key *key, int status);
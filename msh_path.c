@@ -0,0 +1,120 @@
+#define _XOPEN_SOURCE 700
+
+#include <msh_path.h>
+#include <msh_var.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+/* number of cached resolutions, must be a power of two */
+#define MSH_PATH_CACHE 256
+
+struct path_entry {
+    char *program;
+    //NULL for a negative entry (program not found)
+    char *path;
+};
+
+static struct path_entry cache[MSH_PATH_CACHE];
+//the PATH value the cache was filled from
+static char *cached_path_env = NULL;
+
+//FNV-1a, good enough for short program names
+static unsigned long
+hash_str(const char *s)
+{
+    unsigned long h = 14695981039346656037UL;
+
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211UL;
+    }
+    return h;
+}
+
+void
+msh_path_flush(void)
+{
+    for (size_t i = 0; i < MSH_PATH_CACHE; i++) {
+        free(cache[i].program);
+        free(cache[i].path);
+        cache[i].program = NULL;
+        cache[i].path = NULL;
+    }
+    free(cached_path_env);
+    cached_path_env = NULL;
+}
+
+//walk the PATH directories the same way execvp does
+static char *
+path_search(const char *program, const char *path_env)
+{
+    char candidate[PATH_MAX];
+    const char *dir = path_env;
+
+    while (dir != NULL) {
+        const char *end = strchr(dir, ':');
+        size_t len = end ? (size_t)(end - dir) : strlen(dir);
+        struct stat st;
+
+        //an empty PATH entry means the current directory
+        if (len == 0) {
+            snprintf(candidate, sizeof(candidate), "%s", program);
+        } else {
+            snprintf(candidate, sizeof(candidate), "%.*s/%s", (int)len, dir, program);
+        }
+        if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode) && access(candidate, X_OK) == 0) {
+            return strdup(candidate);
+        }
+        dir = end ? end + 1 : NULL;
+    }
+
+    return NULL;
+}
+
+char *
+msh_path_resolve(char *program)
+{
+    const char *path_env;
+    struct path_entry *e;
+    size_t idx;
+
+    if (program == NULL || program[0] == '\0') {
+        return NULL;
+    }
+    //paths are used as-is, just like execvp
+    if (strchr(program, '/') != NULL) {
+        return program;
+    }
+
+    path_env = msh_var_get("PATH", 4);
+    if (path_env == NULL) {
+        path_env = "/usr/local/bin:/bin:/usr/bin";
+    }
+    //a different PATH invalidates everything we know
+    if (cached_path_env == NULL || strcmp(cached_path_env, path_env) != 0) {
+        msh_path_flush();
+        cached_path_env = strdup(path_env);
+        if (cached_path_env == NULL) {
+            return NULL;
+        }
+    }
+
+    //direct-mapped: a colliding program simply replaces the entry
+    idx = hash_str(program) & (MSH_PATH_CACHE - 1);
+    e = &cache[idx];
+    if (e->program != NULL && strcmp(e->program, program) == 0) {
+        return e->path;
+    }
+
+    free(e->program);
+    free(e->path);
+    e->program = strdup(program);
+    e->path = e->program ? path_search(program, path_env) : NULL;
+
+    return e->path;
+}
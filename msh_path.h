@@ -0,0 +1,25 @@
+#pragma once
+
+/***
+ * Resolution of program names to executables through the `PATH`
+ * environment variable. Results are cached so that running the same
+ * program again (or the same pipeline many times) does not walk the
+ * `PATH` directories again.
+ */
+
+/**
+ * `msh_path_resolve` finds the executable that `execvp` would run for
+ * `program`.
+ *
+ * - `@program` - the program name from the command.
+ * - `@return` - the path of the executable, borrowed from the cache
+ *     (valid until `PATH` changes), `program` itself if it contains
+ *     a `/`, or `NULL` if it isn't found in `PATH`.
+ */
+char *msh_path_resolve(char *program);
+
+/**
+ * `msh_path_flush` forgets every cached resolution, e.g. after a
+ * program has been installed or removed.
+ */
+void msh_path_flush(void);
@@ -0,0 +1,402 @@
+#define _GNU_SOURCE
+
+#include <msh_prefetch.h>
+#include <msh_path.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <elf.h>
+#include <pthread.h>
+#include <signal.h>
+#include <limits.h>
+
+/* programs the model knows, must be a power of two */
+#define MSH_PREFETCH_PROGRAMS 1024
+/* programs predicted at once */
+#define MSH_PREFETCH_PREDICT  2
+/* paths waiting for the prefetcher */
+#define MSH_PREFETCH_QUEUE    16
+/* a file isn't prefetched again this soon (ns) */
+#define MSH_PREFETCH_AGAIN    (30 * 1000000000L)
+/* files remembered as recently prefetched, must be a power of two */
+#define MSH_PREFETCH_RECENT   256
+/* shared libraries are followed this deep */
+#define MSH_PREFETCH_DEPTH    2
+
+struct successor {
+    //index into programs, -1 if unused
+    int program;
+    unsigned long count;
+};
+
+struct program {
+    char name[MSH_PREFETCH_NAMELEN];
+    struct successor next[MSH_PREFETCH_SUCC];
+};
+
+//the model, only used by the shell's thread
+static struct program programs[MSH_PREFETCH_PROGRAMS];
+static size_t num_programs = 0;
+static int previous = -1;
+static int enabled = -1;
+
+//the programs the model predicted since the last one executed, the only ones graded
+static char predicted[MSH_PREFETCH_PREDICT][MSH_PREFETCH_NAMELEN];
+static size_t num_predicted = 0;
+//the program prefetched as it was typed, not a prediction
+static char typed[MSH_PREFETCH_NAMELEN];
+static unsigned long hits = 0, misses = 0, prefetched = 0;
+
+//paths queued for the prefetcher, guarded by lock
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static char *queue[MSH_PREFETCH_QUEUE];
+static size_t queue_len = 0;
+static int prefetcher_started = 0;
+
+//owned by the prefetcher
+static struct {
+    unsigned long hash;
+    long when;
+} recent[MSH_PREFETCH_RECENT];
+
+static long
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static unsigned long
+hash_str(const char *s)
+{
+    unsigned long h = 14695981039346656037UL;
+
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211UL;
+    }
+    return h;
+}
+
+static int
+is_enabled(void)
+{
+    if (enabled == -1) {
+        const char *env = getenv("MSH_PREFETCH");
+
+        enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return enabled;
+}
+
+void
+msh_prefetch_enable(int on)
+{
+    enabled = on;
+}
+
+//the index of a program in the model, added if new; -1 if it can't be
+static int
+program_index(const char *name)
+{
+    size_t slot = hash_str(name) & (MSH_PREFETCH_PROGRAMS - 1);
+
+    if (strlen(name) >= MSH_PREFETCH_NAMELEN) {
+        return -1;
+    }
+    while (programs[slot].name[0] != '\0') {
+        if (strcmp(programs[slot].name, name) == 0) {
+            return (int)slot;
+        }
+        slot = (slot + 1) & (MSH_PREFETCH_PROGRAMS - 1);
+    }
+    //keep probes short by never filling the table
+    if (num_programs * 4 >= MSH_PREFETCH_PROGRAMS * 3) {
+        return -1;
+    }
+    strcpy(programs[slot].name, name);
+    for (int i = 0; i < MSH_PREFETCH_SUCC; i++) {
+        programs[slot].next[i].program = -1;
+    }
+    num_programs++;
+
+    return (int)slot;
+}
+
+void
+msh_prefetch_learn(const char *program)
+{
+    int current = program_index(program);
+
+    if (previous != -1 && current != -1) {
+        struct successor *next = programs[previous].next, *least = &next[0];
+        int i;
+
+        for (i = 0; i < MSH_PREFETCH_SUCC && next[i].program != current; i++) {
+            if (next[i].count < least->count) {
+                least = &next[i];
+            }
+        }
+        if (i < MSH_PREFETCH_SUCC) {
+            next[i].count++;
+        } else {
+            //replace the rarest, inheriting its count so a newcomer can stay
+            least->program = current;
+            least->count++;
+        }
+    }
+    previous = current;
+}
+
+//read a NUL-terminated string at off into buf
+static int
+read_string(int fd, off_t off, char *buf, size_t sz)
+{
+    ssize_t n = pread(fd, buf, sz - 1, off);
+
+    if (n <= 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+    return strlen(buf) < (size_t)n ? 0 : -1;
+}
+
+static void prefetch_file(const char *path, int depth);
+
+//where the dynamic loader would find a library
+static void
+prefetch_library(const char *name, int depth)
+{
+    const char *dirs[] = { "/lib/x86_64-linux-gnu", "/usr/lib/x86_64-linux-gnu", "/lib/aarch64-linux-gnu",
+                           "/usr/lib/aarch64-linux-gnu", "/lib64", "/usr/lib64", "/lib", "/usr/lib" };
+    char path[PATH_MAX];
+
+    if (strchr(name, '/') != NULL) {
+        prefetch_file(name, depth);
+        return;
+    }
+    for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", dirs[i], name);
+        if (access(path, R_OK) == 0) {
+            prefetch_file(path, depth);
+            return;
+        }
+    }
+}
+
+//follow the DT_NEEDED entries of a 64-bit ELF file
+static void
+prefetch_needed(int fd, int depth)
+{
+    Elf64_Ehdr eh;
+    Elf64_Phdr ph[64];
+    Elf64_Dyn dyn[256];
+    Elf64_Addr strtab = 0;
+    off_t dyn_off = -1, str_off = -1;
+    size_t dyn_len = 0, num_ph;
+    ssize_t n;
+
+    if (pread(fd, &eh, sizeof(eh), 0) != sizeof(eh) || memcmp(eh.e_ident, ELFMAG, SELFMAG) != 0 ||
+        eh.e_ident[EI_CLASS] != ELFCLASS64 || eh.e_phentsize != sizeof(Elf64_Phdr)) {
+        return;
+    }
+    num_ph = eh.e_phnum < 64 ? eh.e_phnum : 64;
+    n = pread(fd, ph, num_ph * sizeof(Elf64_Phdr), (off_t)eh.e_phoff);
+    if (n != (ssize_t)(num_ph * sizeof(Elf64_Phdr))) {
+        return;
+    }
+    for (size_t i = 0; i < num_ph; i++) {
+        if (ph[i].p_type == PT_DYNAMIC) {
+            dyn_off = (off_t)ph[i].p_offset;
+            dyn_len = ph[i].p_filesz < sizeof(dyn) ? ph[i].p_filesz : sizeof(dyn);
+        }
+    }
+    if (dyn_off == -1 || pread(fd, dyn, dyn_len, dyn_off) != (ssize_t)dyn_len) {
+        return;
+    }
+    dyn_len /= sizeof(Elf64_Dyn);
+    for (size_t i = 0; i < dyn_len && dyn[i].d_tag != DT_NULL; i++) {
+        if (dyn[i].d_tag == DT_STRTAB) {
+            strtab = dyn[i].d_un.d_ptr;
+        }
+    }
+    //the string table is given as an address, find it in the file
+    for (size_t i = 0; i < num_ph; i++) {
+        if (ph[i].p_type == PT_LOAD && strtab >= ph[i].p_vaddr && strtab < ph[i].p_vaddr + ph[i].p_filesz) {
+            str_off = (off_t)(strtab - ph[i].p_vaddr + ph[i].p_offset);
+        }
+    }
+    if (str_off == -1) {
+        return;
+    }
+    for (size_t i = 0; i < dyn_len && dyn[i].d_tag != DT_NULL; i++) {
+        char name[256];
+
+        if (dyn[i].d_tag == DT_NEEDED && read_string(fd, str_off + (off_t)dyn[i].d_un.d_val, name, sizeof(name)) == 0) {
+            prefetch_library(name, depth + 1);
+        }
+    }
+}
+
+static void
+prefetch_file(const char *path, int depth)
+{
+    size_t slot = hash_str(path) & (MSH_PREFETCH_RECENT - 1);
+    long now = now_ns();
+    int fd;
+
+    //libc and friends are shared by everything, skip the repeats
+    if (recent[slot].hash == hash_str(path) && now - recent[slot].when < MSH_PREFETCH_AGAIN) {
+        return;
+    }
+    recent[slot].hash = hash_str(path);
+    recent[slot].when = now;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return;
+    }
+    //starts reading the whole file into the page cache, without waiting
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    if (depth < MSH_PREFETCH_DEPTH) {
+        prefetch_needed(fd, depth);
+    }
+    close(fd);
+}
+
+static void *
+prefetcher_thread(void *arg)
+{
+    (void)arg;
+
+    while (1) {
+        char *path;
+
+        pthread_mutex_lock(&lock);
+        while (queue_len == 0) {
+            pthread_cond_wait(&wake, &lock);
+        }
+        path = queue[--queue_len];
+        pthread_mutex_unlock(&lock);
+
+        prefetch_file(path, 0);
+        free(path);
+    }
+
+    return NULL;
+}
+
+//hand a program to the prefetcher, resolving it here as the path cache isn't shared
+static void
+queue_program(const char *program)
+{
+    char *path = msh_path_resolve((char *)program), *copy;
+
+    if (path == NULL || (copy = strdup(path)) == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&lock);
+    if (!prefetcher_started) {
+        pthread_t prefetcher;
+        pthread_attr_t attr;
+        sigset_t all, old;
+
+        //started on first use, the shell may never need it
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        //with every signal blocked, so none is handled on the prefetcher
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &old);
+        prefetcher_started = pthread_create(&prefetcher, &attr, prefetcher_thread, NULL) == 0 ? 1 : -1;
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+        pthread_attr_destroy(&attr);
+    }
+    if (prefetcher_started != 1 || queue_len == MSH_PREFETCH_QUEUE) {
+        free(copy);
+    } else {
+        queue[queue_len++] = copy;
+        prefetched++;
+        pthread_cond_signal(&wake);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+static int
+was_predicted(const char *program)
+{
+    for (size_t i = 0; i < num_predicted; i++) {
+        if (strcmp(predicted[i], program) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void
+msh_prefetch_program(const char *program)
+{
+    //each keystroke names it again, it's queued once
+    if (!is_enabled() || strlen(program) >= MSH_PREFETCH_NAMELEN || strcmp(typed, program) == 0 ||
+        was_predicted(program)) {
+        return;
+    }
+    strcpy(typed, program);
+    queue_program(program);
+}
+
+void
+msh_prefetch_observe(const char *program)
+{
+    int current;
+
+    if (!is_enabled()) {
+        return;
+    }
+    //only programs the model predicted something for count
+    if (num_predicted > 0) {
+        if (was_predicted(program)) hits++;
+        else misses++;
+        num_predicted = 0;
+    }
+    typed[0] = '\0';
+    msh_prefetch_learn(program);
+
+    //the most frequent successors, while this one runs
+    current = previous;
+    if (current == -1) {
+        return;
+    }
+    for (int k = 0; k < MSH_PREFETCH_PREDICT; k++) {
+        struct successor *best = NULL;
+
+        for (int i = 0; i < MSH_PREFETCH_SUCC; i++) {
+            struct successor *s = &programs[current].next[i];
+
+            if (s->program != -1 && !was_predicted(programs[s->program].name) &&
+                (best == NULL || s->count > best->count)) {
+                best = s;
+            }
+        }
+        if (best == NULL) {
+            break;
+        }
+        strcpy(predicted[num_predicted++], programs[best->program].name);
+        queue_program(programs[best->program].name);
+    }
+}
+
+void
+msh_prefetch_print(FILE *out)
+{
+    unsigned long total = hits + misses;
+
+    fprintf(out, "prefetch: %s, %lu programs prefetched, %lu/%lu predictions hit (%.1f%%)\n",
+            is_enabled() ? "on" : "off", prefetched, hits, total, total ? 100.0 * (double)hits / (double)total : 0.0);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdio.h>
+
+/***
+ * Speculative prefetching of the programs the user is likely to run
+ * next. The shell learns which program tends to follow which (a
+ * first-order model over the programs of every executed pipeline,
+ * seeded from the history), and after each pipeline it resolves the
+ * likely successors through `PATH`. A background thread then asks the
+ * kernel to read ahead each executable and the shared libraries it
+ * needs (its ELF `DT_NEEDED` entries), so that they are in the page
+ * cache by the time they are spawned.
+ */
+
+/* program names longer than this aren't learned */
+#define MSH_PREFETCH_NAMELEN 64
+/* how many successors are remembered per program */
+#define MSH_PREFETCH_SUCC    4
+
+/**
+ * `msh_prefetch_enable` turns prefetching on or off. It starts on,
+ * unless `MSH_PREFETCH=0` is set.
+ */
+void msh_prefetch_enable(int on);
+
+/**
+ * `msh_prefetch_learn` records that `program` ran after the previous
+ * one, without predicting anything, e.g. to replay the history.
+ */
+void msh_prefetch_learn(const char *program);
+
+/**
+ * `msh_prefetch_observe` is called with each program about to be
+ * executed, in order. It accounts whether the program was predicted,
+ * learns it, and prefetches its likely successors.
+ */
+void msh_prefetch_observe(const char *program);
+
+/**
+ * `msh_prefetch_program` prefetches a program that the user is
+ * probably about to run, e.g. the one being typed. It isn't a
+ * prediction of the model, so it doesn't count as a hit when it runs.
+ */
+void msh_prefetch_program(const char *program);
+
+/**
+ * `msh_prefetch_print` prints whether prefetching is on, and how
+ * often the predictions were right.
+ */
+void msh_prefetch_print(FILE *out);
@@ -0,0 +1,196 @@
+#define _DEFAULT_SOURCE
+
+#include <msh.h>
+#include <msh_parse.h>
+#include <msh_script.h>
+#include <msh_loop.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <signal.h>
+#include <errno.h>
+
+/* pipelines (or free slots) a waiting side is woken for */
+#define MSH_SCRIPT_BATCH 32
+/* the script is read in blocks of this many bytes */
+#define MSH_SCRIPT_BUFSZ (64 * 1024)
+
+//the queue between the reader and the shell
+struct stream {
+    FILE *f;
+    pthread_mutex_t lock;
+    //signalled when a pipeline is queued or the reader is done
+    pthread_cond_t more;
+    //signalled when the shell takes a pipeline
+    pthread_cond_t room;
+    struct msh_pipeline *queue[MSH_SCRIPT_QUEUE];
+    //pipelines queued so far, and taken so far
+    size_t head, tail;
+    //which side waits for the other
+    int shell_waiting, reader_waiting;
+    //the reader is done, err is why it stopped
+    int done;
+    msh_err_t err;
+    //errno of a failed read, 0 if the script was read to its end
+    int read_err;
+};
+
+/*
+ * A waiting side is only woken once there's a batch of work (or room)
+ * for it, rather than for every pipeline, so that on a single CPU the
+ * two threads take turns a batch at a time. The very first pipeline
+ * wakes the shell right away.
+ */
+static void
+stream_push(struct stream *st, struct msh_pipeline *p)
+{
+    pthread_mutex_lock(&st->lock);
+    while (st->head - st->tail == MSH_SCRIPT_QUEUE) {
+        st->reader_waiting = 1;
+        pthread_cond_wait(&st->room, &st->lock);
+    }
+    st->reader_waiting = 0;
+    st->queue[st->head++ % MSH_SCRIPT_QUEUE] = p;
+    if (st->shell_waiting && (st->head == 1 || st->head - st->tail >= MSH_SCRIPT_BATCH)) {
+        pthread_cond_signal(&st->more);
+    }
+    pthread_mutex_unlock(&st->lock);
+}
+
+//the next pipeline to run, NULL once the reader is done and it's all run
+static struct msh_pipeline *
+stream_pop(struct stream *st)
+{
+    struct msh_pipeline *p = NULL;
+
+    pthread_mutex_lock(&st->lock);
+    while (st->head == st->tail && !st->done) {
+        st->shell_waiting = 1;
+        pthread_cond_wait(&st->more, &st->lock);
+    }
+    st->shell_waiting = 0;
+    if (st->head != st->tail) {
+        p = st->queue[st->tail++ % MSH_SCRIPT_QUEUE];
+        if (st->reader_waiting && st->head - st->tail <= MSH_SCRIPT_QUEUE - MSH_SCRIPT_BATCH) {
+            pthread_cond_signal(&st->room);
+        }
+    }
+    pthread_mutex_unlock(&st->lock);
+
+    return p;
+}
+
+/*
+ * Parse the script into the queue. The pipelines come from malloc,
+ * rather than a pool, as the shell frees them (and bench shifts their
+ * commands) on its own thread.
+ */
+static void *
+reader_thread(void *arg)
+{
+    struct stream *st = arg;
+    struct msh_sequence *seq = msh_sequence_alloc();
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    msh_err_t err = seq == NULL ? MSH_ERR_NOMEM : 0;
+
+    while (err == 0 && (len = getline(&line, &cap, st->f)) != -1) {
+        struct msh_pipeline *p;
+        char *start = line;
+
+        if (len > 0 && line[len - 1] == '\n') {
+            line[len - 1] = '\0';
+        }
+        while (isspace((unsigned char)*start)) {
+            start++;
+        }
+        if (*start == '\0' || *start == '#') {
+            continue;
+        }
+        err = msh_sequence_parse(line, seq);
+        //a here-document's body is the lines after it, whatever they hold
+        while (err == 0 && msh_sequence_heredoc(seq) != NULL) {
+            if ((len = getline(&line, &cap, st->f)) == -1) {
+                err = MSH_ERR_UNTERMINATED_HEREDOC;
+                break;
+            }
+            if (len > 0 && line[len - 1] == '\n') {
+                line[len - 1] = '\0';
+            }
+            err = msh_sequence_heredoc_line(seq, line);
+        }
+        //a line runs all of its pipelines, or none of them
+        while ((p = msh_sequence_pipeline(seq)) != NULL) {
+            if (err == 0) {
+                stream_push(st, p);
+            } else {
+                msh_pipeline_free(p);
+            }
+        }
+    }
+    free(line);
+    msh_sequence_free(seq);
+
+    pthread_mutex_lock(&st->lock);
+    st->done = 1;
+    st->err = err;
+    st->read_err = ferror(st->f) ? errno : 0;
+    pthread_cond_signal(&st->more);
+    pthread_mutex_unlock(&st->lock);
+
+    return NULL;
+}
+
+int
+msh_script_run(const char *path)
+{
+    struct stream st = { .lock = PTHREAD_MUTEX_INITIALIZER, .more = PTHREAD_COND_INITIALIZER,
+                         .room = PTHREAD_COND_INITIALIZER };
+    struct msh_pipeline *p;
+    pthread_t reader;
+    sigset_t all, old;
+    int ret;
+
+    st.f = fopen(path, "r");
+    if (st.f == NULL) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+    setvbuf(st.f, NULL, _IOFBF, MSH_SCRIPT_BUFSZ);
+
+    //cntrl-c and cntrl-z must interrupt the shell's waits, not the reader
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    ret = pthread_create(&reader, NULL, reader_thread, &st);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret != 0) {
+        fclose(st.f);
+        fprintf(stderr, "msh: %s: cannot start the script reader\n", path);
+        return EXIT_FAILURE;
+    }
+
+    while ((p = stream_pop(&st)) != NULL) {
+        msh_loop_run(p);
+    }
+    pthread_join(reader, NULL);
+    fclose(st.f);
+
+    if (msh_loop_finish() != 0 && st.err == 0) {
+        return EXIT_FAILURE;
+    }
+    if (st.err != 0) {
+        printf("MSH Error: %s\n", msh_pipeline_err2str(st.err));
+        return EXIT_FAILURE;
+    }
+    if (st.read_err != 0) {
+        errno = st.read_err;
+        perror(path);
+        return EXIT_FAILURE;
+    }
+
+    return 0;
+}
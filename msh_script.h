@@ -0,0 +1,26 @@
+#pragma once
+
+/***
+ * Scripts (`msh FILE`) are streamed: a reader thread reads and parses
+ * the script a line at a time, and hands the parsed pipelines to the
+ * shell through a bounded queue. The first pipeline runs as soon as
+ * its line is parsed, however long the script is, and since the reader
+ * waits whenever the queue is full, a script takes the same memory
+ * whatever its size.
+ */
+
+/* parsed pipelines the reader may get ahead of the shell by */
+#define MSH_SCRIPT_QUEUE 64
+
+/**
+ * `msh_script_run` runs the script at `path`, one sequence per line.
+ * Blank lines and lines starting with `#` are skipped. A line that
+ * doesn't parse stops the script: the lines before it are run, it and
+ * the ones after aren't.
+ *
+ * - `@path` - the script.
+ * - `@return` - `0` once the whole script ran, or `EXIT_FAILURE` if a
+ *     line didn't parse (its error is printed) or the script couldn't be
+ *     read.
+ */
+int msh_script_run(const char *path);
@@ -0,0 +1,120 @@
+#define _GNU_SOURCE
+
+#include <msh_shm.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+static struct msh_shm *region = NULL;
+static char region_name[32];
+
+int
+msh_shm_open(void)
+{
+    int fd;
+
+    snprintf(region_name, sizeof(region_name), MSH_SHM_PREFIX "%d", (int)getpid());
+    fd = shm_open(region_name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(struct msh_shm)) == -1) {
+        close(fd);
+        shm_unlink(region_name);
+        return -1;
+    }
+    region = mmap(NULL, sizeof(struct msh_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        region = NULL;
+        shm_unlink(region_name);
+        return -1;
+    }
+
+    //the fresh mapping is zeroed, so every slot is free with an even seq
+    region->version = MSH_SHM_VERSION;
+    region->shell_pid = (int32_t)getpid();
+    region->num_jobs = MSH_MAXJOBS;
+    //publish the magic last, readers ignore the region until it's set
+    __atomic_store_n(&region->magic, MSH_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+void
+msh_shm_publish(size_t slot, int state, int64_t start_ns, pid_t *pids, size_t n, const char *input)
+{
+    struct msh_shm_job *job;
+
+    if (region == NULL || slot >= MSH_MAXJOBS) {
+        return;
+    }
+    job = &region->jobs[slot];
+
+    //odd seq: readers will retry until we're done
+    __atomic_store_n(&job->seq, job->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    job->state = state;
+    job->start_ns = start_ns;
+    job->num_stages = (uint32_t)n;
+    for (size_t i = 0; i < n && i < MSH_MAXCMNDS; i++) {
+        job->pids[i] = (int32_t)pids[i];
+    }
+    strncpy(job->input, input != NULL ? input : "", MSH_SHM_INPUTLEN - 1);
+    job->input[MSH_SHM_INPUTLEN - 1] = '\0';
+
+    __atomic_store_n(&job->seq, job->seq + 1, __ATOMIC_RELEASE);
+}
+
+void
+msh_shm_read(struct msh_shm_job *src, struct msh_shm_job *dst)
+{
+    uint32_t before, after;
+
+    do {
+        //wait out a writer
+        while ((before = __atomic_load_n(&src->seq, __ATOMIC_ACQUIRE)) & 1) {
+            continue;
+        }
+        memcpy(dst, src, sizeof(*dst));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&src->seq, __ATOMIC_RELAXED);
+    } while (before != after);
+
+    dst->input[MSH_SHM_INPUTLEN - 1] = '\0';
+    if (dst->num_stages > MSH_MAXCMNDS) {
+        dst->num_stages = MSH_MAXCMNDS;
+    }
+}
+
+void
+msh_shm_forget(void)
+{
+    if (region == NULL) {
+        return;
+    }
+    munmap(region, sizeof(struct msh_shm));
+    region = NULL;
+}
+
+void
+msh_shm_close(void)
+{
+    if (region == NULL) {
+        return;
+    }
+    //a reader may keep the region mapped after it is removed: leave it no jobs, and no magic
+    for (size_t i = 0; i < MSH_MAXJOBS; i++) {
+        if (region->jobs[i].state != MSH_SHM_FREE) {
+            msh_shm_publish(i, MSH_SHM_FREE, 0, NULL, 0, NULL);
+        }
+    }
+    __atomic_store_n(&region->magic, 0, __ATOMIC_RELEASE);
+    munmap(region, sizeof(struct msh_shm));
+    shm_unlink(region_name);
+    region = NULL;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <msh.h>
+
+/***
+ * The shell's job table, published in a shared memory region
+ * (`/dev/shm/msh.<pid>`) so that `tools/mshtop` can watch running
+ * shells. Each job slot is protected by a seqlock: the shell makes
+ * `seq` odd while it updates the slot, and readers retry until they
+ * copy the slot with the same, even, `seq` before and after. Readers
+ * thus never block the shell, and never need a system call.
+ */
+
+#define MSH_SHM_PREFIX   "/msh."
+#define MSH_SHM_MAGIC    0x6d73686aU
+#define MSH_SHM_VERSION  1
+#define MSH_SHM_INPUTLEN 128
+
+enum msh_shm_state {
+    MSH_SHM_FREE = 0,
+    MSH_SHM_FOREGROUND,
+    MSH_SHM_BACKGROUND,
+    MSH_SHM_STOPPED,
+};
+
+struct msh_shm_job {
+    uint32_t seq;
+    //an msh_shm_state
+    int32_t state;
+    //CLOCK_REALTIME nanoseconds
+    int64_t start_ns;
+    uint32_t num_stages;
+    int32_t pids[MSH_MAXCMNDS];
+    char input[MSH_SHM_INPUTLEN];
+};
+
+struct msh_shm {
+    uint32_t magic;
+    uint32_t version;
+    int32_t shell_pid;
+    uint32_t num_jobs;
+    struct msh_shm_job jobs[MSH_MAXJOBS];
+};
+
+/**
+ * `msh_shm_open` creates and maps this shell's region.
+ *
+ * - `@return` - `0` on success, `-1` (with `errno` set) otherwise.
+ */
+int msh_shm_open(void);
+
+/**
+ * `msh_shm_publish` updates job slot `slot`. Does nothing if the
+ * region isn't open.
+ *
+ * - `@slot` - the job's index in the shell's job table.
+ * - `@state` - an `msh_shm_state`, `MSH_SHM_FREE` clears the slot.
+ * - `@start_ns` - when the job started (`CLOCK_REALTIME`).
+ * - `@pids` - the job's processes, `n` of them.
+ * - `@input` - the pipeline's input, truncated to fit.
+ */
+void msh_shm_publish(size_t slot, int state, int64_t start_ns, pid_t *pids, size_t n, const char *input);
+
+/**
+ * `msh_shm_read` copies a consistent snapshot of `src` into `dst`,
+ * retrying while the shell is updating it.
+ */
+void msh_shm_read(struct msh_shm_job *src, struct msh_shm_job *dst);
+
+/**
+ * `msh_shm_forget` unmaps the region without removing it or clearing
+ * its jobs, in a child of the shell that doesn't own it.
+ */
+void msh_shm_forget(void);
+
+/**
+ * `msh_shm_close` unmaps and removes this shell's region. Its jobs and
+ * its magic are cleared first, so a reader that still maps it knows
+ * the shell has exited.
+ */
+void msh_shm_close(void);
@@ -0,0 +1,225 @@
+#define _GNU_SOURCE
+
+#include <msh_split.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/* left for what the kernel puts beside the arguments, as xargs does */
+#define MSH_SPLIT_HEADROOM 2048
+
+extern char **environ;
+
+//the invocations, in order
+struct chunk {
+    //its arguments are up to here
+    size_t end;
+    pid_t pid;
+    //its output, when several run at a time
+    int fd;
+    int status;
+    int done;
+};
+
+//what the SIGTERM ending the command has to pass on
+static struct chunk *chunks;
+static size_t num_chunks;
+
+//the bytes n strings take on the new program's stack
+static size_t
+strings_size(char **strs, size_t n)
+{
+    size_t size = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        size += strlen(strs[i]) + 1 + sizeof(char *);
+    }
+    return size;
+}
+
+static size_t
+count(char **strs)
+{
+    size_t n = 0;
+
+    while (strs != NULL && strs[n] != NULL) {
+        n++;
+    }
+    return n;
+}
+
+size_t
+msh_split_limit(char **env, size_t size)
+{
+    long max = sysconf(_SC_ARG_MAX);
+    size_t used = strings_size(env, count(env)) + sizeof(char *) + MSH_SPLIT_HEADROOM;
+    size_t limit;
+
+    if (max <= 0) {
+        max = _POSIX_ARG_MAX;
+    }
+    limit = (size_t)max > used ? (size_t)max - used : 0;
+
+    return size > 0 && size < limit ? size : limit;
+}
+
+int
+msh_split_needed(char **argv, size_t limit)
+{
+    return strings_size(argv, count(argv)) + sizeof(char *) > limit;
+}
+
+static void
+split_term(int sig)
+{
+    for (size_t i = 0; i < num_chunks; i++) {
+        if (chunks[i].pid > 0) {
+            kill(chunks[i].pid, sig);
+        }
+    }
+    _exit(128 + sig);
+}
+
+static pid_t
+launch(const char *path, char **argv, char **env, int out)
+{
+    pid_t pid = fork();
+
+    if (pid != 0) {
+        return pid;
+    }
+    if (out != -1 && dup2(out, STDOUT_FILENO) == -1) {
+        _exit(126);
+    }
+    if (path != NULL) {
+        execve(path, argv, env);
+    }
+    environ = env;
+    execvp(argv[0], argv);
+    perror(argv[0]);
+    _exit(errno == ENOENT ? 127 : 126);
+}
+
+//pass on everything an invocation wrote
+static void
+pass_on(int fd)
+{
+    struct stat st;
+    off_t off = 0;
+
+    if (fstat(fd, &st) != 0) {
+        return;
+    }
+    while (off < st.st_size) {
+        ssize_t n = sendfile(STDOUT_FILENO, fd, &off, (size_t)(st.st_size - off));
+
+        //not to a file opened for appending, copied through a buffer then
+        if (n == -1 && errno == EINVAL) {
+            char buf[65536];
+
+            while ((n = pread(fd, buf, sizeof(buf), off)) > 0 && write(STDOUT_FILENO, buf, (size_t)n) == n) {
+                off += n;
+            }
+        }
+        if (n <= 0) {
+            if (n == -1) {
+                perror("msh: split output");
+            }
+            return;
+        }
+    }
+}
+
+static int
+exit_code(int status)
+{
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+int
+msh_split_run(const char *path, char **argv, size_t fixed, char **env, size_t limit, size_t fanout)
+{
+    size_t n = count(argv), base, next = 0, out = 0, active = 0;
+    char **cargv;
+    int ret = 0;
+
+    if (fixed == 0 || fixed >= n || fanout == 0) {
+        fixed = fixed == 0 || fixed > n ? n : fixed;
+        fanout = 1;
+    }
+    base = strings_size(argv, fixed) + sizeof(char *);
+    chunks = calloc(n - fixed + 1, sizeof(struct chunk));
+    cargv = malloc((n + 1) * sizeof(char *));
+    if (chunks == NULL || cargv == NULL) {
+        fprintf(stderr, "msh: %s: out of memory\n", argv[0]);
+        return 126;
+    }
+    //as many arguments as fit, but at least one
+    for (size_t i = fixed; i < n || num_chunks == 0;) {
+        size_t size = base, start = i;
+
+        while (i < n && (i == start || size + strlen(argv[i]) + 1 + sizeof(char *) <= limit)) {
+            size += strlen(argv[i++]) + 1 + sizeof(char *);
+        }
+        chunks[num_chunks++] = (struct chunk) { .end = i, .fd = -1 };
+    }
+    signal(SIGTERM, split_term);
+    signal(SIGINT, SIG_DFL);
+    memcpy(cargv, argv, fixed * sizeof(char *));
+
+    while (out < num_chunks) {
+        int status;
+        pid_t pid;
+
+        while (active < fanout && next < num_chunks) {
+            struct chunk *c = &chunks[next];
+            size_t start = next > 0 ? chunks[next - 1].end : fixed;
+
+            memcpy(cargv + fixed, argv + start, (c->end - start) * sizeof(char *));
+            cargv[fixed + c->end - start] = NULL;
+            if (fanout > 1 && (c->fd = memfd_create("msh-split", MFD_CLOEXEC)) == -1) {
+                perror("msh: split");
+            }
+            c->pid = fanout > 1 && c->fd == -1 ? -1 : launch(path, cargv, env, c->fd);
+            if (c->pid == -1) {
+                c->status = 126 << 8;
+                c->done = 1;
+            } else {
+                active++;
+            }
+            next++;
+        }
+        //reap one, then pass on the outputs that are next in order
+        pid = waitpid(-1, &status, 0);
+        if (pid == -1 && errno == EINTR) {
+            continue;
+        }
+        for (size_t i = out; pid > 0 && i < next; i++) {
+            if (chunks[i].pid == pid) {
+                chunks[i] = (struct chunk) { .end = chunks[i].end, .fd = chunks[i].fd, .status = status, .done = 1 };
+                active--;
+            }
+        }
+        for (; out < next && (chunks[out].done || pid == -1); out++) {
+            if (chunks[out].fd != -1) {
+                pass_on(chunks[out].fd);
+                close(chunks[out].fd);
+            }
+            if (ret == 0) {
+                ret = pid == -1 && !chunks[out].done ? 126 : exit_code(chunks[out].status);
+            }
+        }
+    }
+    free(cargv);
+
+    return ret;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+
+/***
+ * Splitting commands whose arguments don't fit in one `execve`, the
+ * way `xargs` does. It is opt-in: with `MSH_SPLIT=N` set (as a shell
+ * variable or in the environment), a command whose arguments and
+ * environment are over `ARG_MAX` is run as several invocations, `N` of
+ * them at a time. Each gets the arguments before the command's first
+ * pattern (or just its program, without one), and as many of the rest
+ * as fit. `MSH_SPLIT_SIZE` lowers how many bytes of arguments an
+ * invocation gets, like `xargs -s`.
+ *
+ * The invocations' standard outputs are concatenated in order into the
+ * command's own, whether that is a pipe, a file, or the terminal: one
+ * at a time they write to it directly, and several at a time each
+ * writes to a memory file passed on with `sendfile` once every earlier
+ * one is done.
+ */
+
+/**
+ * `msh_split_limit` returns how many bytes of arguments (counting
+ * their pointers and terminating `NULL`) a program can get.
+ *
+ * - `@env` - the environment the program will get.
+ * - `@size` - the most to allow, `0` for no more than `ARG_MAX` does.
+ */
+size_t msh_split_limit(char **env, size_t size);
+
+/**
+ * `msh_split_needed` tells if the arguments are over the limit.
+ *
+ * - `@argv` - the `NULL`-terminated arguments.
+ * - `@limit` - from `msh_split_limit`.
+ */
+int msh_split_needed(char **argv, size_t limit);
+
+/**
+ * `msh_split_run` runs the command as several invocations, from a
+ * forked child whose redirections are in place, and waits for them.
+ *
+ * - `@path` - the program, resolved, or `NULL` to look for `argv[0]`.
+ * - `@argv` - the `NULL`-terminated arguments.
+ * - `@fixed` - how many of the first arguments each invocation gets.
+ * - `@env` - the environment.
+ * - `@limit` - from `msh_split_limit`.
+ * - `@fanout` - how many invocations run at a time.
+ * - `@return` - the exit status: `0`, or the first invocation's (in
+ *     order) that failed.
+ */
+int msh_split_run(const char *path, char **argv, size_t fixed, char **env, size_t limit, size_t fanout);
@@ -0,0 +1,132 @@
+#include <msh_stats.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+static struct msh_stat table[MSH_STATS_MAX];
+static size_t used = 0;
+//shared by programs that arrive once the table is mostly full
+static struct msh_stat other = { .program = "(other)" };
+
+//FNV-1a over the (truncated) name
+static size_t
+hash_name(const char *s)
+{
+    unsigned long h = 14695981039346656037UL;
+
+    for (size_t i = 0; s[i] != '\0' && i < MSH_STATS_NAMELEN - 1; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211UL;
+    }
+    return (size_t)h;
+}
+
+struct msh_stat *
+msh_stats_lookup(const char *program)
+{
+    size_t idx = hash_name(program) & (MSH_STATS_MAX - 1);
+
+    //linear probing, the load factor is capped at 3/4
+    while (table[idx].program[0] != '\0') {
+        if (strncmp(table[idx].program, program, MSH_STATS_NAMELEN - 1) == 0) {
+            return &table[idx];
+        }
+        idx = (idx + 1) & (MSH_STATS_MAX - 1);
+    }
+    if (used >= MSH_STATS_MAX / 4 * 3) {
+        return &other;
+    }
+
+    strncpy(table[idx].program, program, MSH_STATS_NAMELEN - 1);
+    used++;
+
+    return &table[idx];
+}
+
+void
+msh_stats_record(struct msh_stat *s, long wall_ns, struct rusage *ru, int status)
+{
+    s->calls++;
+    s->total_ns += wall_ns;
+    if (wall_ns > s->max_ns) s->max_ns = wall_ns;
+    if (ru != NULL) {
+        s->cpu_ns += (ru->ru_utime.tv_sec + ru->ru_stime.tv_sec) * 1000000000L
+            + (ru->ru_utime.tv_usec + ru->ru_stime.tv_usec) * 1000L;
+    }
+    //a non-zero exit or death by a signal are both failures
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        s->failures++;
+    }
+}
+
+void
+msh_stats_skip(struct msh_stat *s)
+{
+    s->skipped++;
+}
+
+static int
+cmp_total(const void *a, const void *b)
+{
+    const struct msh_stat *x = *(struct msh_stat * const *)a;
+    const struct msh_stat *y = *(struct msh_stat * const *)b;
+
+    return (y->total_ns > x->total_ns) - (y->total_ns < x->total_ns);
+}
+
+//every non-empty entry, largest total first
+static size_t
+sorted_entries(struct msh_stat **out)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < MSH_STATS_MAX; i++) {
+        if (table[i].calls > 0 || table[i].skipped > 0) {
+            out[n++] = &table[i];
+        }
+    }
+    if (other.calls > 0 || other.skipped > 0) {
+        out[n++] = &other;
+    }
+    qsort(out, n, sizeof(struct msh_stat *), cmp_total);
+
+    return n;
+}
+
+void
+msh_stats_print(FILE *out, size_t n)
+{
+    static struct msh_stat *entries[MSH_STATS_MAX + 1];
+    size_t total = sorted_entries(entries);
+
+    fprintf(out, "%-20s %8s %12s %12s %12s %8s %8s\n", "program", "calls", "total(ms)", "max(ms)", "cpu(ms)",
+            "failed", "skipped");
+    for (size_t i = 0; i < total && i < n; i++) {
+        struct msh_stat *s = entries[i];
+
+        fprintf(out, "%-20.20s %8lu %12.1f %12.1f %12.1f %8lu %8lu\n", s->program, s->calls,
+                s->total_ns / 1e6, s->max_ns / 1e6, s->cpu_ns / 1e6, s->failures, s->skipped);
+    }
+}
+
+int
+msh_stats_dump(const char *path)
+{
+    static struct msh_stat *entries[MSH_STATS_MAX + 1];
+    size_t total = sorted_entries(entries);
+    FILE *f = fopen(path, "w");
+
+    if (f == NULL) {
+        return -1;
+    }
+    fprintf(f, "program\tcalls\ttotal_ns\tmax_ns\tcpu_ns\tfailures\tskipped\n");
+    for (size_t i = 0; i < total; i++) {
+        struct msh_stat *s = entries[i];
+
+        fprintf(f, "%s\t%lu\t%ld\t%ld\t%ld\t%lu\t%lu\n", s->program, s->calls,
+                s->total_ns, s->max_ns, s->cpu_ns, s->failures, s->skipped);
+    }
+
+    return fclose(f);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdio.h>
+#include <sys/resource.h>
+
+/***
+ * Session-wide statistics per program: how often it ran, how long it
+ * took (wall and CPU time), how often it failed, and how often it was
+ * skipped (by `update`) as its output was up to date. The table has a
+ * fixed size, so a long-lived shell uses bounded memory; once it is
+ * mostly full, new programs are accounted to a shared "(other)" entry.
+ */
+
+/* number of slots in the table, must be a power of two */
+#define MSH_STATS_MAX     512
+/* program names longer than this are truncated */
+#define MSH_STATS_NAMELEN 64
+
+struct msh_stat {
+    char program[MSH_STATS_NAMELEN];
+    unsigned long calls;
+    unsigned long failures;
+    long total_ns;
+    long max_ns;
+    long cpu_ns;
+    unsigned long skipped;
+};
+
+/**
+ * `msh_stats_lookup` finds (or creates) the entry for `program`. Call
+ * it when the program is started, so that recording its completion
+ * is a constant-time update of the returned entry.
+ *
+ * - `@program` - the program name, as typed in the command.
+ * - `@return` - the entry, borrowed from the table. Never `NULL`.
+ */
+struct msh_stat *msh_stats_lookup(const char *program);
+
+/**
+ * `msh_stats_record` accounts one completed run of a program.
+ *
+ * - `@s` - the entry returned by `msh_stats_lookup` at start.
+ * - `@wall_ns` - the wall-clock time between start and reap.
+ * - `@ru` - the resource usage of the reaped child.
+ * - `@status` - the `wait` status of the child.
+ */
+void msh_stats_record(struct msh_stat *s, long wall_ns, struct rusage *ru, int status);
+
+/**
+ * `msh_stats_skip` accounts a run of a program that was skipped, its
+ * output being up to date.
+ *
+ * - `@s` - the program's entry, from `msh_stats_lookup`.
+ */
+void msh_stats_skip(struct msh_stat *s);
+
+/**
+ * `msh_stats_print` prints the `n` programs with the largest total
+ * wall time, as done by the `stats` builtin.
+ */
+void msh_stats_print(FILE *out, size_t n);
+
+/**
+ * `msh_stats_dump` writes every entry to `path`, one tab-separated
+ * line per program.
+ *
+ * - `@return` - `0` on success, `-1` (with `errno` set) otherwise.
+ */
+int msh_stats_dump(const char *path);
@@ -0,0 +1,216 @@
+#define _GNU_SOURCE
+
+#include <msh.h>
+#include <msh_parse.h>
+#include <msh_subst.h>
+#include <msh_var.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+//the output of the substitutions at one depth
+struct capture {
+    int open;
+    int fd;
+    //the output read back, grown by doubling
+    char *buf;
+    size_t cap;
+    struct msh_sequence *seq;
+};
+
+static struct capture captures[MSH_SUBST_DEPTH];
+static size_t depth = 0;
+
+static int
+capture_open(struct capture *c)
+{
+    if (c->open) {
+        return 0;
+    }
+    c->fd = memfd_create("msh-subst", MFD_CLOEXEC);
+    if (c->fd == -1) {
+        perror("msh: substitution");
+        return -1;
+    }
+    c->seq = msh_sequence_alloc();
+    if (c->seq == NULL) {
+        close(c->fd);
+        fprintf(stderr, "msh: substitution: out of memory\n");
+        return -1;
+    }
+    c->open = 1;
+
+    return 0;
+}
+
+//read back what the pipelines wrote, without the trailing newlines
+static const char *
+capture_read(struct capture *c)
+{
+    struct stat st;
+    size_t got = 0;
+
+    if (fstat(c->fd, &st) != 0) {
+        perror("msh: substitution");
+        return "";
+    }
+    if ((size_t)st.st_size + 1 > c->cap) {
+        size_t cap = c->cap ? c->cap : 256;
+        char *grown;
+
+        while (cap < (size_t)st.st_size + 1) {
+            cap *= 2;
+        }
+        grown = realloc(c->buf, cap);
+        if (grown == NULL) {
+            fprintf(stderr, "msh: substitution: out of memory\n");
+            return "";
+        }
+        c->buf = grown;
+        c->cap = cap;
+    }
+    while (got < (size_t)st.st_size) {
+        ssize_t r = pread(c->fd, c->buf + got, (size_t)st.st_size - got, (off_t)got);
+
+        if (r <= 0) {
+            break;
+        }
+        got += (size_t)r;
+    }
+    while (got > 0 && c->buf[got - 1] == '\n') {
+        got--;
+    }
+    c->buf[got] = '\0';
+
+    return c->buf;
+}
+
+//the builtins that only print, and can run in the shell itself
+static const char *quiet_builtins[] = { "echo", "pwd", "history", "stats", "jobs", NULL };
+
+//whether the pipeline starts with a builtin that changes the shell (cd, exit, NAME=value...)
+static int
+changes_shell(struct msh_pipeline *p)
+{
+    struct msh_command *c = msh_pipeline_command(p, 0);
+    char **args = c != NULL ? msh_command_args(c) : NULL;
+    size_t i = 0;
+
+    if (args == NULL) {
+        return 0;
+    }
+    while (args[i] != NULL && msh_var_assignment(args[i]) > 0) {
+        i++;
+    }
+    //nothing but assignments sets the variables
+    if (args[i] == NULL) {
+        return 1;
+    }
+    for (size_t j = 0; quiet_builtins[j] != NULL; j++) {
+        if (strcmp(quiet_builtins[j], args[i]) == 0) {
+            return 0;
+        }
+    }
+    for (size_t j = 0; msh_builtin_names[j] != NULL; j++) {
+        if (strcmp(msh_builtin_names[j], args[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//run the pipeline in a child, so that what it changes is gone with it
+static void
+execute_apart(struct msh_pipeline *p)
+{
+    int status;
+    pid_t pid;
+
+    fflush(stdout);
+    fflush(stderr);
+    pid = fork();
+    if (pid == -1) {
+        perror("msh: substitution");
+        return;
+    }
+    if (pid == 0) {
+        msh_forked();
+        msh_execute(p);
+        fflush(stdout);
+        _exit(msh_status());
+    }
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR) {
+        continue;
+    }
+}
+
+const char *
+msh_subst_run(const char *pipeline, size_t len, msh_lookup_fn_t lookup, void *data)
+{
+    struct capture *c;
+    struct msh_pipeline *p;
+    msh_err_t err;
+    char *line;
+    int saved;
+
+    if (depth == MSH_SUBST_DEPTH) {
+        fprintf(stderr, "msh: substitutions nested more than %d deep\n", MSH_SUBST_DEPTH);
+        return "";
+    }
+    c = &captures[depth];
+    if (capture_open(c) != 0) {
+        return "";
+    }
+    line = strndup(pipeline, len);
+    if (line == NULL) {
+        fprintf(stderr, "msh: substitution: out of memory\n");
+        return "";
+    }
+    err = msh_sequence_parse(line, c->seq);
+    free(line);
+    if (err != 0) {
+        fprintf(stderr, "msh: $(%.*s): %s\n", (int)len, pipeline, msh_pipeline_err2str(err));
+        return "";
+    }
+
+    //the pipelines (and their children) write to the memory file, from its start
+    fflush(stdout);
+    saved = dup(STDOUT_FILENO);
+    if (saved == -1 || ftruncate(c->fd, 0) != 0 || lseek(c->fd, 0, SEEK_SET) != 0 ||
+        dup2(c->fd, STDOUT_FILENO) == -1) {
+        perror("msh: substitution");
+        while ((p = msh_sequence_pipeline(c->seq)) != NULL) {
+            msh_pipeline_free(p);
+        }
+        if (saved != -1) {
+            close(saved);
+        }
+        return "";
+    }
+    depth++;
+    while ((p = msh_sequence_pipeline(c->seq)) != NULL) {
+        //a substitution in here runs one level deeper, before this pipeline does
+        if (msh_pipeline_expand(p, lookup, data) != 0) {
+            msh_pipeline_free(p);
+            continue;
+        }
+        if (changes_shell(p)) {
+            execute_apart(p);
+        } else {
+            msh_execute(p);
+        }
+        msh_pipeline_free(p);
+    }
+    depth--;
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    return capture_read(c);
+}
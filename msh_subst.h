@@ -0,0 +1,30 @@
+#pragma once
+
+#include <msh_parse.h>
+
+/***
+ * Command substitution, `$(PIPELINE)`: the pipelines are run with
+ * their standard output captured, and the output (without its trailing
+ * newlines) is the value. The output goes to a memory file kept for
+ * each level of nesting, so capturing never blocks on a full pipe and
+ * costs no more than a few system calls. The builtins that only print
+ * (e.g. `pwd` or `echo`) run in the shell itself, without a fork; the
+ * others (e.g. `cd`, `exit`, or an assignment) run in a child, so that
+ * they don't change the shell.
+ */
+
+/* substitutions nest this deep at most */
+#define MSH_SUBST_DEPTH 8
+
+/**
+ * `msh_subst_run` runs the sequence `pipeline` and captures its output.
+ *
+ * - `@pipeline` - the text between the parentheses, not necessarily
+ *     `'\0'` terminated.
+ * - `@len` - its length.
+ * - `@lookup` - expands the variables of its pipelines.
+ * - `@data` - passed to `lookup`.
+ * - `@return` - the output, borrowed until the next substitution at
+ *     the same depth, or `""` if it couldn't be run (which is reported).
+ */
+const char *msh_subst_run(const char *pipeline, size_t len, msh_lookup_fn_t lookup, void *data);
@@ -0,0 +1,227 @@
+#define _GNU_SOURCE
+
+#include <msh_timeout.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+//a min-heap on the deadlines
+static struct msh_timeout *heap[MSH_TIMEOUT_MAX];
+static size_t num_pending = 0;
+static msh_timeout_fn_t on_expiry = NULL;
+
+static long
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void
+place(size_t i, struct msh_timeout *t)
+{
+    heap[i] = t;
+    t->slot = i + 1;
+}
+
+static void
+sift_up(size_t i)
+{
+    struct msh_timeout *t = heap[i];
+
+    while (i > 0 && heap[(i - 1) / 2]->deadline_ns > t->deadline_ns) {
+        place(i, heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    place(i, t);
+}
+
+static void
+sift_down(size_t i)
+{
+    struct msh_timeout *t = heap[i];
+
+    for (;;) {
+        size_t child = 2 * i + 1;
+
+        if (child >= num_pending) {
+            break;
+        }
+        if (child + 1 < num_pending && heap[child + 1]->deadline_ns < heap[child]->deadline_ns) {
+            child++;
+        }
+        if (heap[child]->deadline_ns >= t->deadline_ns) {
+            break;
+        }
+        place(i, heap[child]);
+        i = child;
+    }
+    place(i, t);
+}
+
+static void
+heap_remove(struct msh_timeout *t)
+{
+    size_t i = t->slot - 1;
+    struct msh_timeout *last = heap[--num_pending];
+
+    t->slot = 0;
+    if (last == t) {
+        return;
+    }
+    place(i, last);
+    sift_up(i);
+    sift_down(last->slot - 1);
+}
+
+//arm the interval timer for the earliest deadline, or disarm it
+static void
+arm(void)
+{
+    struct itimerval it = { 0 };
+
+    if (num_pending > 0) {
+        long left = heap[0]->deadline_ns - now_ns();
+
+        //0 would disarm it, so an expired one is due in a microsecond
+        if (left < 1000) {
+            left = 1000;
+        }
+        it.it_value.tv_sec = left / 1000000000L;
+        it.it_value.tv_usec = left % 1000000000L / 1000;
+    }
+    setitimer(ITIMER_REAL, &it, NULL);
+}
+
+static void
+sigalrm_handler(int sig)
+{
+    int saved = errno;
+    long now = now_ns();
+
+    (void)sig;
+    while (num_pending > 0 && heap[0]->deadline_ns <= now) {
+        struct msh_timeout *t = heap[0];
+
+        heap_remove(t);
+        on_expiry(t);
+    }
+    arm();
+    errno = saved;
+}
+
+int
+msh_timeout_init(msh_timeout_fn_t expired)
+{
+    struct sigaction sa;
+
+    on_expiry = expired;
+    sa.sa_handler = sigalrm_handler;
+    sigemptyset(&sa.sa_mask);
+    //the prompt and the waits carry on as if nothing happened
+    sa.sa_flags = SA_RESTART;
+
+    return sigaction(SIGALRM, &sa, NULL);
+}
+
+void
+msh_timeout_hold(sigset_t *old)
+{
+    sigset_t set;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &set, old);
+}
+
+void
+msh_timeout_release(const sigset_t *old)
+{
+    pthread_sigmask(SIG_SETMASK, old, NULL);
+}
+
+int
+msh_timeout_set(struct msh_timeout *t, long deadline_ns)
+{
+    sigset_t old;
+    int ret = 0;
+
+    msh_timeout_hold(&old);
+    if (t->slot != 0) {
+        heap_remove(t);
+    }
+    if (num_pending == MSH_TIMEOUT_MAX) {
+        ret = -1;
+    } else {
+        t->deadline_ns = deadline_ns;
+        heap[num_pending++] = t;
+        sift_up(num_pending - 1);
+    }
+    //only a new earliest deadline moves the timer
+    if (ret == 0 && t->slot == 1) {
+        arm();
+    }
+    msh_timeout_release(&old);
+
+    return ret;
+}
+
+void
+msh_timeout_cancel(struct msh_timeout *t)
+{
+    sigset_t old;
+
+    msh_timeout_hold(&old);
+    if (t->slot != 0) {
+        int first = t->slot == 1;
+
+        heap_remove(t);
+        if (first) {
+            arm();
+        }
+    }
+    msh_timeout_release(&old);
+}
+
+long
+msh_timeout_parse(const char *duration)
+{
+    char *end;
+    double secs;
+
+    if (duration == NULL || *duration == '\0') {
+        return -1;
+    }
+    errno = 0;
+    secs = strtod(duration, &end);
+    if (errno != 0 || end == duration || secs < 0) {
+        return -1;
+    }
+    switch (*end) {
+    case 'd':
+        secs *= 24;
+        //fall through
+    case 'h':
+        secs *= 60;
+        //fall through
+    case 'm':
+        secs *= 60;
+        //fall through
+    case 's':
+        end++;
+        break;
+    default:
+        break;
+    }
+    if (*end != '\0' || !(secs * 1e9 < 9e18)) {
+        return -1;
+    }
+    return (long)(secs * 1e9);
+}
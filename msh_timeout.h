@@ -0,0 +1,76 @@
+#pragma once
+
+#include <signal.h>
+#include <stddef.h>
+
+/***
+ * Deadlines, for `timeout DURATION <pipeline>` and the default one of
+ * background pipelines (`MSH_TIMEOUT`). Pending deadlines are kept in a
+ * binary heap on their time, and only the earliest one is armed, as an
+ * interval timer: however many are pending, the shell does nothing for
+ * them until one expires, whether it is reading a line or waiting on a
+ * foreground pipeline. The expired deadlines' callback then runs in
+ * the `SIGALRM` handler, so it may only do what is async-signal-safe.
+ * The shell's other threads are started with every signal blocked, so
+ * the handler runs on the main thread, where `msh_timeout_hold` holds
+ * it off.
+ *
+ * A job whose deadline expires gets `SIGTERM`, then `SIGKILL` once
+ * `MSH_TIMEOUT_GRACE` (a duration) has passed.
+ */
+
+/* most deadlines pending at a time */
+#define MSH_TIMEOUT_MAX 4096
+/* between SIGTERM and SIGKILL, unless MSH_TIMEOUT_GRACE says otherwise */
+#define MSH_TIMEOUT_GRACE_NS 5000000000L
+
+struct msh_timeout {
+    //on CLOCK_MONOTONIC, in nanoseconds
+    long deadline_ns;
+    //its place in the heap plus one, 0 when it isn't pending
+    size_t slot;
+};
+
+typedef void (*msh_timeout_fn_t)(struct msh_timeout *t);
+
+/**
+ * `msh_timeout_init` installs the `SIGALRM` handler.
+ *
+ * - `@expired` - called (from the handler) with each deadline that
+ *     expires. It may set the deadline again.
+ * - `@return` - `0`, or `-1` if the handler couldn't be installed.
+ */
+int msh_timeout_init(msh_timeout_fn_t expired);
+
+/**
+ * `msh_timeout_set` sets (or moves) a deadline.
+ *
+ * - `@t` - the deadline, zeroed before it is first set.
+ * - `@deadline_ns` - when it expires, on `CLOCK_MONOTONIC`.
+ * - `@return` - `0`, or `-1` if `MSH_TIMEOUT_MAX` are already pending.
+ */
+int msh_timeout_set(struct msh_timeout *t, long deadline_ns);
+
+/**
+ * `msh_timeout_cancel` removes a deadline, if it is pending.
+ */
+void msh_timeout_cancel(struct msh_timeout *t);
+
+/**
+ * `msh_timeout_hold` defers the expiries until `msh_timeout_release`,
+ * while what the callback looks at is being changed.
+ *
+ * - `@old` - set to the signal mask to restore.
+ */
+void msh_timeout_hold(sigset_t *old);
+
+void msh_timeout_release(const sigset_t *old);
+
+/**
+ * `msh_timeout_parse` reads a duration, as `timeout(1)` does: a number
+ * of seconds, possibly fractional, followed by `s`, `m`, `h` or `d`.
+ *
+ * - `@duration` - the duration.
+ * - `@return` - it in nanoseconds, or `-1` if it isn't one.
+ */
+long msh_timeout_parse(const char *duration);
@@ -0,0 +1,85 @@
+#include <msh.h>
+#include <msh_parse.h>
+#include <msh_update.h>
+#include <msh_glob.h>
+#include <msh_path.h>
+
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+static int
+newer(const struct timespec *a, const struct timespec *b)
+{
+    return a->tv_sec > b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec > b->tv_nsec);
+}
+
+//the oldest of the outputs, 0 if one of them is missing or there are none
+static int
+oldest_output(struct msh_pipeline *p, struct timespec *oldest)
+{
+    struct msh_command *c;
+    int found = 0;
+
+    for (size_t i = 0; (c = msh_pipeline_command(p, i)) != NULL; i++) {
+        char *files[2];
+
+        msh_command_file_outputs(c, &files[0], &files[1]);
+        for (int j = 0; j < 2; j++) {
+            struct stat st;
+
+            if (files[j] == NULL) {
+                continue;
+            }
+            if (stat(files[j], &st) != 0) {
+                return 0;
+            }
+            if (!found || newer(oldest, &st.st_mtim)) {
+                *oldest = st.st_mtim;
+            }
+            found = 1;
+        }
+    }
+    return found;
+}
+
+//if the input (a regular file) was changed after the outputs
+static int
+stale(const char *path, const struct timespec *oldest)
+{
+    struct stat st;
+
+    return path != NULL && stat(path, &st) == 0 && S_ISREG(st.st_mode) && newer(&st.st_mtim, oldest);
+}
+
+int
+msh_update_fresh(struct msh_pipeline *p)
+{
+    struct timespec oldest;
+    struct msh_command *c;
+
+    if (!oldest_output(p, &oldest)) {
+        return 0;
+    }
+    for (size_t i = 0; (c = msh_pipeline_command(p, i)) != NULL; i++) {
+        char **argv = msh_glob_argv(msh_command_args(c), NULL);
+        int program = 1;
+
+        if (argv == NULL || stale(msh_command_getdata(c), &oldest)) {
+            return 0;
+        }
+        for (size_t j = 0; argv[j] != NULL; j++) {
+            //the program is the first argument that isn't an assignment
+            if (program && strchr(argv[j], '=') == NULL) {
+                if (stale(msh_path_resolve(argv[j]), &oldest)) {
+                    return 0;
+                }
+                program = 0;
+            }
+            if (stale(argv[j], &oldest)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
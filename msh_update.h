@@ -0,0 +1,20 @@
+#pragma once
+
+#include <msh_parse.h>
+
+/***
+ * Freshness checks for `update <pipeline>`, the way `make` decides what
+ * to rebuild: a pipeline writing its output to files (`>`, `2>`) is
+ * skipped when each of those files exists and none of its inputs is
+ * newer. Its inputs are the programs it runs, its `<` files, and the
+ * arguments naming regular files. Nothing is read, only `stat`ed.
+ */
+
+/**
+ * `msh_update_fresh` tells if a pipeline's outputs are up to date.
+ *
+ * - `@p` - the pipeline, expanded.
+ * - `@return` - `1` if it has outputs and they are all up to date, `0`
+ *     if it has to run.
+ */
+int msh_update_fresh(struct msh_pipeline *p);
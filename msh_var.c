@@ -0,0 +1,331 @@
+#define _XOPEN_SOURCE 700
+
+#include <msh.h>
+#include <msh_var.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+
+extern char **environ;
+
+//a variable, stored as "NAME=value"
+struct var {
+    char *str;
+    size_t len;
+    //in the environment of the programs run
+    int exported;
+    //unset, but kept for its slot (and being exported)
+    int unset;
+    //where it is in the envp snapshot
+    size_t env_slot;
+};
+
+static struct var *vars = NULL;
+static size_t num_vars = 0, cap_vars = 0;
+//open addressing on the name, index + 1 into vars, 0 marks a free slot
+static uint32_t *table = NULL;
+static size_t table_size = 0;
+static int imported = 0;
+
+//the exported variables, with room behind them for the overlays of a command
+static char **envp = NULL;
+static size_t envp_len = 0, envp_cap = 0;
+//an exported variable changed since envp was built
+static int envp_stale = 1;
+
+//FNV-1a over the name
+static unsigned long
+hash_name(const char *s, size_t len)
+{
+    unsigned long h = 14695981039346656037UL;
+
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211UL;
+    }
+    return h;
+}
+
+static int
+table_grow(void)
+{
+    size_t size = table_size ? table_size * 2 : 256;
+    uint32_t *t = calloc(size, sizeof(uint32_t));
+
+    if (t == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < num_vars; i++) {
+        size_t slot = hash_name(vars[i].str, vars[i].len) & (size - 1);
+
+        while (t[slot] != 0) {
+            slot = (slot + 1) & (size - 1);
+        }
+        t[slot] = (uint32_t)i + 1;
+    }
+    free(table);
+    table = t;
+    table_size = size;
+
+    return 0;
+}
+
+//the variable's slot in the table, free if it isn't there
+static uint32_t *
+find(const char *name, size_t len)
+{
+    size_t slot = hash_name(name, len) & (table_size - 1);
+
+    while (table[slot] != 0) {
+        struct var *v = &vars[table[slot] - 1];
+
+        if (v->len == len && memcmp(v->str, name, len) == 0) {
+            break;
+        }
+        slot = (slot + 1) & (table_size - 1);
+    }
+    return &table[slot];
+}
+
+//the variable, created (unset) if it doesn't exist
+static struct var *
+lookup_or_add(const char *name, size_t len)
+{
+    uint32_t *slot;
+    char *str;
+
+    if (num_vars * 2 >= table_size && table_grow() != 0) {
+        return NULL;
+    }
+    slot = find(name, len);
+    if (*slot != 0) {
+        return &vars[*slot - 1];
+    }
+    if (num_vars == cap_vars) {
+        size_t cap = cap_vars ? cap_vars * 2 : 128;
+        struct var *grown = realloc(vars, cap * sizeof(*vars));
+
+        if (grown == NULL) {
+            return NULL;
+        }
+        vars = grown;
+        cap_vars = cap;
+    }
+    str = malloc(len + 2);
+    if (str == NULL) {
+        return NULL;
+    }
+    memcpy(str, name, len);
+    memcpy(str + len, "=", 2);
+    vars[num_vars] = (struct var) { .str = str, .len = len, .unset = 1 };
+    *slot = (uint32_t)++num_vars;
+
+    return &vars[num_vars - 1];
+}
+
+static int
+store(const char *name, size_t len, const char *value, int exported)
+{
+    struct var *v = lookup_or_add(name, len);
+    size_t vlen = strlen(value);
+    char *str;
+
+    if (v == NULL) {
+        return -1;
+    }
+    //setting what's already there changes nothing, the snapshot stays
+    if (!v->unset && strcmp(v->str + len + 1, value) == 0) {
+        if (exported && !v->exported) {
+            v->exported = 1;
+            envp_stale = 1;
+        }
+        return 0;
+    }
+    str = malloc(len + vlen + 2);
+    if (str == NULL) {
+        return -1;
+    }
+    memcpy(str, name, len);
+    str[len] = '=';
+    memcpy(str + len + 1, value, vlen + 1);
+    free(v->str);
+    v->str = str;
+    v->unset = 0;
+    v->exported |= exported;
+    if (v->exported) {
+        envp_stale = 1;
+    }
+
+    return 0;
+}
+
+//the environment is only read once a variable is used
+static void
+import_environ(void)
+{
+    imported = 1;
+    for (char **e = environ; e != NULL && *e != NULL; e++) {
+        char *eq = strchr(*e, '=');
+
+        if (eq != NULL && eq > *e) {
+            store(*e, (size_t)(eq - *e), eq + 1, 1);
+        }
+    }
+}
+
+const char *
+msh_var_get(const char *name, size_t len)
+{
+    uint32_t *slot;
+
+    if (!imported) {
+        import_environ();
+    }
+    if (table_size == 0) {
+        return NULL;
+    }
+    slot = find(name, len);
+    return *slot != 0 && !vars[*slot - 1].unset ? vars[*slot - 1].str + len + 1 : NULL;
+}
+
+int
+msh_var_set(const char *name, size_t len, const char *value)
+{
+    if (!imported) {
+        import_environ();
+    }
+    return store(name, len, value, 0);
+}
+
+int
+msh_var_export(const char *name, size_t len)
+{
+    struct var *v;
+
+    if (!imported) {
+        import_environ();
+    }
+    v = lookup_or_add(name, len);
+    if (v == NULL) {
+        return -1;
+    }
+    if (!v->exported) {
+        v->exported = 1;
+        if (!v->unset) {
+            envp_stale = 1;
+        }
+    }
+    return 0;
+}
+
+void
+msh_var_unset(const char *name, size_t len)
+{
+    uint32_t *slot;
+
+    if (!imported) {
+        import_environ();
+    }
+    if (table_size == 0) {
+        return;
+    }
+    slot = find(name, len);
+    if (*slot != 0 && !vars[*slot - 1].unset) {
+        struct var *v = &vars[*slot - 1];
+
+        v->unset = 1;
+        if (v->exported) {
+            envp_stale = 1;
+        }
+    }
+}
+
+const char *
+msh_var_lookup(const char *name, size_t len, void *data)
+{
+    const char *value = msh_var_get(name, len);
+
+    (void)data;
+    return value != NULL ? value : "";
+}
+
+size_t
+msh_var_name(const char *word)
+{
+    size_t len = 0;
+
+    if (!isalpha((unsigned char)*word) && *word != '_') {
+        return 0;
+    }
+    while (isalnum((unsigned char)word[len]) || word[len] == '_') {
+        len++;
+    }
+    return len;
+}
+
+size_t
+msh_var_assignment(const char *word)
+{
+    size_t len = msh_var_name(word);
+
+    return len > 0 && word[len] == '=' ? len : 0;
+}
+
+char **
+msh_var_environ(void)
+{
+    size_t n = 0;
+
+    if (!imported) {
+        import_environ();
+    }
+    if (!envp_stale) {
+        return envp;
+    }
+    for (size_t i = 0; i < num_vars; i++) {
+        n += vars[i].exported && !vars[i].unset;
+    }
+    //room for a command's overlays, and the NULL
+    if (n + MSH_MAXARGS + 1 > envp_cap) {
+        size_t cap = n + MSH_MAXARGS + 1 > envp_cap * 2 ? n + MSH_MAXARGS + 1 : envp_cap * 2;
+        char **grown = realloc(envp, cap * sizeof(char *));
+
+        if (grown == NULL) {
+            return NULL;
+        }
+        envp = grown;
+        envp_cap = cap;
+    }
+    envp_len = 0;
+    for (size_t i = 0; i < num_vars; i++) {
+        if (vars[i].exported && !vars[i].unset) {
+            vars[i].env_slot = envp_len;
+            envp[envp_len++] = vars[i].str;
+        }
+    }
+    envp[envp_len] = NULL;
+    envp_stale = 0;
+
+    return envp;
+}
+
+void
+msh_var_overlay(char **env, char **assignments, size_t n)
+{
+    size_t len = envp_len;
+
+    for (size_t i = 0; i < n; i++) {
+        size_t name_len = msh_var_assignment(assignments[i]);
+        uint32_t *slot = table_size > 0 ? find(assignments[i], name_len) : NULL;
+        struct var *v = slot != NULL && *slot != 0 ? &vars[*slot - 1] : NULL;
+
+        if (v != NULL && v->exported && !v->unset) {
+            env[v->env_slot] = assignments[i];
+        } else if (len < envp_cap - 1) {
+            env[len++] = assignments[i];
+        }
+    }
+    env[len] = NULL;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stddef.h>
+
+/***
+ * Shell variables, set with `NAME=value` and used as `$NAME` or
+ * `${NAME}`. The environment the shell started with is imported into
+ * the same hash table the first time a variable is looked up, so that
+ * expanding a variable never walks `environ`.
+ *
+ * Exported variables make up the environment of the programs the shell
+ * runs. It is kept as an `envp` snapshot that is only rebuilt after an
+ * exported variable changes, and a command's `NAME=value` prefixes are
+ * laid over the child's copy of the snapshot rather than a new array.
+ */
+
+/**
+ * `msh_var_get` looks a variable up.
+ *
+ * - `@name` - the variable's name, not necessarily `'\0'` terminated.
+ * - `@len` - the length of the name.
+ * - `@return` - the value, borrowed until the variable is set again,
+ *     or `NULL` if it isn't set.
+ */
+const char *msh_var_get(const char *name, size_t len);
+
+/**
+ * `msh_var_set` sets a variable.
+ *
+ * - `@name` - the variable's name, not necessarily `'\0'` terminated.
+ * - `@len` - the length of the name.
+ * - `@value` - the value, copied.
+ * - `@return` - `0`, or `-1` if out of memory.
+ */
+int msh_var_set(const char *name, size_t len, const char *value);
+
+/**
+ * `msh_var_export` puts a variable in the environment of the programs
+ * run, from now on (it needn't be set yet).
+ *
+ * - `@return` - `0`, or `-1` if out of memory.
+ */
+int msh_var_export(const char *name, size_t len);
+
+/**
+ * `msh_var_unset` removes a variable (it stays exported if it was, for
+ * when it is set again).
+ */
+void msh_var_unset(const char *name, size_t len);
+
+/**
+ * `msh_var_lookup` is `msh_var_get` as a `msh_lookup_fn_t`: a variable
+ * that isn't set expands to nothing.
+ */
+const char *msh_var_lookup(const char *name, size_t len, void *data);
+
+/**
+ * `msh_var_name` measures the variable name a word starts with.
+ *
+ * - `@word` - an argument.
+ * - `@return` - the length of the name, `0` if it doesn't start with one.
+ */
+size_t msh_var_name(const char *word);
+
+/**
+ * `msh_var_assignment` tells if a word is an assignment, `NAME=value`.
+ *
+ * - `@word` - an argument.
+ * - `@return` - the length of the name, or `0` if it isn't one.
+ */
+size_t msh_var_assignment(const char *word);
+
+/**
+ * `msh_var_environ` returns the environment for the programs run.
+ *
+ * - `@return` - the `NULL`-terminated `envp` snapshot, borrowed until
+ *     a variable next changes, or `NULL` if out of memory.
+ */
+char **msh_var_environ(void);
+
+/**
+ * `msh_var_overlay` lays a command's `NAME=value` prefixes over the
+ * snapshot. It writes to the snapshot, so it is only for a forked
+ * child, whose copy it changes.
+ *
+ * - `@env` - the snapshot, from `msh_var_environ`.
+ * - `@assignments` - the prefixes, fewer than `MSH_MAXARGS`.
+ * - `@n` - the number of prefixes.
+ */
+void msh_var_overlay(char **env, char **assignments, size_t n);
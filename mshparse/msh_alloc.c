@@ -0,0 +1,200 @@
+#include <msh_parse.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/* size classes are powers of two from 16 bytes up to this */
+#define MSH_POOL_MAXCLASS 4096
+#define MSH_POOL_CLASSES  9
+/* bytes the pool gets from its parent at a time */
+#define MSH_POOL_CHUNK    (64 * 1024)
+
+//a block of memory objects are carved from, the header keeps them 16-byte aligned
+struct pool_chunk {
+    struct pool_chunk *next;
+    size_t size;
+    char mem[];
+};
+
+//an object too large for the size classes, straight from the parent
+struct pool_large {
+    struct pool_large *next;
+    struct pool_large *prev;
+    size_t size;
+    size_t pad;
+};
+
+struct pool {
+    struct msh_allocator a;
+    struct msh_allocator *parent;
+    //freed objects of each size class, linked through their first word
+    void *free_lists[MSH_POOL_CLASSES];
+    //the chunks in the order they were added, cur is being carved
+    struct pool_chunk *chunks, *cur;
+    char *bump;
+    struct pool_large *large;
+};
+
+static void *
+std_alloc(struct msh_allocator *a, size_t size)
+{
+    (void)a;
+    return malloc(size);
+}
+
+static void
+std_free(struct msh_allocator *a, void *ptr, size_t size)
+{
+    (void)a;
+    (void)size;
+    free(ptr);
+}
+
+static struct msh_allocator std_parent = { .alloc = std_alloc, .free = std_free, .reset = NULL };
+
+static size_t
+size_class(size_t size)
+{
+    size_t c = 0;
+
+    while (((size_t)16 << c) < size) {
+        c++;
+    }
+    return c;
+}
+
+static void *
+pool_alloc(struct msh_allocator *a, size_t size)
+{
+    struct pool *p = (struct pool *)a;
+    size_t c, csize;
+    void *obj;
+
+    if (size > MSH_POOL_MAXCLASS) {
+        struct pool_large *l = p->parent->alloc(p->parent, sizeof(*l) + size);
+
+        if (l == NULL) {
+            return NULL;
+        }
+        l->size = size;
+        l->prev = NULL;
+        l->next = p->large;
+        if (p->large) p->large->prev = l;
+        p->large = l;
+        return l + 1;
+    }
+
+    c = size_class(size);
+    csize = (size_t)16 << c;
+    if (p->free_lists[c] != NULL) {
+        obj = p->free_lists[c];
+        p->free_lists[c] = *(void **)obj;
+        return obj;
+    }
+    //carve from the current chunk, moving on to the next (kept from before a reset) or a new one
+    while (p->cur == NULL || p->bump + csize > p->cur->mem + p->cur->size) {
+        struct pool_chunk *next = p->cur ? p->cur->next : p->chunks;
+
+        if (next == NULL) {
+            next = p->parent->alloc(p->parent, sizeof(*next) + MSH_POOL_CHUNK);
+            if (next == NULL) {
+                return NULL;
+            }
+            next->next = NULL;
+            next->size = MSH_POOL_CHUNK;
+            if (p->cur) p->cur->next = next;
+            else p->chunks = next;
+        }
+        p->cur = next;
+        p->bump = next->mem;
+    }
+    obj = p->bump;
+    p->bump += csize;
+
+    return obj;
+}
+
+static void
+pool_free(struct msh_allocator *a, void *ptr, size_t size)
+{
+    struct pool *p = (struct pool *)a;
+    size_t c;
+
+    if (ptr == NULL) {
+        return;
+    }
+    if (size > MSH_POOL_MAXCLASS) {
+        struct pool_large *l = (struct pool_large *)ptr - 1;
+
+        if (l->prev) l->prev->next = l->next;
+        else p->large = l->next;
+        if (l->next) l->next->prev = l->prev;
+        p->parent->free(p->parent, l, sizeof(*l) + l->size);
+        return;
+    }
+    c = size_class(size);
+    *(void **)ptr = p->free_lists[c];
+    p->free_lists[c] = ptr;
+}
+
+static void
+free_large(struct pool *p)
+{
+    while (p->large != NULL) {
+        struct pool_large *l = p->large;
+
+        p->large = l->next;
+        p->parent->free(p->parent, l, sizeof(*l) + l->size);
+    }
+}
+
+//everything is free again, but the chunks are kept to be carved anew
+static void
+pool_reset(struct msh_allocator *a)
+{
+    struct pool *p = (struct pool *)a;
+
+    memset(p->free_lists, 0, sizeof(p->free_lists));
+    p->cur = NULL;
+    p->bump = NULL;
+    free_large(p);
+}
+
+struct msh_allocator *
+msh_pool_create(struct msh_allocator *parent)
+{
+    struct pool *p;
+
+    if (parent == NULL) {
+        parent = &std_parent;
+    }
+    p = parent->alloc(parent, sizeof(*p));
+    if (p == NULL) {
+        return NULL;
+    }
+    memset(p, 0, sizeof(*p));
+    p->a.alloc = pool_alloc;
+    p->a.free = pool_free;
+    p->a.reset = pool_reset;
+    p->parent = parent;
+
+    return &p->a;
+}
+
+void
+msh_pool_destroy(struct msh_allocator *pool)
+{
+    struct pool *p = (struct pool *)pool;
+
+    if (p == NULL) {
+        return;
+    }
+    free_large(p);
+    while (p->chunks != NULL) {
+        struct pool_chunk *c = p->chunks;
+
+        p->chunks = c->next;
+        p->parent->free(p->parent, c, sizeof(*c) + c->size);
+    }
+    p->parent->free(p->parent, p, sizeof(*p));
+}
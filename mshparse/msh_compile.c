@@ -0,0 +1,674 @@
+#define _DEFAULT_SOURCE
+
+#include <msh_parse.h>
+#include <msh_parse_internal.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/***
+ * The compiled file is a header followed by six sections: the
+ * pipelines, their commands, the commands' arguments, the templates of
+ * the arguments with variables in them, the templates' segments, and
+ * the strings they all point to. Segments are stored as the parser
+ * makes them, so a template is used straight from the file. Strings
+ * are offsets into the string section, which starts with a `'\0'` so
+ * that offset `0` means "no string". Everything is in the byte order
+ * of the machine that compiled it.
+ */
+
+#define MSHC_MAGIC "MSHC"
+
+struct mshc_header {
+    char magic[4];
+    //these first four fields never move, so that any version can find
+    //the script to fall back on
+    uint32_t version;
+    uint64_t source;
+    uint64_t strings;
+    uint64_t size;
+    //the script when it was compiled
+    uint64_t source_size;
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint64_t num_pipelines;
+    uint64_t num_commands;
+    uint64_t num_args;
+    uint64_t pipelines;
+    uint64_t commands;
+    uint64_t args;
+    uint64_t num_templates;
+    uint64_t num_segments;
+    uint64_t templates;
+    uint64_t segments;
+};
+
+struct mshc_pipeline {
+    uint64_t input;
+    uint32_t first_command;
+    uint32_t num_commands;
+    uint32_t background;
+    uint32_t pad;
+};
+
+struct mshc_command {
+    uint64_t stdout_file;
+    uint64_t stderr_file;
+    uint64_t stdin_file;
+    uint64_t first_arg;
+    uint64_t first_template;
+    uint32_t num_args;
+    uint32_t num_templates;
+    //a here-string or here-document's bytes
+    uint64_t here;
+    uint32_t here_doc;
+    uint32_t pad;
+};
+
+//expands the argument (or TMPL_ redirection) arg, which is its raw text
+struct mshc_template {
+    uint64_t first_segment;
+    uint32_t arg;
+    uint32_t num_segments;
+};
+
+//a section being compiled
+struct section {
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+//append n bytes, returning where they went (or -1 if out of memory)
+static int64_t
+section_put(struct section *s, const void *data, size_t n)
+{
+    size_t off = s->len;
+
+    if (s->len + n > s->cap) {
+        size_t cap = s->cap ? s->cap : 4096;
+        char *grown;
+
+        while (cap < s->len + n) {
+            cap *= 2;
+        }
+        grown = realloc(s->data, cap);
+        if (grown == NULL) {
+            return -1;
+        }
+        s->data = grown;
+        s->cap = cap;
+    }
+    memcpy(s->data + s->len, data, n);
+    s->len += n;
+
+    return (int64_t)off;
+}
+
+static int64_t
+section_str(struct section *s, const char *str)
+{
+    if (str == NULL) {
+        return 0;
+    }
+    return section_put(s, str, strlen(str) + 1);
+}
+
+struct compiler {
+    struct section pipelines, commands, args, templates, segments, strings;
+};
+
+static msh_err_t
+compile_pipeline(struct compiler *cc, struct msh_pipeline *p)
+{
+    struct mshc_pipeline rec = {
+        .input = (uint64_t)section_str(&cc->strings, p->input),
+        .first_command = (uint32_t)(cc->commands.len / sizeof(struct mshc_command)),
+        .num_commands = (uint32_t)p->num_commands,
+        .background = (uint32_t)p->background,
+    };
+
+    if ((int64_t)rec.input == -1) {
+        return MSH_ERR_NOMEM;
+    }
+    for (size_t i = 0; i < p->num_commands; i++) {
+        struct msh_command *c = p->commands[i];
+        struct mshc_command crec = {
+            .stdout_file = (uint64_t)section_str(&cc->strings, c->stdout_file),
+            .stderr_file = (uint64_t)section_str(&cc->strings, c->stderr_file),
+            .stdin_file = (uint64_t)section_str(&cc->strings, c->stdin_file),
+            .first_arg = cc->args.len / sizeof(uint64_t),
+            .first_template = cc->templates.len / sizeof(struct mshc_template),
+            .num_args = (uint32_t)c->numberArgs,
+            .here = (uint64_t)section_str(&cc->strings, c->here),
+            .here_doc = (uint32_t)c->here_doc,
+        };
+
+        //the arguments always leave room for their NULL
+        if (c->numberArgs >= MSH_MAXARGS) {
+            return MSH_ERR_TOO_MANY_ARGS;
+        }
+        if ((int64_t)crec.stdout_file == -1 || (int64_t)crec.stderr_file == -1 || (int64_t)crec.stdin_file == -1 ||
+            (int64_t)crec.here == -1) {
+            return MSH_ERR_NOMEM;
+        }
+        for (int j = 0; j < c->numberArgs; j++) {
+            uint64_t arg = (uint64_t)section_str(&cc->strings, c->args[j]);
+
+            if ((int64_t)arg == -1 || section_put(&cc->args, &arg, sizeof(arg)) == -1) {
+                return MSH_ERR_NOMEM;
+            }
+        }
+        for (struct msh_template *t = c->templates; t != NULL; t = t->next) {
+            struct mshc_template trec = {
+                .first_segment = cc->segments.len / sizeof(struct msh_segment),
+                .arg = (uint32_t)t->arg,
+                .num_segments = (uint32_t)t->nsegs,
+            };
+
+            if (section_put(&cc->segments, t->segs, t->nsegs * sizeof(struct msh_segment)) == -1 ||
+                section_put(&cc->templates, &trec, sizeof(trec)) == -1) {
+                return MSH_ERR_NOMEM;
+            }
+            crec.num_templates++;
+        }
+        if (section_put(&cc->commands, &crec, sizeof(crec)) == -1) {
+            return MSH_ERR_NOMEM;
+        }
+    }
+    if (section_put(&cc->pipelines, &rec, sizeof(rec)) == -1) {
+        return MSH_ERR_NOMEM;
+    }
+
+    return 0;
+}
+
+//parse the script a line at a time into the sections
+static msh_err_t
+compile_lines(struct compiler *cc, FILE *f, size_t *lineno)
+{
+    struct msh_sequence *seq = msh_sequence_alloc();
+    struct msh_allocator *pool = msh_pool_create(NULL);
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    msh_err_t err = 0;
+
+    if (seq == NULL || pool == NULL) {
+        msh_sequence_free(seq);
+        msh_pool_destroy(pool);
+        return MSH_ERR_NOMEM;
+    }
+    msh_sequence_allocator(seq, pool);
+    while (err == 0 && (len = getline(&line, &cap, f)) != -1) {
+        struct msh_pipeline *p;
+        char *start = line;
+
+        (*lineno)++;
+        if (len > 0 && line[len - 1] == '\n') {
+            line[len - 1] = '\0';
+        }
+        while (isspace((unsigned char)*start)) {
+            start++;
+        }
+        if (*start == '\0' || *start == '#') {
+            continue;
+        }
+        err = msh_sequence_parse(line, seq);
+        //a here-document's body is the lines after it, whatever they hold
+        while (err == 0 && msh_sequence_heredoc(seq) != NULL) {
+            if ((len = getline(&line, &cap, f)) == -1) {
+                err = MSH_ERR_UNTERMINATED_HEREDOC;
+                break;
+            }
+            (*lineno)++;
+            if (len > 0 && line[len - 1] == '\n') {
+                line[len - 1] = '\0';
+            }
+            err = msh_sequence_heredoc_line(seq, line);
+        }
+        while ((p = msh_sequence_pipeline(seq)) != NULL) {
+            if (err == 0) {
+                err = compile_pipeline(cc, p);
+            }
+            msh_pipeline_free(p);
+        }
+    }
+    free(line);
+    msh_sequence_free(seq);
+    msh_pool_destroy(pool);
+
+    return err;
+}
+
+//write the sections out behind the header
+static int
+compile_write(struct compiler *cc, struct mshc_header *h, const char *out)
+{
+    char tmp[4096];
+    FILE *f;
+    int ok;
+
+    h->pipelines = sizeof(*h);
+    h->commands = h->pipelines + cc->pipelines.len;
+    h->args = h->commands + cc->commands.len;
+    h->templates = h->args + cc->args.len;
+    h->segments = h->templates + cc->templates.len;
+    h->strings = h->segments + cc->segments.len;
+    h->size = h->strings + cc->strings.len;
+    h->num_pipelines = cc->pipelines.len / sizeof(struct mshc_pipeline);
+    h->num_commands = cc->commands.len / sizeof(struct mshc_command);
+    h->num_args = cc->args.len / sizeof(uint64_t);
+    h->num_templates = cc->templates.len / sizeof(struct mshc_template);
+    h->num_segments = cc->segments.len / sizeof(struct msh_segment);
+
+    //written beside the target and renamed, so a running copy is never torn
+    if ((size_t)snprintf(tmp, sizeof(tmp), "%s.%d.tmp", out, (int)getpid()) >= sizeof(tmp)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    f = fopen(tmp, "w");
+    if (f == NULL) {
+        return -1;
+    }
+    ok = fwrite(h, sizeof(*h), 1, f) == 1 &&
+        fwrite(cc->pipelines.data, 1, cc->pipelines.len, f) == cc->pipelines.len &&
+        fwrite(cc->commands.data, 1, cc->commands.len, f) == cc->commands.len &&
+        fwrite(cc->args.data, 1, cc->args.len, f) == cc->args.len &&
+        fwrite(cc->templates.data, 1, cc->templates.len, f) == cc->templates.len &&
+        fwrite(cc->segments.data, 1, cc->segments.len, f) == cc->segments.len &&
+        fwrite(cc->strings.data, 1, cc->strings.len, f) == cc->strings.len;
+    if (fclose(f) != 0) {
+        ok = 0;
+    }
+    if (!ok || rename(tmp, out) != 0) {
+        int saved = errno;
+
+        unlink(tmp);
+        errno = saved;
+        return -1;
+    }
+
+    return 0;
+}
+
+msh_err_t
+msh_script_compile(const char *src, const char *out, size_t *line)
+{
+    struct compiler cc = { 0 };
+    struct mshc_header h = { .version = MSH_COMPILED_VERSION };
+    char path[4096];
+    struct stat st;
+    size_t lineno = 0;
+    msh_err_t err;
+    FILE *f;
+
+    *line = 0;
+    memcpy(h.magic, MSHC_MAGIC, sizeof(h.magic));
+    f = fopen(src, "r");
+    if (f == NULL) {
+        return MSH_ERR_NOMEM;
+    }
+    if (fstat(fileno(f), &st) != 0) {
+        fclose(f);
+        return MSH_ERR_NOMEM;
+    }
+    h.source_size = (uint64_t)st.st_size;
+    h.source_mtime_sec = st.st_mtim.tv_sec;
+    h.source_mtime_nsec = st.st_mtim.tv_nsec;
+    //the compiled script may be run from anywhere
+    if (realpath(src, path) == NULL) {
+        snprintf(path, sizeof(path), "%s", src);
+    }
+
+    err = section_put(&cc.strings, "", 1) == -1 ? MSH_ERR_NOMEM : 0;
+    if (err == 0) {
+        h.source = (uint64_t)section_str(&cc.strings, path);
+        err = (int64_t)h.source == -1 ? MSH_ERR_NOMEM : compile_lines(&cc, f, &lineno);
+        if (err != 0 && err != MSH_ERR_NOMEM) {
+            *line = lineno;
+        }
+    }
+    fclose(f);
+    if (err == 0 && compile_write(&cc, &h, out) != 0) {
+        err = MSH_ERR_NOMEM;
+    }
+    free(cc.pipelines.data);
+    free(cc.commands.data);
+    free(cc.args.data);
+    free(cc.templates.data);
+    free(cc.segments.data);
+    free(cc.strings.data);
+
+    return err;
+}
+
+struct msh_compiled {
+    //frees the strings bench's shift swaps in, never the mapped ones
+    struct msh_allocator a;
+    char *map;
+    size_t size;
+    struct mshc_header *h;
+    struct mshc_pipeline *pipelines;
+    struct mshc_command *commands;
+    uint64_t *args;
+    struct mshc_template *templates;
+    struct msh_segment *segments;
+    //the pipeline handed out, rebuilt by each msh_compiled_pipeline
+    struct msh_pipeline pipeline;
+    struct msh_command cmds[MSH_MAXCMNDS];
+    //the commands' templates, their segments are in the file
+    struct msh_template tmpls[MSH_MAXCMNDS][TMPL_SLOTS];
+};
+
+static void *
+view_alloc(struct msh_allocator *a, size_t size)
+{
+    (void)a;
+    return malloc(size);
+}
+
+static void
+view_free(struct msh_allocator *a, void *ptr, size_t size)
+{
+    struct msh_compiled *c = (struct msh_compiled *)a;
+
+    (void)size;
+    //nor the templates, which are part of the view
+    if (((char *)ptr < c->map || (char *)ptr >= c->map + c->size) &&
+        ((char *)ptr < (char *)c || (char *)ptr >= (char *)(c + 1))) {
+        free(ptr);
+    }
+}
+
+//the string at off in the string section, if it is in bounds and terminated
+static char *
+string_at(char *map, size_t size, uint64_t strings, uint64_t off)
+{
+    if (strings >= size || off >= size - strings) {
+        return NULL;
+    }
+    if (memchr(map + strings + off, '\0', size - strings - off) == NULL) {
+        return NULL;
+    }
+    return map + strings + off;
+}
+
+//does the section of n records of sz bytes at off fit in the file?
+static int
+section_fits(size_t size, uint64_t off, uint64_t n, size_t sz)
+{
+    return off <= size && n <= (size - off) / sz;
+}
+
+//is the script still what was compiled? (a script that's gone can't have changed)
+static int
+source_fresh(struct mshc_header *h, const char *source)
+{
+    struct stat st;
+
+    if (stat(source, &st) != 0) {
+        return 1;
+    }
+    return (uint64_t)st.st_size == h->source_size && st.st_mtim.tv_sec == h->source_mtime_sec &&
+        st.st_mtim.tv_nsec == h->source_mtime_nsec;
+}
+
+struct msh_compiled *
+msh_compiled_open(const char *path, char *source, size_t sz)
+{
+    struct msh_compiled *c;
+    struct mshc_header *h;
+    struct stat st;
+    char *map, *src;
+    int fd, err;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0) {
+        err = errno;
+        close(fd);
+        errno = err;
+        return NULL;
+    }
+    if ((size_t)st.st_size < sizeof(struct mshc_header)) {
+        close(fd);
+        errno = ENOEXEC;
+        return NULL;
+    }
+    //private, so that a pipeline written to never changes the file
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    err = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        errno = err;
+        return NULL;
+    }
+    h = (struct mshc_header *)map;
+    err = 0;
+    src = string_at(map, (size_t)st.st_size, h->strings, h->source);
+    if (memcmp(h->magic, MSHC_MAGIC, sizeof(h->magic)) != 0) {
+        err = ENOEXEC;
+    } else if (src == NULL) {
+        err = EINVAL;
+    } else if (h->version != MSH_COMPILED_VERSION || !source_fresh(h, src)) {
+        err = ESTALE;
+        if (source != NULL && sz > 0) {
+            snprintf(source, sz, "%s", src);
+        }
+    } else if (h->size != (uint64_t)st.st_size ||
+               !section_fits(h->size, h->pipelines, h->num_pipelines, sizeof(struct mshc_pipeline)) ||
+               !section_fits(h->size, h->commands, h->num_commands, sizeof(struct mshc_command)) ||
+               !section_fits(h->size, h->args, h->num_args, sizeof(uint64_t)) ||
+               !section_fits(h->size, h->templates, h->num_templates, sizeof(struct mshc_template)) ||
+               !section_fits(h->size, h->segments, h->num_segments, sizeof(struct msh_segment))) {
+        err = EINVAL;
+    }
+    c = err == 0 ? calloc(1, sizeof(*c)) : NULL;
+    if (c == NULL) {
+        munmap(map, (size_t)st.st_size);
+        errno = err != 0 ? err : ENOMEM;
+        return NULL;
+    }
+    //scripts are run front to back
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+    c->a = (struct msh_allocator) { .alloc = view_alloc, .free = view_free, .reset = NULL };
+    c->map = map;
+    c->size = (size_t)st.st_size;
+    c->h = h;
+    c->pipelines = (struct mshc_pipeline *)(map + h->pipelines);
+    c->commands = (struct mshc_command *)(map + h->commands);
+    c->args = (uint64_t *)(map + h->args);
+    c->templates = (struct mshc_template *)(map + h->templates);
+    c->segments = (struct msh_segment *)(map + h->segments);
+
+    return c;
+}
+
+size_t
+msh_compiled_count(struct msh_compiled *c)
+{
+    return c != NULL ? c->h->num_pipelines : 0;
+}
+
+//drop what the previous pipeline's user put in its commands
+static void
+view_release(struct msh_compiled *c)
+{
+    for (size_t i = 0; i < c->pipeline.num_commands; i++) {
+        struct msh_command *cmd = &c->cmds[i];
+
+        //expanded arguments are in the command's buffer, kept for the next pipeline
+        if (!(cmd->templated & 1)) {
+            view_free(&c->a, cmd->program, 0);
+        }
+        for (int j = 0; j < cmd->numberArgs; j++) {
+            if (!(cmd->templated & (1u << j))) {
+                view_free(&c->a, cmd->args[j], 0);
+            }
+        }
+        if (cmd->data != NULL && cmd->fn != NULL) {
+            cmd->fn(cmd->data);
+        }
+    }
+    c->pipeline.num_commands = 0;
+}
+
+//a string of the script, NULL for none, corrupt sets *bad
+static char *
+view_string(struct msh_compiled *c, uint64_t off, int *bad)
+{
+    char *str;
+
+    if (off == 0) {
+        return NULL;
+    }
+    str = string_at(c->map, c->size, c->h->strings, off);
+    if (str == NULL) {
+        *bad = 1;
+    }
+    return str;
+}
+
+//where a template's argument (or redirection) goes
+static char **
+view_slot(struct msh_command *cmd, uint32_t arg)
+{
+    if (arg == TMPL_STDOUT) {
+        return &cmd->stdout_file;
+    } else if (arg == TMPL_STDERR) {
+        return &cmd->stderr_file;
+    } else if (arg == TMPL_HERE) {
+        return &cmd->here;
+    } else if (arg == TMPL_STDIN) {
+        return &cmd->stdin_file;
+    }
+    return arg < (uint32_t)cmd->numberArgs ? &cmd->args[arg] : NULL;
+}
+
+//point the command's templates at the file, 0 if they're corrupt
+static int
+view_templates(struct msh_compiled *c, struct mshc_command *crec, struct msh_command *cmd,
+               struct msh_template *tmpls)
+{
+    if (crec->num_templates > TMPL_SLOTS || crec->first_template > c->h->num_templates ||
+        crec->num_templates > c->h->num_templates - crec->first_template) {
+        return 0;
+    }
+    for (uint32_t k = 0; k < crec->num_templates; k++) {
+        struct mshc_template *trec = &c->templates[crec->first_template + k];
+        struct msh_template *t = &tmpls[k];
+        char **slot = view_slot(cmd, trec->arg);
+        size_t len;
+
+        if (slot == NULL || *slot == NULL || (cmd->templated & (1u << trec->arg)) ||
+            trec->first_segment > c->h->num_segments ||
+            trec->num_segments > c->h->num_segments - trec->first_segment) {
+            return 0;
+        }
+        *t = (struct msh_template) {
+            .next = cmd->templates, .arg = (int)trec->arg, .raw = *slot,
+            .nsegs = trec->num_segments, .cap = trec->num_segments,
+            .segs = &c->segments[trec->first_segment],
+        };
+        len = strlen(t->raw);
+        for (size_t s = 0; s < t->nsegs; s++) {
+            struct msh_segment *seg = &t->segs[s];
+
+            if (seg->start > len || seg->len > len - seg->start ||
+                (seg->var && (seg->ref_start > len || seg->ref_len > len - seg->ref_start))) {
+                return 0;
+            }
+        }
+        cmd->templates = t;
+        cmd->templated |= 1u << trec->arg;
+    }
+    return 1;
+}
+
+struct msh_pipeline *
+msh_compiled_pipeline(struct msh_compiled *c, size_t nth)
+{
+    struct mshc_pipeline *rec;
+    int bad = 0;
+
+    if (c == NULL || nth >= c->h->num_pipelines) {
+        return NULL;
+    }
+    view_release(c);
+    rec = &c->pipelines[nth];
+    if (rec->num_commands == 0 || rec->num_commands > MSH_MAXCMNDS ||
+        rec->first_command > c->h->num_commands || rec->num_commands > c->h->num_commands - rec->first_command) {
+        return NULL;
+    }
+    c->pipeline.background = (int)rec->background;
+    c->pipeline.input = view_string(c, rec->input, &bad);
+    c->pipeline.alloc = &c->a;
+    for (uint32_t i = 0; i < rec->num_commands && !bad; i++) {
+        struct mshc_command *crec = &c->commands[rec->first_command + i];
+        struct msh_command *cmd = &c->cmds[i];
+        size_t expanded_cap;
+        char *expanded;
+
+        if (crec->num_args == 0 || crec->num_args >= MSH_MAXARGS ||
+            crec->first_arg > c->h->num_args || crec->num_args > c->h->num_args - crec->first_arg) {
+            return NULL;
+        }
+        //the buffer arguments are expanded into is reused
+        expanded = cmd->expanded;
+        expanded_cap = cmd->expanded_cap;
+        memset(cmd, 0, sizeof(*cmd));
+        cmd->expanded = expanded;
+        cmd->expanded_cap = expanded_cap;
+        for (uint32_t j = 0; j < crec->num_args; j++) {
+            cmd->args[j] = view_string(c, c->args[crec->first_arg + j], &bad);
+            if (cmd->args[j] == NULL) {
+                bad = 1;
+            }
+        }
+        cmd->numberArgs = bad ? 0 : (int)crec->num_args;
+        cmd->program = cmd->args[0];
+        cmd->final = i == rec->num_commands - 1;
+        cmd->stdout_file = view_string(c, crec->stdout_file, &bad);
+        cmd->stderr_file = view_string(c, crec->stderr_file, &bad);
+        cmd->stdin_file = view_string(c, crec->stdin_file, &bad);
+        cmd->data = cmd->stdin_file;
+        cmd->here = view_string(c, crec->here, &bad);
+        cmd->here_doc = (int)crec->here_doc;
+        cmd->alloc = &c->a;
+        if (!bad && !view_templates(c, crec, cmd, c->tmpls[i])) {
+            bad = 1;
+        }
+        c->pipeline.commands[i] = cmd;
+        c->pipeline.num_commands = i + 1;
+    }
+    if (bad) {
+        return NULL;
+    }
+
+    return &c->pipeline;
+}
+
+void
+msh_compiled_close(struct msh_compiled *c)
+{
+    if (c == NULL) {
+        return;
+    }
+    view_release(c);
+    for (size_t i = 0; i < MSH_MAXCMNDS; i++) {
+        free(c->cmds[i].expanded);
+    }
+    munmap(c->map, c->size);
+    free(c);
+}
@@ -1,4 +1,5 @@
 #include <msh_parse.h>
+#include <msh_parse_internal.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
@@ -12,38 +13,100 @@
 struct msh_sequence {
 	struct msh_pipeline *pipelines[MSH_MAXCMNDS];
     size_t num_pipelines;
+    //where the pipelines and commands parsed into it come from
+    struct msh_allocator *alloc;
 };
 
-/**
- * A pipeline is a sequence of commands, separated by "|"s. The output
- * of a preceding command (before the "|") gets passed to the input of
- * the next (after the "|").
- */
-struct msh_pipeline {
-	struct msh_command *commands[MSH_MAXCMNDS];
-    size_t num_commands;
-    int background;
-    char *input;
-};
+static void *
+std_alloc(struct msh_allocator *a, size_t size)
+{
+    (void)a;
+    return malloc(size);
+}
 
-/**
- * Each command corresponds to either a program (in the `PATH`
- * environment variable, see `echo $PATH`), or a builtin command like
- * `cd`. Commands are passed arguments.
- */
-struct msh_command {
-	char *program;
-    char *args[MSH_MAXARGS];
-    int numberArgs;
-    int final;
-    void *data;
-    //function to free data
-    msh_free_data_fn_t fn;
-    //redirect output
-    char *stdout_file;
-    //redirect input
-    char *stderr_file;
-};
+static void
+std_free(struct msh_allocator *a, void *ptr, size_t size)
+{
+    (void)a;
+    (void)size;
+    free(ptr);
+}
+
+//malloc and free, used unless a sequence is given another allocator
+static struct msh_allocator std_allocator = { .alloc = std_alloc, .free = std_free, .reset = NULL };
+
+static char *
+alloc_strdup(struct msh_allocator *a, const char *str)
+{
+    size_t len = strlen(str) + 1;
+    char *copy = a->alloc(a, len);
+
+    if (copy != NULL) {
+        memcpy(copy, str, len);
+    }
+    return copy;
+}
+
+static void
+alloc_strfree(struct msh_allocator *a, char *str)
+{
+    if (str != NULL) {
+        a->free(a, str, strlen(str) + 1);
+    }
+}
+
+static void
+tmpl_free(struct msh_allocator *a, struct msh_template *t)
+{
+    alloc_strfree(a, t->raw);
+    a->free(a, t, sizeof(*t) + t->cap * sizeof(struct msh_segment));
+}
+
+//free a command and everything it holds
+static void
+cmnd_free(struct msh_command *c)
+{
+    struct msh_allocator *a = c->alloc;
+    struct msh_template *t, *next;
+
+    //a templated program is its first argument, templated arguments are owned by their template
+    if (!(c->templated & 1)) {
+        alloc_strfree(a, c->program);
+    }
+    for (int j = 0; j < c->numberArgs; j++) {
+        if (!(c->templated & (1u << j))) {
+            alloc_strfree(a, c->args[j]);
+        }
+    }
+    for (t = c->templates; t != NULL; t = next) {
+        next = t->next;
+        tmpl_free(a, t);
+    }
+    if (c->expanded != NULL) {
+        a->free(a, c->expanded, c->expanded_cap);
+    }
+    if (!(c->templated & (1u << TMPL_STDOUT))) {
+        alloc_strfree(a, c->stdout_file);
+    }
+    if (!(c->templated & (1u << TMPL_STDERR))) {
+        alloc_strfree(a, c->stderr_file);
+    }
+    if (!(c->templated & (1u << TMPL_HERE))) {
+        alloc_strfree(a, c->here);
+    }
+    if (!(c->templated & (1u << TMPL_STDIN))) {
+        alloc_strfree(a, c->stdin_file);
+    }
+    alloc_strfree(a, c->here_end);
+    if (c->here_body != NULL) {
+        a->free(a, c->here_body, c->here_cap);
+    }
+
+    if (c->data != NULL && c->fn != NULL) {
+        c->fn(c->data);
+    }
+    a->free(a, c, sizeof(struct msh_command));
+}
 
 void
 msh_pipeline_free(struct msh_pipeline *p)
@@ -52,21 +115,11 @@ msh_pipeline_free(struct msh_pipeline *p)
 	if(p != NULL) {
         //loop through and clear everything including the commands
 		for (size_t i = 0; i < p->num_commands; i++) {
-			free(p->commands[i]->program);
-			for (int j = 0; j < p->commands[i]->numberArgs; j++) {
-                    free(p->commands[i]->args[j]);
-            }
-            free(p->commands[i]->stdout_file);
-            free(p->commands[i]->stderr_file);
-
-            if(p->commands[i]->data != NULL && p->commands[i]->fn != NULL) {
-                p->commands[i]->fn(p->commands[i]->data);
-            }
-			free(p->commands[i]);
+			cmnd_free(p->commands[i]);
 		}
 
-        free(p->input);
-		free(p);
+        alloc_strfree(p->alloc, p->input);
+		p->alloc->free(p->alloc, p, sizeof(struct msh_pipeline));
 	}
 }
 
@@ -98,9 +151,45 @@ msh_sequence_alloc(void)
     //initialize
 	allocated->num_pipelines = 0;
 	memset(allocated->pipelines, 0, sizeof(allocated->pipelines));
+    allocated->alloc = &std_allocator;
 	return allocated;
 }
 
+void
+msh_sequence_allocator(struct msh_sequence *s, struct msh_allocator *a)
+{
+    if (s != NULL) {
+        s->alloc = a != NULL ? a : &std_allocator;
+    }
+}
+
+void
+msh_sequence_reset(struct msh_sequence *s)
+{
+    if (s == NULL) {
+        return;
+    }
+    //the allocator drops everything at once, only the client data needs freeing
+    if (s->alloc->reset != NULL) {
+        for (size_t i = 0; i < s->num_pipelines; i++) {
+            for (size_t j = 0; j < s->pipelines[i]->num_commands; j++) {
+                struct msh_command *c = s->pipelines[i]->commands[j];
+
+                if (c->data != NULL && c->fn != NULL) {
+                    c->fn(c->data);
+                }
+            }
+        }
+        s->alloc->reset(s->alloc);
+    } else {
+        for (size_t i = 0; i < s->num_pipelines; i++) {
+            msh_pipeline_free(s->pipelines[i]);
+        }
+    }
+	memset(s->pipelines, 0, sizeof(s->pipelines));
+    s->num_pipelines = 0;
+}
+
 /**
  * `msh_pipeline_input` returns the string used as input for the
  * pipeline. Most useful when printing out the "jobs" builtin command
@@ -119,9 +208,181 @@ msh_pipeline_input(struct msh_pipeline *p)
 	return p->input;
 }
 
-static int cmnd_parse(char *str, struct msh_command **command) {
+static int
+name_start(char ch)
+{
+    return isalpha((unsigned char)ch) || ch == '_';
+}
+
+static int
+name_char(char ch)
+{
+    return isalnum((unsigned char)ch) || ch == '_';
+}
+
+/*
+ * Inside a `$(...)` the separators are swapped for bytes the tokenizer
+ * doesn't split at, so the whole substitution stays in one argument.
+ * They're swapped back as soon as the argument is stored.
+ */
+static const char masked_from[] = " |;&";
+static const char masked_to[] = "\x01\x02\x03\x04";
+
+//mask the substitutions in str, -1 if one isn't closed
+static int
+subst_mask(char *str)
+{
+    size_t depth = 0;
+
+    for (char *s = str; *s != '\0'; s++) {
+        if (s[0] == '$' && s[1] == '(') {
+            depth++;
+            s++;
+        } else if (depth > 0 && *s == '(') {
+            depth++;
+        } else if (depth > 0 && *s == ')') {
+            depth--;
+        } else if (depth > 0) {
+            char *m = strchr(masked_from, *s);
+
+            if (m != NULL) {
+                *s = masked_to[m - masked_from];
+            }
+        }
+    }
+    return depth == 0 ? 0 : -1;
+}
+
+static void
+subst_unmask(char *str)
+{
+    for (char *s = str; s != NULL && *s != '\0'; s++) {
+        if (*s >= '\x01' && *s <= '\x04') {
+            *s = masked_from[*s - 1];
+        }
+    }
+}
+
+//the ')' closing the '(' at open, or 0
+static size_t
+subst_end(const char *str, size_t open)
+{
+    size_t depth = 0;
+
+    for (size_t i = open; str[i] != '\0'; i++) {
+        if (str[i] == '(') {
+            depth++;
+        } else if (str[i] == ')' && --depth == 0) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+//where a template's argument (or redirection) goes
+static char **
+cmnd_slot(struct msh_command *c, int arg)
+{
+    if (arg == TMPL_STDOUT) {
+        return &c->stdout_file;
+    } else if (arg == TMPL_STDERR) {
+        return &c->stderr_file;
+    } else if (arg == TMPL_HERE) {
+        return &c->here;
+    } else if (arg == TMPL_STDIN) {
+        return &c->stdin_file;
+    }
+    return &c->args[arg];
+}
+
+/*
+ * Split argument `arg` of the command into literals and variables. An
+ * argument without variables (a lone `$` is just a `$`) is left alone.
+ */
+static int
+cmnd_template(struct msh_command *c, int arg)
+{
+    struct msh_allocator *a = c->alloc;
+    char *raw = *cmnd_slot(c, arg);
+    size_t len = strlen(raw), cap = 1, n = 0, lit = 0, vars = 0, i = 0;
+    struct msh_template *t;
+
+    subst_unmask(raw);
+    //a literal and a variable per '$', and the literal after the last
+    for (char *d = strchr(raw, '$'); d != NULL; d = strchr(d + 1, '$')) {
+        cap += 2;
+    }
+    if (cap == 1) {
+        return 0;
+    }
+    t = a->alloc(a, sizeof(*t) + cap * sizeof(struct msh_segment));
+    if (t == NULL) {
+        return MSH_ERR_NOMEM;
+    }
+    t->segs = (struct msh_segment *)(t + 1);
+    while (i < len) {
+        size_t start = 0, nlen = 0, end = 0;
+
+        if (raw[i] == '$' && raw[i + 1] == '(') {
+            //a substitution is looked up as "(PIPELINE)"
+            size_t close = subst_end(raw, i + 1);
+
+            start = i + 1;
+            nlen = close != 0 ? close - i : 0;
+            end = close != 0 ? close + 1 : 0;
+        } else if (raw[i] == '$' && raw[i + 1] == '{') {
+            start = i + 2;
+            while (name_char(raw[start + nlen])) {
+                nlen++;
+            }
+            end = nlen > 0 && name_start(raw[start]) && raw[start + nlen] == '}' ? start + nlen + 1 : 0;
+        } else if (raw[i] == '$' && name_start(raw[i + 1])) {
+            start = i + 1;
+            while (name_char(raw[start + nlen])) {
+                nlen++;
+            }
+            end = start + nlen;
+        }
+        if (end == 0) {
+            i++;
+            continue;
+        }
+        if (i > lit) {
+            t->segs[n++] = (struct msh_segment) { .start = (unsigned int)lit, .len = (unsigned int)(i - lit) };
+        }
+        t->segs[n++] = (struct msh_segment) {
+            .start = (unsigned int)start, .len = (unsigned int)nlen,
+            .ref_start = (unsigned int)i, .ref_len = (unsigned int)(end - i), .var = 1,
+        };
+        vars++;
+        i = lit = end;
+    }
+    if (vars == 0) {
+        a->free(a, t, sizeof(*t) + cap * sizeof(struct msh_segment));
+        return 0;
+    }
+    if (len > lit) {
+        t->segs[n++] = (struct msh_segment) { .start = (unsigned int)lit, .len = (unsigned int)(len - lit) };
+    }
+    t->nsegs = n;
+    t->cap = cap;
+    t->arg = arg;
+    t->raw = raw;
+    t->next = c->templates;
+    c->templates = t;
+    c->templated |= 1u << arg;
+    //the program is always the first argument, expanded or not
+    if (arg == 0) {
+        alloc_strfree(a, c->program);
+        c->program = raw;
+    }
+
+    return 0;
+}
+
+static int cmnd_parse(char *str, struct msh_command **command, struct msh_allocator *a) {
     //string to follow through the command
-	struct msh_command *tempCommand = malloc(sizeof(struct msh_command));
+	struct msh_command *tempCommand = a->alloc(a, sizeof(struct msh_command));
     //null check
     if (tempCommand == NULL) {
         return MSH_ERR_NOMEM;
@@ -133,6 +394,7 @@ static int cmnd_parse(char *str, struct msh_command **command) {
     tempCommand->stderr_file = NULL;
     tempCommand->data = NULL;
     tempCommand->fn = NULL;
+    tempCommand->alloc = a;
 
     //counter/helper vairbales
     char *token;
@@ -142,31 +404,73 @@ static int cmnd_parse(char *str, struct msh_command **command) {
     //get first piece and check its not null
     token = strtok_r(str, " ", &saveptr);
     if (token == NULL) {
-        free(tempCommand);
+        cmnd_free(tempCommand);
         return MSH_ERR_NO_EXEC_PROG;
     }
 
     //set the first piece we just got as the program and null check
-    tempCommand->program = strdup(token);
+    tempCommand->program = alloc_strdup(a, token);
     if (tempCommand->program == NULL) {
-        free(tempCommand);
+        cmnd_free(tempCommand);
         return MSH_ERR_NOMEM;
     }
 
     //edge test case to make sure first is the name and null check after strdup
-    tempCommand->args[count] = strdup(tempCommand->program);
+    tempCommand->args[count] = alloc_strdup(a, tempCommand->program);
     if (tempCommand->args[count] == NULL) {
-        free(tempCommand->program);
-        for (size_t j = 0; j < count; j++) {
-            free(tempCommand->args[j]);
-        }
-        free(tempCommand);
+        cmnd_free(tempCommand);
         return MSH_ERR_NOMEM;
     }
     count++;
+    //so that cmnd_free sees the args stored so far
+    tempCommand->numberArgs = (int)count;
+    if (cmnd_template(tempCommand, 0) != 0) {
+        cmnd_free(tempCommand);
+        return MSH_ERR_NOMEM;
+    }
 
     //keep parsing all of the pieces
     while ((token = strtok_r(NULL, " ", &saveptr)) != NULL) {
+        if (strncmp(token, "<<", 2) == 0) {
+            //a here-string ("<<< WORD") or a here-document ("<< END"), the word can be attached
+            int doc = strncmp(token, "<<<", 3) != 0;
+            char *word = token[doc ? 2 : 3] != '\0' ? token + (doc ? 2 : 3) : strtok_r(NULL, " ", &saveptr);
+            size_t wlen;
+
+            if (word == NULL) {
+                cmnd_free(tempCommand);
+                return MSH_ERR_NO_REDIR_FILE;
+            }
+            //the standard input only comes from one place
+            if (tempCommand->data != NULL || tempCommand->here != NULL || tempCommand->here_end != NULL) {
+                cmnd_free(tempCommand);
+                return MSH_ERR_MULT_REDIRECTIONS;
+            }
+            tempCommand->here_doc = doc;
+            if (doc) {
+                //the body comes in the lines that follow, see msh_sequence_heredoc_line
+                tempCommand->here_end = alloc_strdup(a, word);
+                if (tempCommand->here_end == NULL) {
+                    cmnd_free(tempCommand);
+                    return MSH_ERR_NOMEM;
+                }
+                subst_unmask(tempCommand->here_end);
+                continue;
+            }
+            wlen = strlen(word);
+            tempCommand->here = a->alloc(a, wlen + 2);
+            if (tempCommand->here == NULL) {
+                cmnd_free(tempCommand);
+                return MSH_ERR_NOMEM;
+            }
+            memcpy(tempCommand->here, word, wlen);
+            memcpy(tempCommand->here + wlen, "\n", 2);
+            if (cmnd_template(tempCommand, TMPL_HERE) != 0) {
+                cmnd_free(tempCommand);
+                return MSH_ERR_NOMEM;
+            }
+            continue;
+        }
         if ((strcmp(token, "1>") == 0) || (strcmp(token, "1>>") == 0) ||
             (strcmp(token, "2>") == 0) || (strcmp(token, "2>>") == 0) || 
             (strcmp(token, ">") == 0) || (strcmp(token, ">>") == 0) ||
@@ -176,28 +480,22 @@ static int cmnd_parse(char *str, struct msh_command **command) {
             char *filename = strtok_r(NULL, " ", &saveptr);
             if (filename == NULL) {
                 //error qand free everything since there was no filename
-                for (size_t j = 0; j < count; j++) {
-                    free(tempCommand->args[j]);
-                }
-                free(tempCommand->program);
-                free(tempCommand);
+                cmnd_free(tempCommand);
                 return MSH_ERR_NO_REDIR_FILE;
             }
 
             if (strcmp(token, "<") == 0) {
-                //input redirection
-                //use data to store stdin filename
-                char *infile = strdup(filename);
-                if (!infile) {
-                    for (size_t j = 0; j < count; j++) {
-                        free(tempCommand->args[j]);
-                    }
-                    free(tempCommand->program);
-                    free(tempCommand);
+                if (tempCommand->here != NULL || tempCommand->here_end != NULL || tempCommand->stdin_file != NULL) {
+                    cmnd_free(tempCommand);
+                    return MSH_ERR_MULT_REDIRECTIONS;
+                }
+                //input redirection, templated like the others and lent out as the command's data
+                tempCommand->stdin_file = alloc_strdup(a, filename);
+                if (tempCommand->stdin_file == NULL || cmnd_template(tempCommand, TMPL_STDIN) != 0) {
+                    cmnd_free(tempCommand);
                     return MSH_ERR_NOMEM;
                 }
-                // put data into command->data
-                msh_command_putdata(tempCommand, infile, free);
+                msh_command_putdata(tempCommand, tempCommand->stdin_file, NULL);
                 continue;
             } 
             int fd;
@@ -222,11 +520,7 @@ static int cmnd_parse(char *str, struct msh_command **command) {
                 fd = 2;
                 append = 1;
             } else {
-                for (size_t j = 0; j < count; j++) {
-                    free(tempCommand->args[j]);
-                }
-                free(tempCommand->program);
-                free(tempCommand);
+                cmnd_free(tempCommand);
                 return MSH_ERR_SEQ_REDIR_OR_BACKGROUND_MISSING_CMD;
             }
 
@@ -234,25 +528,17 @@ static int cmnd_parse(char *str, struct msh_command **command) {
             //stdout handing
             char *filename_dup;
             if (append) {
-                filename_dup = malloc(strlen(filename) + 3);
+                filename_dup = a->alloc(a, strlen(filename) + 3);
                 if (!filename_dup) {
-                    for (size_t j = 0; j < count; j++) {
-                        free(tempCommand->args[j]);
-                    }
-                    free(tempCommand->program);
-                    free(tempCommand);
+                    cmnd_free(tempCommand);
                     return MSH_ERR_NOMEM;
                 }
                 strcpy(filename_dup, ">>");
                 strcat(filename_dup, filename);
             } else {
-                filename_dup = strdup(filename);
+                filename_dup = alloc_strdup(a, filename);
                 if (!filename_dup) {
-                    for (size_t j = 0; j < count; j++) {
-                        free(tempCommand->args[j]);
-                    }
-                    free(tempCommand->program);
-                    free(tempCommand);
+                    cmnd_free(tempCommand);
                     return MSH_ERR_NOMEM;
                 }
             }
@@ -260,52 +546,47 @@ static int cmnd_parse(char *str, struct msh_command **command) {
             if (fd == 1) {
                 //you are already handling one file so error for multiple redirections
                 if (tempCommand->stdout_file != NULL) {
-                    free(filename_dup);
-                    for (size_t j = 0; j < count; j++) {
-                        free(tempCommand->args[j]);
-                    }
-                    free(tempCommand->program);
-                    free(tempCommand->stdout_file);
-                    free(tempCommand);
+                    alloc_strfree(a, filename_dup);
+                    cmnd_free(tempCommand);
                     return MSH_ERR_MULT_REDIRECTIONS;
                 }
                 tempCommand->stdout_file = filename_dup;
+                if (cmnd_template(tempCommand, TMPL_STDOUT) != 0) {
+                    cmnd_free(tempCommand);
+                    return MSH_ERR_NOMEM;
+                }
             } else {
                 //you already redirected once so now theres an eror
                 if (tempCommand->stderr_file != NULL) {
-                    free(filename_dup);
-                    for (size_t j = 0; j < count; j++) {
-                        free(tempCommand->args[j]);
-                    }
-                    free(tempCommand->program);
-                    free(tempCommand->stderr_file);
-                    free(tempCommand);
+                    alloc_strfree(a, filename_dup);
+                    cmnd_free(tempCommand);
                     return MSH_ERR_MULT_REDIRECTIONS;
                 }
                 tempCommand->stderr_file = filename_dup;
+                if (cmnd_template(tempCommand, TMPL_STDERR) != 0) {
+                    cmnd_free(tempCommand);
+                    return MSH_ERR_NOMEM;
+                }
                 //normal argument
             } 
         } else {
             //have more args than we are allowed and free everything
             if (count >= MSH_MAXARGS) {
-                for (size_t j = 0; j < count; j++) {
-                    free(tempCommand->args[j]);
-                }
-                free(tempCommand->program);
-                free(tempCommand);
+                cmnd_free(tempCommand);
                 return MSH_ERR_TOO_MANY_ARGS;
             }
             //store the piece and make sure it allocated
-            tempCommand->args[count] = strdup(token);
+            tempCommand->args[count] = alloc_strdup(a, token);
             if (tempCommand->args[count] == NULL) {
-                for (size_t j = 0; j < count; j++) {
-                    free(tempCommand->args[j]);
-                }
-                free(tempCommand->program);
-                free(tempCommand);
+                cmnd_free(tempCommand);
                 return MSH_ERR_NOMEM;
             }
             count++;
+            tempCommand->numberArgs = (int)count;
+            if (cmnd_template(tempCommand, (int)count - 1) != 0) {
+                cmnd_free(tempCommand);
+                return MSH_ERR_NOMEM;
+            }
         }
     }
 
@@ -325,11 +606,18 @@ msh_sequence_parse(char *str, struct msh_sequence *seq)
 	if (str == NULL || seq == NULL) {
         return MSH_ERR_NOMEM;
     }
+    struct msh_allocator *a = seq->alloc;
     //get a helper string and make sure it allocated
-    char *tempString = strdup(str);
+    char *tempString = alloc_strdup(a, str);
     if (tempString == NULL) {
         return MSH_ERR_NOMEM;
     }
+    //strtok_r writes '\0's into it, so remember its size for the free
+    size_t tempSize = strlen(str) + 1;
+    if (subst_mask(tempString) != 0) {
+        a->free(a, tempString, tempSize);
+        return MSH_ERR_UNTERMINATED_SUBST;
+    }
 
     //splitting at the ;
     char *savePipeline;
@@ -355,36 +643,38 @@ msh_sequence_parse(char *str, struct msh_sequence *seq)
         
         //base case, theres no command
         if (len == 0) {
-            free(tempString);
+            a->free(a, tempString, tempSize);
             return MSH_ERR_PIPE_MISSING_CMD;
         //theres 2 | following one another, error
         } else if (token[0] == '|' || token[len - 1] == '|') {
-            free(tempString);
+            a->free(a, tempString, tempSize);
             return MSH_ERR_PIPE_MISSING_CMD;
         }
         for (size_t i = 0; i < len; i ++) {
             if (token[i] == '|' && token[i+1] == '|') {
-                free(tempString);
+                a->free(a, tempString, tempSize);
                 return MSH_ERR_PIPE_MISSING_CMD;
             }
         }
 
         //allocate a new pipeline and null check/startup
-        struct msh_pipeline *pipeline = malloc(sizeof(struct msh_pipeline));
+        struct msh_pipeline *pipeline = a->alloc(a, sizeof(struct msh_pipeline));
         if (pipeline == NULL) {
-            free(tempString);
+            a->free(a, tempString, tempSize);
             return MSH_ERR_NOMEM;
         }
         //initialize the pipeline
         memset(pipeline->commands, 0, sizeof(pipeline->commands));
         pipeline->num_commands = 0;
         pipeline->background = 0;
-        pipeline->input = strdup(token);
+        pipeline->alloc = a;
+        pipeline->input = alloc_strdup(a, token);
         if (pipeline->input == NULL) {
-            free(pipeline);
-            free(tempString);
+            a->free(a, pipeline, sizeof(struct msh_pipeline));
+            a->free(a, tempString, tempSize);
             return MSH_ERR_NOMEM;
         }
+        subst_unmask(pipeline->input);
 
         //check for & at the end of the pipeline
         if (len > 0 && token[len - 1] == '&') {
@@ -413,22 +703,22 @@ msh_sequence_parse(char *str, struct msh_sequence *seq)
             if (*command_str == '\0') {
                 // Free the current pipeline
                 msh_pipeline_free(pipeline);
-                free(tempString);
+                a->free(a, tempString, tempSize);
                 return MSH_ERR_PIPE_MISSING_CMD;
             }
             //make sure we dont have too many commands and free if we do
             if (pipeline->num_commands >= MSH_MAXCMNDS) {
                 msh_pipeline_free(pipeline);
-                free(tempString);
+                a->free(a, tempString, tempSize);
                 return MSH_ERR_TOO_MANY_CMDS;
             }
 
             //parse the command and call the helper method
             struct msh_command *cmd = NULL;
-            int parsed = cmnd_parse(command_str, &cmd);
+            int parsed = cmnd_parse(command_str, &cmd, a);
             if (parsed != 0) {
                 msh_pipeline_free(pipeline);
-                free(tempString);
+                a->free(a, tempString, tempSize);
                 return parsed;
             }
 
@@ -447,7 +737,7 @@ msh_sequence_parse(char *str, struct msh_sequence *seq)
         //check if we have too many pipelines
         if (seq->num_pipelines >= MSH_MAXCMNDS) {
             msh_pipeline_free(pipeline);
-            free(tempString);
+            a->free(a, tempString, tempSize);
             return MSH_ERR_TOO_MANY_CMDS;
         }
         //add the new pipeline to the sequence and increment
@@ -457,7 +747,7 @@ msh_sequence_parse(char *str, struct msh_sequence *seq)
         token = strtok_r(NULL, ";", &savePipeline);
     }
     //free what we allocated
-    free(tempString);
+    a->free(a, tempString, tempSize);
     return 0;
 
 }
@@ -484,6 +774,86 @@ msh_sequence_parse(char *str, struct msh_sequence *seq)
 	return 0;*/
 
 
+//the first command still waiting for the body of its here-document
+static struct msh_command *
+heredoc_pending(struct msh_sequence *s)
+{
+    for (size_t i = 0; s != NULL && i < s->num_pipelines; i++) {
+        for (size_t j = 0; j < s->pipelines[i]->num_commands; j++) {
+            if (s->pipelines[i]->commands[j]->here_end != NULL) {
+                return s->pipelines[i]->commands[j];
+            }
+        }
+    }
+    return NULL;
+}
+
+const char *
+msh_sequence_heredoc(struct msh_sequence *s)
+{
+    struct msh_command *c = heredoc_pending(s);
+
+    return c != NULL ? c->here_end : NULL;
+}
+
+msh_err_t
+msh_sequence_heredoc_line(struct msh_sequence *s, const char *line)
+{
+    struct msh_command *c = heredoc_pending(s);
+    struct msh_allocator *a;
+    size_t len;
+
+    if (c == NULL || line == NULL) {
+        return 0;
+    }
+    a = c->alloc;
+    len = strlen(line);
+    if (strcmp(line, c->here_end) != 0) {
+        //the body grows by doubling, a line at a time
+        if (c->here_len + len + 2 > c->here_cap) {
+            size_t cap = c->here_cap ? c->here_cap : 256;
+            char *grown;
+
+            while (cap < c->here_len + len + 2) {
+                cap *= 2;
+            }
+            grown = a->alloc(a, cap);
+            if (grown == NULL) {
+                return MSH_ERR_NOMEM;
+            }
+            if (c->here_body != NULL) {
+                memcpy(grown, c->here_body, c->here_len);
+                a->free(a, c->here_body, c->here_cap);
+            }
+            c->here_body = grown;
+            c->here_cap = cap;
+        }
+        memcpy(c->here_body + c->here_len, line, len);
+        c->here_len += len;
+        c->here_body[c->here_len++] = '\n';
+        return 0;
+    }
+
+    //the end, the body is kept at its exact size
+    c->here = a->alloc(a, c->here_len + 1);
+    if (c->here == NULL) {
+        return MSH_ERR_NOMEM;
+    }
+    if (c->here_len > 0) {
+        memcpy(c->here, c->here_body, c->here_len);
+    }
+    c->here[c->here_len] = '\0';
+    if (c->here_body != NULL) {
+        a->free(a, c->here_body, c->here_cap);
+    }
+    c->here_body = NULL;
+    c->here_len = c->here_cap = 0;
+    alloc_strfree(a, c->here_end);
+    c->here_end = NULL;
+
+    return cmnd_template(c, TMPL_HERE) != 0 ? MSH_ERR_NOMEM : 0;
+}
+
 /**
  * `msh_sequence_pipeline` dequeues the first pipeline in the sequence.
  *
@@ -581,6 +951,15 @@ msh_command_file_outputs(struct msh_command *c, char **stdout_file, char **stder
 }
 
 
+char *
+msh_command_here(struct msh_command *c, int *doc)
+{
+    if (doc != NULL) {
+        *doc = c != NULL ? c->here_doc : 0;
+    }
+    return c != NULL ? c->here : NULL;
+}
+
 char *
 msh_command_program(struct msh_command *c)
 {
@@ -603,6 +982,156 @@ msh_command_args(struct msh_command *c)
 	}
 }
 
+msh_err_t
+msh_command_shift(struct msh_command *c, size_t n)
+{
+    struct msh_template **tp;
+    char *program = NULL;
+
+    //there has to be something left to run
+    if (c == NULL || n >= (size_t)c->numberArgs) {
+        return MSH_ERR_NO_EXEC_PROG;
+    }
+    //a templated program stays its first argument
+    if (!(c->templated & (1u << n))) {
+        program = alloc_strdup(c->alloc, c->args[n]);
+        if (program == NULL) {
+            return MSH_ERR_NOMEM;
+        }
+    }
+    if (!(c->templated & 1)) {
+        alloc_strfree(c->alloc, c->program);
+    }
+
+    //free the dropped args (and their templates) and slide the rest down
+    for (size_t i = 0; i < n; i++) {
+        if (!(c->templated & (1u << i))) {
+            alloc_strfree(c->alloc, c->args[i]);
+        }
+    }
+    for (tp = &c->templates; *tp != NULL;) {
+        struct msh_template *t = *tp;
+
+        if ((size_t)t->arg < n) {
+            *tp = t->next;
+            tmpl_free(c->alloc, t);
+        } else {
+            if (t->arg < MSH_MAXARGS) {
+                t->arg -= (int)n;
+            }
+            tp = &t->next;
+        }
+    }
+    c->templated = ((c->templated & ~TMPL_REDIRS) >> n) | (c->templated & TMPL_REDIRS);
+    memmove(&c->args[0], &c->args[n], (c->numberArgs - n) * sizeof(char *));
+    c->numberArgs -= (int)n;
+    c->args[c->numberArgs] = NULL;
+    c->program = program != NULL ? program : c->args[0];
+
+    return 0;
+}
+
+//the length of a segment once expanded, and its text
+static size_t
+segment_value(struct msh_template *t, struct msh_segment *seg, msh_lookup_fn_t lookup, void *data,
+              const char **text)
+{
+    if (seg->var) {
+        *text = lookup(t->raw + seg->start, seg->len, data);
+        if (*text != NULL) {
+            return strlen(*text);
+        }
+        //unknown variables are left as they were written
+        *text = t->raw + seg->ref_start;
+        return seg->ref_len;
+    }
+    *text = t->raw + seg->start;
+    return seg->len;
+}
+
+//make room for need bytes in the expansion buffer, keeping the used ones
+static int
+expanded_reserve(struct msh_command *c, size_t used, size_t need)
+{
+    size_t cap = c->expanded_cap ? c->expanded_cap : 64;
+    char *grown;
+
+    if (need <= c->expanded_cap) {
+        return 0;
+    }
+    while (cap < need) {
+        cap *= 2;
+    }
+    grown = c->alloc->alloc(c->alloc, cap);
+    if (grown == NULL) {
+        return -1;
+    }
+    if (c->expanded != NULL) {
+        memcpy(grown, c->expanded, used);
+        c->alloc->free(c->alloc, c->expanded, c->expanded_cap);
+    }
+    c->expanded = grown;
+    c->expanded_cap = cap;
+
+    return 0;
+}
+
+msh_err_t
+msh_command_expand(struct msh_command *c, msh_lookup_fn_t lookup, void *data)
+{
+    size_t offsets[TMPL_SLOTS];
+    struct msh_template *t;
+    const char *text;
+    size_t pos = 0, k = 0;
+
+    if (c == NULL || c->templates == NULL) {
+        return 0;
+    }
+    //each variable is looked up once (a substitution runs a pipeline)
+    for (t = c->templates; t != NULL; t = t->next) {
+        offsets[k++] = pos;
+        for (size_t i = 0; i < t->nsegs; i++) {
+            size_t len = segment_value(t, &t->segs[i], lookup, data, &text);
+
+            if (expanded_reserve(c, pos, pos + len + 1) != 0) {
+                return MSH_ERR_NOMEM;
+            }
+            memcpy(c->expanded + pos, text, len);
+            pos += len;
+        }
+        if (expanded_reserve(c, pos, pos + 1) != 0) {
+            return MSH_ERR_NOMEM;
+        }
+        c->expanded[pos++] = '\0';
+    }
+    //the buffer may have moved, so the arguments are only pointed at it now
+    k = 0;
+    for (t = c->templates; t != NULL; t = t->next) {
+        *cmnd_slot(c, t->arg) = c->expanded + offsets[k++];
+    }
+    if (c->templated & 1) {
+        c->program = c->args[0];
+    }
+    if (c->templated & (1u << TMPL_STDIN)) {
+        c->data = c->stdin_file;
+    }
+
+    return 0;
+}
+
+msh_err_t
+msh_pipeline_expand(struct msh_pipeline *p, msh_lookup_fn_t lookup, void *data)
+{
+    for (size_t i = 0; p != NULL && i < p->num_commands; i++) {
+        msh_err_t err = msh_command_expand(p->commands[i], lookup, data);
+
+        if (err != 0) {
+            return err;
+        }
+    }
+    return 0;
+}
+
 /***
  * `msg_command_putdata` and `msh_command_getdata` are functions that
  * enable the shell to store some data for the command, and to
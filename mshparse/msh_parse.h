@@ -6,16 +6,89 @@
  * Parse a string which is a pipeline of commands into a set of
  * commands, along with information about where their standard in,
  * error, and out should be connected.
+ *
+ * The library keeps no global state: every function only touches the
+ * sequence, pipeline, or command it is given (and the input string it
+ * borrows). Different threads may use it at the same time as long as
+ * they use different sequences, which is what
+ * `msh_sequence_parse_batch` does.
  */
 
 #include <msh.h>
 
+/***
+ * Everything the parser creates for a sequence (its pipelines,
+ * commands, and their strings) comes from the sequence's allocator,
+ * `malloc` and `free` unless another one is installed. An allocator is
+ * a structure holding its functions, which a custom allocator embeds
+ * as its first member to find its own state:
+ *
+ * ```
+ * struct counting {
+ *     struct msh_allocator a;
+ *     size_t allocs;
+ * };
+ * void *counting_alloc(struct msh_allocator *a, size_t size) {
+ *     ((struct counting *)a)->allocs++;
+ *     return malloc(size);
+ * }
+ * ```
+ *
+ * An allocator is only used by one thread at a time. The file named
+ * by a `<` redirection is allocated with it like the rest, and lent
+ * out as the command's data (see `msh_command_putdata`).
+ */
+struct msh_allocator {
+    /* returns `size` bytes aligned for any type, or `NULL` */
+    void *(*alloc)(struct msh_allocator *a, size_t size);
+    /* frees `ptr`, which was allocated with `size` bytes */
+    void (*free)(struct msh_allocator *a, void *ptr, size_t size);
+    /* optional (`NULL` if not supported): frees everything at once */
+    void (*reset)(struct msh_allocator *a);
+};
+
 /**
  * `msh_sequence_alloc` simply allocates a sequence structure which is
  * effectively a queue.
  */
 struct msh_sequence *msh_sequence_alloc(void);
 
+/**
+ * `msh_sequence_allocator` installs the allocator that the pipelines
+ * parsed into `s` (and their commands) are allocated from. Pipelines
+ * already parsed keep using the allocator they came from.
+ *
+ * - `@s` - the sequence.
+ * - `@a` - the allocator, borrowed for as long as its pipelines live,
+ *     or `NULL` for `malloc` and `free`.
+ */
+void msh_sequence_allocator(struct msh_sequence *s, struct msh_allocator *a);
+
+/**
+ * `msh_sequence_reset` frees every pipeline still in the sequence. If
+ * its allocator supports `reset`, everything is dropped at once, which
+ * also frees the pipelines already dequeued from the sequence.
+ */
+void msh_sequence_reset(struct msh_sequence *s);
+
+/**
+ * `msh_pool_create` creates a pool allocator, meant for parsing many
+ * lines: freed pipelines, commands, and strings are kept on free lists
+ * by size class and reused, so that once warmed up, parsing a line
+ * allocates nothing from `parent`. Memory is only returned to `parent`
+ * by a reset (kept for reuse) or by `msh_pool_destroy`.
+ *
+ * - `@parent` - where the pool gets its memory, `NULL` for `malloc`.
+ * - `@return` - the pool, or `NULL` if out of memory.
+ */
+struct msh_allocator *msh_pool_create(struct msh_allocator *parent);
+
+/**
+ * `msh_pool_destroy` returns all of a pool's memory to its parent. No
+ * pipeline allocated from the pool may be used afterwards.
+ */
+void msh_pool_destroy(struct msh_allocator *pool);
+
 /**
  * `msh_pipeline_parse` takes the command string, parses it, and
  * inserts pipelines therein into the sequence queue.
@@ -28,6 +101,116 @@ struct msh_sequence *msh_sequence_alloc(void);
  */
 msh_err_t msh_sequence_parse(char *str, struct msh_sequence *s);
 
+/**
+ * `msh_sequence_parse_batch` parses many lines at once, spread over a
+ * pool of worker threads (the calling thread being one of them). Each
+ * line is parsed as by `msh_sequence_parse` into its own sequence.
+ *
+ * - `@lines` - the `num` lines, borrowed.
+ * - `@seqs` - the `num` sequences (from `msh_sequence_alloc`), one
+ *     per line, that the pipelines are queued into.
+ * - `@errs` - if not `NULL`, set to the result of parsing each line.
+ * - `@num` - the number of lines.
+ * - `@nthreads` - the number of threads to parse with, `0` for one
+ *     per online processor.
+ * - `@return` - the number of lines that did not parse.
+ */
+size_t msh_sequence_parse_batch(char **lines, struct msh_sequence **seqs, msh_err_t *errs, size_t num, size_t nthreads);
+
+/**
+ * `msh_sequence_heredoc` tells if a command parsed into the sequence
+ * is still waiting for the body of its here-document (`cat << END`).
+ * The lines after the one parsed are the body, up to the line holding
+ * just the end word, and whoever reads them feeds them to the sequence
+ * (with `msh_sequence_heredoc_line`) before dequeuing its pipelines.
+ *
+ * - `@s` - the sequence.
+ * - `@return` - the word ending the first here-document still being
+ *     read, borrowed, or `NULL` if there is none.
+ */
+const char *msh_sequence_heredoc(struct msh_sequence *s);
+
+/**
+ * `msh_sequence_heredoc_line` adds a line to the first here-document
+ * still being read, or ends it if the line is its end word.
+ *
+ * - `@s` - the sequence.
+ * - `@line` - the line, without its newline.
+ * - `@return` - `0` on success, or `MSH_ERR_NOMEM`.
+ */
+msh_err_t msh_sequence_heredoc_line(struct msh_sequence *s, const char *line);
+
+/***
+ * A script can be compiled ahead of time (`msh --compile`): every line
+ * is parsed, and the resulting pipelines, commands, arguments, and
+ * redirections are written out as a flat file that refers to its own
+ * contents by offset. Running the compiled script maps the file and
+ * reads the pipelines straight out of the mapping, so there is neither
+ * a parse nor an allocation per command.
+ *
+ * The compiled file records the version of its layout and the path,
+ * size, and modification time of the script it came from. When either
+ * doesn't match anymore, it is stale, and the script should be parsed
+ * again instead.
+ */
+
+/* the layout of compiled scripts, bumped whenever it changes */
+#define MSH_COMPILED_VERSION 4
+
+/**
+ * `msh_script_compile` parses the script at `src`, one sequence per
+ * line (blank lines and lines starting with `#` are skipped), and
+ * writes the compiled script to `out`.
+ *
+ * - `@src` - the path of the script.
+ * - `@out` - the path of the compiled script, replaced atomically.
+ * - `@line` - if the script doesn't parse, set to the (one-based)
+ *     line that doesn't, `0` otherwise.
+ * - `@return` - `0` on success, the parse error of `*line`, or
+ *     `MSH_ERR_NOMEM` if a file couldn't be read or written (`errno`
+ *     is set).
+ */
+msh_err_t msh_script_compile(const char *src, const char *out, size_t *line);
+
+struct msh_compiled;
+
+/**
+ * `msh_compiled_open` maps a compiled script.
+ *
+ * - `@path` - the compiled script.
+ * - `@source` - if the compiled script is stale, the path of the
+ *     script it was compiled from is copied here, to be run instead.
+ * - `@sz` - the size of `source`.
+ * - `@return` - the compiled script, or `NULL` with `errno` set to
+ *     `ENOEXEC` if `path` isn't a compiled script, `ESTALE` if it is
+ *     stale, `EINVAL` if it is corrupt, or as set by `open`/`mmap`.
+ */
+struct msh_compiled *msh_compiled_open(const char *path, char *source, size_t sz);
+
+/**
+ * `msh_compiled_count` returns the number of pipelines in the
+ * compiled script.
+ */
+size_t msh_compiled_count(struct msh_compiled *c);
+
+/**
+ * `msh_compiled_pipeline` makes the `nth` pipeline of the compiled
+ * script ready to be executed, its strings pointing into the mapping.
+ *
+ * - `@c` - the compiled script.
+ * - `@nth` - which pipeline, in script order.
+ * - `@return` - the pipeline, borrowed: it is reused for the next call,
+ *     and must not be passed to `msh_pipeline_free`. `NULL` if `nth`
+ *     is out of range or the pipeline is corrupt.
+ */
+struct msh_pipeline *msh_compiled_pipeline(struct msh_compiled *c, size_t nth);
+
+/**
+ * `msh_compiled_close` unmaps the compiled script; the last pipeline
+ * returned by `msh_compiled_pipeline` can no longer be used.
+ */
+void msh_compiled_close(struct msh_compiled *c);
+
 /**
  * `msh_sequence_free` deallocates the entire sequence, including all
  * constituent pipelines and commands. However, pipelines that have
@@ -110,6 +293,17 @@ int msh_command_final(struct msh_command *c);
  */
 void msh_command_file_outputs(struct msh_command *c, char **stdout, char **stderr);
 
+/**
+ * `msh_command_here` returns what the standard input of the command
+ * is, from a here-string (`<<< WORD`, the word and a newline) or a
+ * here-document.
+ *
+ * - `@c` - Command being queried.
+ * - `@doc` - if not `NULL`, set to `1` if it is a here-document.
+ * - `@return` - the bytes, borrowed, or `NULL` if there are none.
+ */
+char *msh_command_here(struct msh_command *c, int *doc);
+
 /**
  * `msh_command_program` retrieves the program to be executed for a
  * command.
@@ -131,6 +325,62 @@ char *msh_command_program(struct msh_command *c);
  */
 char **msh_command_args(struct msh_command *c);
 
+/**
+ * `msh_command_shift` drops the first `n` arguments of the command,
+ * making the next argument its program. Used by builtins that prefix
+ * another command (e.g. `bench -n 10 ls`).
+ *
+ * - `@c` - the command to modify.
+ * - `@n` - the number of leading arguments to drop.
+ * - `@return` - `0` on success, `MSH_ERR_NO_EXEC_PROG` if no argument
+ *     would be left to be the program (`c` is unchanged), or
+ *     `MSH_ERR_NOMEM`.
+ */
+msh_err_t msh_command_shift(struct msh_command *c, size_t n);
+
+/***
+ * Arguments may refer to variables, as `$NAME` or `${NAME}` (a name is
+ * a letter or `_` followed by letters, digits, and `_`s). Such an
+ * argument (or redirection target) is split into its literal text and
+ * its variables when it is parsed, also in compiled scripts, and the
+ * shell expands it, as often as it likes (e.g. on each
+ * iteration of a loop), by looking each variable up. Until expanded,
+ * arguments are as written.
+ *
+ * A command substitution, `$(PIPELINE)`, is kept whole (its spaces,
+ * `|`s, `;`s and `&`s don't split the line) and is looked up like a
+ * variable whose name is `(PIPELINE)`, parentheses included, for the
+ * shell to run it and return its output.
+ */
+
+/**
+ * `msh_lookup_fn_t` finds the value of the variable `name` (which is
+ * `len` characters, and *not* `NUL`-terminated), or returns `NULL` to
+ * leave the reference as it was written. Each reference is looked up
+ * once per expansion, and the value only has to last until `lookup`
+ * is next called.
+ */
+typedef const char *(*msh_lookup_fn_t)(const char *name, size_t len, void *data);
+
+/**
+ * `msh_command_expand` expands the variables in the command's
+ * arguments (and so maybe its program) and redirection targets. The expansions share a buffer
+ * kept with the command, so once it is large enough, expanding
+ * allocates nothing. Arguments from a previous expansion are replaced.
+ *
+ * - `@c` - the command to expand.
+ * - `@lookup` - finds the value of each variable.
+ * - `@data` - passed to `lookup`.
+ * - `@return` - `0` on success, or `MSH_ERR_NOMEM`.
+ */
+msh_err_t msh_command_expand(struct msh_command *c, msh_lookup_fn_t lookup, void *data);
+
+/**
+ * `msh_pipeline_expand` expands each of the pipeline's commands with
+ * `msh_command_expand`.
+ */
+msh_err_t msh_pipeline_expand(struct msh_pipeline *p, msh_lookup_fn_t lookup, void *data);
+
 /***
  * `msg_command_putdata` and `msh_command_getdata` are functions that
  * enable the shell to store some data for the command, and to
@@ -0,0 +1,87 @@
+#include <msh_parse.h>
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/* lines a worker claims at a time */
+#define MSH_BATCH_CHUNK 64
+/* never start more workers than this */
+#define MSH_BATCH_MAXTHREADS 64
+
+//the batch, shared by the workers
+struct batch {
+    char **lines;
+    struct msh_sequence **seqs;
+    msh_err_t *errs;
+    size_t num;
+    //the next line nobody has claimed yet
+    _Atomic size_t next;
+    _Atomic size_t failed;
+};
+
+static void *
+batch_worker(void *arg)
+{
+    struct batch *b = arg;
+    size_t failed = 0;
+
+    while (1) {
+        //claim a chunk, so that slow lines don't hold up a static split
+        size_t start = atomic_fetch_add(&b->next, MSH_BATCH_CHUNK);
+
+        if (start >= b->num) {
+            break;
+        }
+        for (size_t i = start; i < b->num && i < start + MSH_BATCH_CHUNK; i++) {
+            msh_err_t err = msh_sequence_parse(b->lines[i], b->seqs[i]);
+
+            if (b->errs != NULL) {
+                b->errs[i] = err;
+            }
+            if (err != 0) {
+                failed++;
+            }
+        }
+    }
+    atomic_fetch_add(&b->failed, failed);
+
+    return NULL;
+}
+
+size_t
+msh_sequence_parse_batch(char **lines, struct msh_sequence **seqs, msh_err_t *errs, size_t num, size_t nthreads)
+{
+    pthread_t workers[MSH_BATCH_MAXTHREADS];
+    struct batch b = { .lines = lines, .seqs = seqs, .errs = errs, .num = num };
+    size_t started = 0;
+
+    if (nthreads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+        nthreads = cpus > 0 ? (size_t)cpus : 1;
+    }
+    if (nthreads > MSH_BATCH_MAXTHREADS) {
+        nthreads = MSH_BATCH_MAXTHREADS;
+    }
+    //no point in workers without a chunk each
+    if (nthreads > (num + MSH_BATCH_CHUNK - 1) / MSH_BATCH_CHUNK) {
+        nthreads = (num + MSH_BATCH_CHUNK - 1) / MSH_BATCH_CHUNK;
+    }
+    atomic_init(&b.next, 0);
+    atomic_init(&b.failed, 0);
+
+    //the calling thread is a worker too
+    for (; started + 1 < nthreads; started++) {
+        if (pthread_create(&workers[started], NULL, batch_worker, &b) != 0) {
+            break;
+        }
+    }
+    batch_worker(&b);
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    return atomic_load(&b.failed);
+}
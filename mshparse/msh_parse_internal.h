@@ -0,0 +1,92 @@
+#pragma once
+
+#include <msh_parse.h>
+
+/***
+ * The layout of the parser's pipelines and commands, private to the
+ * library: `msh_parse.c` builds them, and `msh_compile.c` writes them
+ * out and loads them back in place. `msh_execute.c` reads them directly
+ * too, so this is the one definition everything shares.
+ */
+
+/**
+ * A pipeline is a sequence of commands, separated by "|"s. The output
+ * of a preceding command (before the "|") gets passed to the input of
+ * the next (after the "|").
+ */
+struct msh_pipeline {
+    struct msh_command *commands[MSH_MAXCMNDS];
+    size_t num_commands;
+    int background;
+    char *input;
+    struct msh_allocator *alloc;
+};
+
+/**
+ * Each command corresponds to either a program (in the `PATH`
+ * environment variable, see `echo $PATH`), or a builtin command like
+ * `cd`. Commands are passed arguments.
+ */
+struct msh_command {
+    char *program;
+    char *args[MSH_MAXARGS];
+    int numberArgs;
+    int final;
+    void *data;
+    //function to free data
+    msh_free_data_fn_t fn;
+    //redirect output
+    char *stdout_file;
+    //redirect input
+    char *stderr_file;
+    //the file read by "<", lent out as the command's data
+    char *stdin_file;
+    struct msh_allocator *alloc;
+    //the arguments (and redirections) with variables in them, and a bit for each
+    struct msh_template *templates;
+    unsigned int templated;
+    //where they are expanded to
+    char *expanded;
+    size_t expanded_cap;
+    //what its standard input is, from a here-string or a here-document
+    char *here;
+    int here_doc;
+    //the word ending the here-document, while its body is still being read
+    char *here_end;
+    char *here_body;
+    size_t here_len, here_cap;
+};
+
+//a part of an argument: literal text, or a variable
+struct msh_segment {
+    //the text, or the variable's name, in the argument as written
+    unsigned int start, len;
+    //the whole reference ("$NAME" or "${NAME}"), for variables
+    unsigned int ref_start, ref_len;
+    int var;
+};
+
+/**
+ * An argument with variables in it, split up when it is parsed so that
+ * it can be expanded any number of times without looking at it again.
+ */
+struct msh_template {
+    struct msh_template *next;
+    //the argument it expands into, or one of the TMPL_ redirections
+    int arg;
+    //the argument as written
+    char *raw;
+    size_t nsegs;
+    size_t cap;
+    //allocated right behind the template
+    struct msh_segment *segs;
+};
+
+//templates of the redirection targets come after the arguments'
+#define TMPL_STDOUT MSH_MAXARGS
+#define TMPL_STDERR (MSH_MAXARGS + 1)
+#define TMPL_HERE (MSH_MAXARGS + 2)
+#define TMPL_STDIN (MSH_MAXARGS + 3)
+#define TMPL_REDIRS (15u << MSH_MAXARGS)
+//templates a command can have at most
+#define TMPL_SLOTS (MSH_MAXARGS + 4)
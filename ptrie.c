@@ -0,0 +1,398 @@
+#include <ptrie.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* strings longer than this are only listed up to this length */
+#define PTRIE_MAXLEN 4096
+
+//a radix tree: each node holds the run of characters leading to it
+struct ptrie_node {
+    char *label;
+    unsigned int len;
+    struct ptrie_node *parent;
+    //children sorted by the first character of their label
+    struct ptrie_node **children;
+    unsigned int nchildren;
+    unsigned int cap;
+    //how many times the string ending here is in the trie
+    unsigned int count;
+    double score;
+    //the highest scored string at or below this node
+    struct ptrie_node *best;
+};
+
+struct ptrie {
+    struct ptrie_node root;
+};
+
+struct ptrie *
+ptrie_allocate(void)
+{
+    return calloc(1, sizeof(struct ptrie));
+}
+
+static void
+node_free(struct ptrie_node *n)
+{
+    for (unsigned int i = 0; i < n->nchildren; i++) {
+        node_free(n->children[i]);
+        free(n->children[i]);
+    }
+    free(n->children);
+    free(n->label);
+}
+
+void
+ptrie_free(struct ptrie *pt)
+{
+    if (pt == NULL) {
+        return;
+    }
+    node_free(&pt->root);
+    free(pt);
+}
+
+//binary search for the child starting with c, or where it would be inserted
+static unsigned int
+child_pos(struct ptrie_node *n, unsigned char c)
+{
+    unsigned int lo = 0, hi = n->nchildren;
+
+    while (lo < hi) {
+        unsigned int mid = (lo + hi) / 2;
+
+        if ((unsigned char)n->children[mid]->label[0] < c) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static struct ptrie_node *
+child_find(struct ptrie_node *n, unsigned char c)
+{
+    unsigned int pos = child_pos(n, c);
+
+    if (pos < n->nchildren && (unsigned char)n->children[pos]->label[0] == c) {
+        return n->children[pos];
+    }
+    return NULL;
+}
+
+static int
+child_insert(struct ptrie_node *n, unsigned int pos, struct ptrie_node *child)
+{
+    if (n->nchildren == n->cap) {
+        unsigned int cap = n->cap ? n->cap * 2 : 2;
+        struct ptrie_node **children = realloc(n->children, cap * sizeof(*children));
+
+        if (children == NULL) {
+            return -1;
+        }
+        n->children = children;
+        n->cap = cap;
+    }
+    memmove(&n->children[pos + 1], &n->children[pos], (n->nchildren - pos) * sizeof(*n->children));
+    n->children[pos] = child;
+    n->nchildren++;
+    child->parent = n;
+
+    return 0;
+}
+
+/*
+ * Split n's label after k characters, putting a new node above n. The
+ * node n itself stays where the strings ending in it point.
+ */
+static struct ptrie_node *
+split(struct ptrie_node *n, unsigned int k)
+{
+    struct ptrie_node *upper = calloc(1, sizeof(*upper));
+    char *rest = strdup(n->label + k);
+
+    if (upper == NULL || rest == NULL || (upper->label = strndup(n->label, k)) == NULL ||
+        (upper->children = malloc(2 * sizeof(*upper->children))) == NULL) {
+        if (upper) free(upper->label);
+        free(upper);
+        free(rest);
+        return NULL;
+    }
+    upper->len = k;
+    upper->cap = 2;
+    upper->nchildren = 1;
+    upper->children[0] = n;
+    upper->best = n->best;
+    upper->parent = n->parent;
+    //same first character, so the same place among the parent's children
+    upper->parent->children[child_pos(upper->parent, (unsigned char)upper->label[0])] = upper;
+
+    free(n->label);
+    n->label = rest;
+    n->len -= k;
+    n->parent = upper;
+
+    return upper;
+}
+
+//find the node for str, adding the nodes it needs
+static struct ptrie_node *
+node_insert(struct ptrie *pt, const char *str)
+{
+    struct ptrie_node *n = &pt->root;
+
+    while (*str != '\0') {
+        unsigned int pos = child_pos(n, (unsigned char)*str), k = 0;
+        struct ptrie_node *c;
+
+        if (pos == n->nchildren || n->children[pos]->label[0] != *str) {
+            //nothing shares the rest of the string, it all goes in a leaf
+            c = calloc(1, sizeof(*c));
+            if (c == NULL || (c->label = strdup(str)) == NULL || child_insert(n, pos, c) != 0) {
+                if (c) free(c->label);
+                free(c);
+                return NULL;
+            }
+            c->len = (unsigned int)strlen(str);
+            return c;
+        }
+        c = n->children[pos];
+        while (k < c->len && str[k] == c->label[k]) {
+            k++;
+        }
+        if (k < c->len && (c = split(c, k)) == NULL) {
+            return NULL;
+        }
+        n = c;
+        str += k;
+    }
+    return n;
+}
+
+//find the node for str, if it's in the tree
+static struct ptrie_node *
+node_find(struct ptrie *pt, const char *str)
+{
+    struct ptrie_node *n = &pt->root;
+
+    while (*str != '\0') {
+        n = child_find(n, (unsigned char)*str);
+        if (n == NULL || strncmp(n->label, str, n->len) != 0) {
+            return NULL;
+        }
+        str += n->len;
+    }
+    return n;
+}
+
+/*
+ * Find the highest node whose strings all start with prefix; the
+ * prefix may end inside its label. Its full string goes into buf.
+ */
+static struct ptrie_node *
+node_prefix(struct ptrie *pt, const char *prefix, char *buf, size_t *len)
+{
+    struct ptrie_node *n = &pt->root;
+    size_t plen = strlen(prefix);
+
+    *len = 0;
+    while (*len < plen) {
+        size_t rest = plen - *len;
+
+        n = child_find(n, (unsigned char)prefix[*len]);
+        if (n == NULL || *len + n->len >= PTRIE_MAXLEN ||
+            strncmp(n->label, prefix + *len, rest < n->len ? rest : n->len) != 0) {
+            return NULL;
+        }
+        memcpy(buf + *len, n->label, n->len);
+        *len += n->len;
+    }
+    return n;
+}
+
+//the string a node stands for, from the labels up to the root
+static int
+node_string(struct ptrie_node *n, char *buf, size_t sz)
+{
+    size_t len = 0;
+
+    //the root has no label
+    for (struct ptrie_node *p = n; p->parent != NULL; p = p->parent) {
+        len += p->len;
+    }
+    if (len + 1 > sz) {
+        return -1;
+    }
+    buf[len] = '\0';
+    for (struct ptrie_node *p = n; p->parent != NULL; p = p->parent) {
+        len -= p->len;
+        memcpy(buf + len, p->label, p->len);
+    }
+    return 0;
+}
+
+static int
+better(struct ptrie_node *a, struct ptrie_node *b)
+{
+    return a != NULL && (b == NULL || a->score > b->score);
+}
+
+//n's string was added or its score went up
+static void
+best_raise(struct ptrie_node *n)
+{
+    for (struct ptrie_node *p = n; p != NULL; p = p->parent) {
+        if (p->best == n) {
+            continue;
+        }
+        if (!better(n, p->best)) {
+            //and so nothing above does either
+            break;
+        }
+        p->best = n;
+    }
+}
+
+//n's string was removed or its score went down, look at everything again
+static void
+best_recompute(struct ptrie_node *n)
+{
+    for (struct ptrie_node *p = n; p != NULL; p = p->parent) {
+        struct ptrie_node *best = p->count > 0 ? p : NULL;
+
+        for (unsigned int i = 0; i < p->nchildren; i++) {
+            if (better(p->children[i]->best, best)) {
+                best = p->children[i]->best;
+            }
+        }
+        p->best = best;
+    }
+}
+
+int
+ptrie_add(struct ptrie *pt, const char *str)
+{
+    struct ptrie_node *n = node_insert(pt, str);
+
+    if (n == NULL) {
+        return -1;
+    }
+    n->count++;
+    best_raise(n);
+
+    return 0;
+}
+
+int
+ptrie_remove(struct ptrie *pt, const char *str)
+{
+    struct ptrie_node *n = node_find(pt, str);
+
+    if (n == NULL || n->count == 0) {
+        return -1;
+    }
+    //the nodes are kept: the string is likely to come back
+    n->count--;
+    if (n->count == 0) {
+        best_recompute(n);
+    }
+
+    return 0;
+}
+
+int
+ptrie_set_score(struct ptrie *pt, const char *str, double score)
+{
+    struct ptrie_node *n = node_find(pt, str);
+    double old;
+
+    if (n == NULL || n->count == 0) {
+        return -1;
+    }
+    old = n->score;
+    n->score = score;
+    if (score >= old) {
+        best_raise(n);
+    } else {
+        best_recompute(n);
+    }
+
+    return 0;
+}
+
+int
+ptrie_autocomplete(struct ptrie *pt, const char *prefix, char *buf, size_t sz)
+{
+    char path[PTRIE_MAXLEN];
+    size_t len;
+    struct ptrie_node *n = node_prefix(pt, prefix, path, &len);
+
+    if (n == NULL || n->best == NULL) {
+        return -1;
+    }
+    return node_string(n->best, buf, sz);
+}
+
+struct walk {
+    char buf[PTRIE_MAXLEN];
+    ptrie_visit_fn_t fn;
+    void *data;
+    size_t found;
+    size_t max;
+};
+
+//depth-first, so strings come out in lexicographic order
+static void
+walk_node(struct walk *w, struct ptrie_node *n, size_t len)
+{
+    if (n->count > 0) {
+        w->buf[len] = '\0';
+        w->fn(w->buf, w->data);
+        w->found++;
+    }
+    for (unsigned int i = 0; i < n->nchildren && w->found < w->max; i++) {
+        struct ptrie_node *c = n->children[i];
+
+        if (len + c->len >= PTRIE_MAXLEN) {
+            continue;
+        }
+        memcpy(w->buf + len, c->label, c->len);
+        walk_node(w, c, len + c->len);
+    }
+}
+
+size_t
+ptrie_complete(struct ptrie *pt, const char *prefix, ptrie_visit_fn_t fn, void *data, size_t max)
+{
+    struct walk w;
+    size_t len;
+    struct ptrie_node *n = node_prefix(pt, prefix, w.buf, &len);
+
+    if (n == NULL || max == 0) {
+        return 0;
+    }
+    w.fn = fn;
+    w.data = data;
+    w.found = 0;
+    w.max = max;
+    walk_node(&w, n, len);
+
+    return w.found;
+}
+
+static void
+print_one(const char *str, void *data)
+{
+    struct ptrie_node *n = node_find(data, str);
+
+    printf("%6u %s\n", n->count, str);
+}
+
+void
+ptrie_print(struct ptrie *pt)
+{
+    ptrie_complete(pt, "", print_one, pt, (size_t)-1);
+}
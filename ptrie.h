@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stddef.h>
+
+/***
+ * A prefix trie of strings, stored as a radix tree so that long
+ * strings with little in common cost a node each rather than a node
+ * per character. Each string is stored with a count of how many times
+ * it was added (minus how many times it was removed), and the strings
+ * sharing a prefix can be listed in lexicographic order by walking
+ * just the prefix's subtree. Strings can also carry a score: every
+ * node remembers the best scored string below it, so the best
+ * completion of a prefix is found without any search.
+ */
+
+struct ptrie;
+
+/**
+ * `ptrie_allocate` creates an empty trie, or returns `NULL` if out of
+ * memory.
+ */
+struct ptrie *ptrie_allocate(void);
+
+/**
+ * `ptrie_free` frees the trie and all of its strings.
+ */
+void ptrie_free(struct ptrie *pt);
+
+/**
+ * `ptrie_add` adds `str` to the trie, incrementing its count if it
+ * is already there.
+ *
+ * - `@return` - `0` on success, `-1` if out of memory.
+ */
+int ptrie_add(struct ptrie *pt, const char *str);
+
+/**
+ * `ptrie_remove` decrements the count of `str`; it is no longer in the
+ * trie once its count reaches zero.
+ *
+ * - `@return` - `0` on success, `-1` if `str` isn't in the trie.
+ */
+int ptrie_remove(struct ptrie *pt, const char *str);
+
+/**
+ * `ptrie_visit_fn_t` is called for each string found by
+ * `ptrie_complete`, with the string and the caller's `data`.
+ */
+typedef void (*ptrie_visit_fn_t)(const char *str, void *data);
+
+/**
+ * `ptrie_complete` lists the strings that start with `prefix`, in
+ * lexicographic order.
+ *
+ * - `@pt` - the trie to search.
+ * - `@prefix` - the prefix the strings must start with.
+ * - `@fn` - called for each string; the string is only valid during
+ *     the call.
+ * - `@data` - passed to `fn`.
+ * - `@max` - stop after this many strings.
+ * - `@return` - the number of strings passed to `fn`.
+ */
+size_t ptrie_complete(struct ptrie *pt, const char *prefix, ptrie_visit_fn_t fn, void *data, size_t max);
+
+/**
+ * `ptrie_set_score` sets the score of a string in the trie (strings
+ * start with a score of `0`). Raising a score costs `O(length)`,
+ * lowering one also looks at the siblings of each node on the way.
+ *
+ * - `@return` - `0` on success, `-1` if `str` isn't in the trie.
+ */
+int ptrie_set_score(struct ptrie *pt, const char *str, double score);
+
+/**
+ * `ptrie_autocomplete` finds the highest scored string starting with
+ * `prefix` (the earliest added one among equal scores).
+ *
+ * - `@pt` - the trie to search.
+ * - `@prefix` - the prefix the string must start with.
+ * - `@buf` - where the string is copied.
+ * - `@sz` - the size of `buf`.
+ * - `@return` - `0` on success, `-1` if no string (that fits in `buf`)
+ *     starts with `prefix`.
+ */
+int ptrie_autocomplete(struct ptrie *pt, const char *prefix, char *buf, size_t sz);
+
+/**
+ * `ptrie_print` prints every string and its count, for debugging.
+ */
+void ptrie_print(struct ptrie *pt);
@@ -0,0 +1,135 @@
+#include <sunit.h>
+#include <msh_parse.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define NLINES 2000
+
+static const char *shapes[] = {
+	"ls -l",
+	"cat file | grep x | wc -l",
+	"a ; b ; c &",
+	"prog 1> out 2>> err",
+	"ls | | x",
+	"| ls",
+};
+
+//the lines, and a serially parsed copy of each to compare against
+static char *lines[NLINES];
+static struct msh_sequence *seqs[NLINES], *serial[NLINES];
+static msh_err_t errs[NLINES];
+
+static void
+build(void)
+{
+	for (int i = 0; i < NLINES; i++) {
+		char buf[64];
+
+		snprintf(buf, sizeof(buf), "%s %d", shapes[i % 6], i);
+		lines[i] = strdup(buf);
+		seqs[i] = msh_sequence_alloc();
+		serial[i] = msh_sequence_alloc();
+	}
+}
+
+static void
+teardown(void)
+{
+	for (int i = 0; i < NLINES; i++) {
+		free(lines[i]);
+		msh_sequence_free(seqs[i]);
+		msh_sequence_free(serial[i]);
+	}
+}
+
+//both sequences hold the same pipelines, which are consumed
+static int
+same(struct msh_sequence *a, struct msh_sequence *b)
+{
+	struct msh_pipeline *p, *q;
+	int ok = 1;
+
+	while (ok && (p = msh_sequence_pipeline(a)) != NULL) {
+		q = msh_sequence_pipeline(b);
+		ok = q != NULL && strcmp(msh_pipeline_input(p), msh_pipeline_input(q)) == 0 &&
+			msh_pipeline_background(p) == msh_pipeline_background(q);
+		for (size_t i = 0; ok && msh_pipeline_command(p, i) != NULL; i++) {
+			char **x = msh_command_args(msh_pipeline_command(p, i));
+			char **y = msh_command_args(msh_pipeline_command(q, i));
+
+			for (; ok && (*x != NULL || *y != NULL); x++, y++) {
+				ok = *x != NULL && *y != NULL && strcmp(*x, *y) == 0;
+			}
+		}
+		msh_pipeline_free(p);
+		msh_pipeline_free(q);
+	}
+	return ok && msh_sequence_pipeline(b) == NULL;
+}
+
+static sunit_ret_t
+batch_threads(size_t nthreads)
+{
+	size_t failed, expected = 0;
+
+	build();
+	failed = msh_sequence_parse_batch(lines, seqs, errs, NLINES, nthreads);
+	for (int i = 0; i < NLINES; i++) {
+		msh_err_t err = msh_sequence_parse(lines[i], serial[i]);
+
+		SUNIT_ASSERT("same result as a serial parse", err == errs[i]);
+		if (err != 0) {
+			expected++;
+		} else {
+			SUNIT_ASSERT("same pipelines as a serial parse", same(seqs[i], serial[i]));
+		}
+	}
+	SUNIT_ASSERT("failed lines counted", failed == expected && expected == NLINES / 3);
+	teardown();
+
+	return SUNIT_SUCCESS;
+}
+
+sunit_ret_t
+batch_one(void)
+{
+	return batch_threads(1);
+}
+
+sunit_ret_t
+batch_many(void)
+{
+	return batch_threads(8);
+}
+
+sunit_ret_t
+batch_default(void)
+{
+	return batch_threads(0);
+}
+
+sunit_ret_t
+batch_empty(void)
+{
+	SUNIT_ASSERT("empty batch", msh_sequence_parse_batch(NULL, NULL, NULL, 0, 4) == 0);
+
+	return SUNIT_SUCCESS;
+}
+
+int
+main(void)
+{
+	struct sunit_test tests[] = {
+		SUNIT_TEST("batch parse, one thread", batch_one),
+		SUNIT_TEST("batch parse, eight threads", batch_many),
+		SUNIT_TEST("batch parse, a thread per processor", batch_default),
+		SUNIT_TEST("batch parse, no lines", batch_empty),
+		SUNIT_TEST_TERM
+	};
+
+	sunit_execute("Testing batch parsing", tests);
+
+	return 0;
+}
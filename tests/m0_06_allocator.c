@@ -0,0 +1,208 @@
+#include <sunit.h>
+#include <msh_parse.h>
+
+#include <string.h>
+#include <stdlib.h>
+
+//an allocator counting the calls and the bytes in use
+struct counting {
+	struct msh_allocator a;
+	size_t allocs;
+	size_t frees;
+	size_t bytes;
+};
+
+static void *
+counting_alloc(struct msh_allocator *a, size_t size)
+{
+	struct counting *c = (struct counting *)a;
+
+	c->allocs++;
+	c->bytes += size;
+	return malloc(size);
+}
+
+static void
+counting_free(struct msh_allocator *a, void *ptr, size_t size)
+{
+	struct counting *c = (struct counting *)a;
+
+	c->frees++;
+	c->bytes -= size;
+	free(ptr);
+}
+
+static void
+counting_init(struct counting *c)
+{
+	memset(c, 0, sizeof(*c));
+	c->a.alloc = counting_alloc;
+	c->a.free = counting_free;
+}
+
+//parse a line, then dequeue and free its pipelines
+static msh_err_t
+parse_and_free(struct msh_sequence *s, char *line)
+{
+	struct msh_pipeline *p;
+	msh_err_t err = msh_sequence_parse(line, s);
+
+	while ((p = msh_sequence_pipeline(s)) != NULL) {
+		msh_pipeline_free(p);
+	}
+	return err;
+}
+
+sunit_ret_t
+counts_per_parse(void)
+{
+	struct msh_sequence *s = msh_sequence_alloc();
+	struct counting c;
+
+	SUNIT_ASSERT("sequence allocation", s != NULL);
+	counting_init(&c);
+	msh_sequence_allocator(s, &c.a);
+
+	//the line copy, the pipeline and its input, the command, its program and 2 args
+	SUNIT_ASSERT("parse ls -l", parse_and_free(s, "ls -l") == 0);
+	SUNIT_ASSERT("7 allocations for ls -l", c.allocs == 7);
+	SUNIT_ASSERT("all freed", c.frees == c.allocs && c.bytes == 0);
+
+	//the line copy, plus per pipeline 2, per command 2 and one per arg or output file
+	c.allocs = c.frees = 0;
+	SUNIT_ASSERT("parse a sequence", parse_and_free(s, "cat f | grep x 1> out ; ls &") == 0);
+	SUNIT_ASSERT("17 allocations for the sequence", c.allocs == 17);
+	SUNIT_ASSERT("all freed", c.frees == c.allocs && c.bytes == 0);
+
+	msh_sequence_free(s);
+
+	return SUNIT_SUCCESS;
+}
+
+sunit_ret_t
+counts_on_error(void)
+{
+	struct msh_sequence *s = msh_sequence_alloc();
+	struct counting c;
+
+	SUNIT_ASSERT("sequence allocation", s != NULL);
+	counting_init(&c);
+	msh_sequence_allocator(s, &c.a);
+
+	SUNIT_ASSERT("two stdout redirections", parse_and_free(s, "ls 1> a 1> b") == MSH_ERR_MULT_REDIRECTIONS);
+	SUNIT_ASSERT("missing redirection file", parse_and_free(s, "ls 2>") == MSH_ERR_NO_REDIR_FILE);
+	SUNIT_ASSERT("missing command", parse_and_free(s, "ls | | x") == MSH_ERR_PIPE_MISSING_CMD);
+	SUNIT_ASSERT("nothing leaked on errors", c.allocs > 0 && c.frees == c.allocs && c.bytes == 0);
+
+	msh_sequence_free(s);
+
+	return SUNIT_SUCCESS;
+}
+
+sunit_ret_t
+pool_reuses(void)
+{
+	struct msh_sequence *s = msh_sequence_alloc();
+	struct msh_allocator *pool;
+	struct counting c;
+	size_t warm;
+
+	SUNIT_ASSERT("sequence allocation", s != NULL);
+	counting_init(&c);
+	pool = msh_pool_create(&c.a);
+	SUNIT_ASSERT("pool creation", pool != NULL);
+	msh_sequence_allocator(s, pool);
+
+	SUNIT_ASSERT("first parse", parse_and_free(s, "cat f | grep x 1> out ; ls &") == 0);
+	warm = c.allocs;
+	//the pool itself and one chunk
+	SUNIT_ASSERT("2 allocations to warm up", warm == 2);
+	for (int i = 0; i < 1000; i++) {
+		SUNIT_ASSERT("parse again", parse_and_free(s, "cat f | grep x 1> out ; ls &") == 0);
+	}
+	SUNIT_ASSERT("no allocations once warm", c.allocs == warm);
+
+	msh_sequence_free(s);
+	msh_pool_destroy(pool);
+	SUNIT_ASSERT("all returned to the parent", c.frees == c.allocs && c.bytes == 0);
+
+	return SUNIT_SUCCESS;
+}
+
+sunit_ret_t
+pool_reset(void)
+{
+	struct msh_sequence *s = msh_sequence_alloc();
+	struct msh_allocator *pool;
+	struct counting c;
+	char line[8192];
+	size_t warm, frees;
+
+	SUNIT_ASSERT("sequence allocation", s != NULL);
+	counting_init(&c);
+	pool = msh_pool_create(&c.a);
+	SUNIT_ASSERT("pool creation", pool != NULL);
+	msh_sequence_allocator(s, pool);
+
+	//a line too long for the size classes comes from the parent
+	memset(line, 'x', sizeof(line) - 1);
+	line[sizeof(line) - 1] = '\0';
+	memcpy(line, "ls ; ", 5);
+	SUNIT_ASSERT("parse", msh_sequence_parse(line, s) == 0);
+	warm = c.allocs;
+	frees = c.frees;
+	msh_sequence_reset(s);
+	SUNIT_ASSERT("sequence emptied", msh_sequence_pipeline(s) == NULL);
+	//the long input, program and arg go back to the parent, the chunk is kept
+	SUNIT_ASSERT("large objects freed on reset", c.frees == frees + 3);
+
+	SUNIT_ASSERT("parse after reset", msh_sequence_parse("ls -l ; pwd", s) == 0);
+	SUNIT_ASSERT("chunks reused after reset", c.allocs == warm);
+	msh_sequence_reset(s);
+
+	msh_sequence_free(s);
+	msh_pool_destroy(pool);
+	SUNIT_ASSERT("all returned to the parent", c.frees == c.allocs && c.bytes == 0);
+
+	return SUNIT_SUCCESS;
+}
+
+sunit_ret_t
+shift_uses_allocator(void)
+{
+	struct msh_sequence *s = msh_sequence_alloc();
+	struct msh_pipeline *p;
+	struct counting c;
+
+	SUNIT_ASSERT("sequence allocation", s != NULL);
+	counting_init(&c);
+	msh_sequence_allocator(s, &c.a);
+
+	SUNIT_ASSERT("parse", msh_sequence_parse("bench -n 10 ls -l", s) == 0);
+	p = msh_sequence_pipeline(s);
+	SUNIT_ASSERT("shift", msh_command_shift(msh_pipeline_command(p, 0), 3) == 0);
+	SUNIT_ASSERT("shifted program", strcmp(msh_command_program(msh_pipeline_command(p, 0)), "ls") == 0);
+	msh_pipeline_free(p);
+	SUNIT_ASSERT("all freed", c.frees == c.allocs && c.bytes == 0);
+
+	msh_sequence_free(s);
+
+	return SUNIT_SUCCESS;
+}
+
+int
+main(void)
+{
+	struct sunit_test tests[] = {
+		SUNIT_TEST("allocations per parse", counts_per_parse),
+		SUNIT_TEST("allocations on parse errors", counts_on_error),
+		SUNIT_TEST("pool reuses freed objects", pool_reuses),
+		SUNIT_TEST("pool reset", pool_reset),
+		SUNIT_TEST("shift uses the allocator", shift_uses_allocator),
+		SUNIT_TEST_TERM
+	};
+
+	sunit_execute("Testing parser allocators", tests);
+
+	return 0;
+}
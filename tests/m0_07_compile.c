@@ -0,0 +1,262 @@
+#define _DEFAULT_SOURCE
+
+#include <sunit.h>
+#include <msh_parse.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+static const char *script =
+	"# a comment\n"
+	"ls -l\n"
+	"\n"
+	"cat < in.txt | grep x | wc -l 1> out 2>> err\n"
+	"   \n"
+	"a ; b arg ; c &\n";
+
+//the pipelines of the script, in order
+static const char *lines[] = {
+	"ls -l",
+	"cat < in.txt | grep x | wc -l 1> out 2>> err",
+	"a ; b arg ; c &",
+};
+
+static char src[] = "/tmp/msh_compile_src_XXXXXX";
+static char out[sizeof(src) + 8];
+
+static void
+write_file(const char *path, const char *contents)
+{
+	FILE *f = fopen(path, "w");
+
+	fputs(contents, f);
+	fclose(f);
+}
+
+static void
+setup(const char *contents)
+{
+	int fd = mkstemp(src);
+
+	close(fd);
+	write_file(src, contents);
+	snprintf(out, sizeof(out), "%s.mshc", src);
+}
+
+static void
+teardown(void)
+{
+	unlink(src);
+	unlink(out);
+	strcpy(src, "/tmp/msh_compile_src_XXXXXX");
+}
+
+static int
+same_str(const char *a, const char *b)
+{
+	return (a == NULL && b == NULL) || (a != NULL && b != NULL && strcmp(a, b) == 0);
+}
+
+//the compiled pipeline matches a freshly parsed one
+static int
+same(struct msh_pipeline *p, struct msh_pipeline *q)
+{
+	struct msh_command *c, *d;
+	size_t i;
+
+	if (!same_str(msh_pipeline_input(p), msh_pipeline_input(q)) ||
+		msh_pipeline_background(p) != msh_pipeline_background(q)) {
+		return 0;
+	}
+	for (i = 0; (c = msh_pipeline_command(p, i)) != NULL; i++) {
+		char *o1, *e1, *o2, *e2;
+		char **x, **y;
+
+		d = msh_pipeline_command(q, i);
+		if (d == NULL || !same_str(msh_command_program(c), msh_command_program(d)) ||
+			msh_command_final(c) != msh_command_final(d) ||
+			!same_str(msh_command_getdata(c), msh_command_getdata(d))) {
+			return 0;
+		}
+		msh_command_file_outputs(c, &o1, &e1);
+		msh_command_file_outputs(d, &o2, &e2);
+		if (!same_str(o1, o2) || !same_str(e1, e2)) {
+			return 0;
+		}
+		for (x = msh_command_args(c), y = msh_command_args(d); *x != NULL || *y != NULL; x++, y++) {
+			if (!same_str(*x, *y)) {
+				return 0;
+			}
+		}
+	}
+	return msh_pipeline_command(q, i) == NULL;
+}
+
+sunit_ret_t
+compile_roundtrip(void)
+{
+	struct msh_compiled *c;
+	size_t line, n = 0;
+
+	setup(script);
+	SUNIT_ASSERT("compiles", msh_script_compile(src, out, &line) == 0 && line == 0);
+	c = msh_compiled_open(out, NULL, 0);
+	SUNIT_ASSERT("opens", c != NULL);
+	SUNIT_ASSERT("every pipeline, no comments or blank lines", msh_compiled_count(c) == 5);
+	for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+		struct msh_sequence *s = msh_sequence_alloc();
+		struct msh_pipeline *q;
+		char *str = strdup(lines[i]);
+
+		SUNIT_ASSERT("parses", msh_sequence_parse(str, s) == 0);
+		while ((q = msh_sequence_pipeline(s)) != NULL) {
+			struct msh_pipeline *p = msh_compiled_pipeline(c, n++);
+
+			SUNIT_ASSERT("same as parsed", p != NULL && same(p, q));
+			msh_pipeline_free(q);
+		}
+		msh_sequence_free(s);
+		free(str);
+	}
+	SUNIT_ASSERT("nothing past the end", msh_compiled_pipeline(c, n) == NULL);
+	msh_compiled_close(c);
+	teardown();
+
+	return SUNIT_SUCCESS;
+}
+
+sunit_ret_t
+compile_shift(void)
+{
+	struct msh_compiled *c;
+	struct msh_command *cmd;
+	size_t line;
+
+	setup("bench -n 3 ls -l\n");
+	SUNIT_ASSERT("compiles", msh_script_compile(src, out, &line) == 0);
+	c = msh_compiled_open(out, NULL, 0);
+	SUNIT_ASSERT("opens", c != NULL);
+	cmd = msh_pipeline_command(msh_compiled_pipeline(c, 0), 0);
+	SUNIT_ASSERT("shifts", msh_command_shift(cmd, 3) == 0);
+	SUNIT_ASSERT("shifted program", strcmp(msh_command_program(cmd), "ls") == 0);
+	SUNIT_ASSERT("shifted args", strcmp(msh_command_args(cmd)[1], "-l") == 0 && msh_command_args(cmd)[2] == NULL);
+	//the next use of the pipeline starts over from the mapping
+	cmd = msh_pipeline_command(msh_compiled_pipeline(c, 0), 0);
+	SUNIT_ASSERT("unshifted again", strcmp(msh_command_program(cmd), "bench") == 0);
+	msh_compiled_close(c);
+	teardown();
+
+	return SUNIT_SUCCESS;
+}
+
+//$d is /tmp, $f is x, nothing else is set
+static const char *
+lookup(const char *name, size_t len, void *data)
+{
+	(void)data;
+	if (len == 1 && name[0] == 'd') {
+		return "/tmp";
+	} else if (len == 1 && name[0] == 'f') {
+		return "x";
+	}
+	return NULL;
+}
+
+sunit_ret_t
+compile_templates(void)
+{
+	struct msh_compiled *c;
+	struct msh_command *cmd;
+	size_t line;
+	char *err;
+
+	setup("cat $d/${f}.txt 2>> $d/err | $f < $d/in\n");
+	SUNIT_ASSERT("compiles", msh_script_compile(src, out, &line) == 0);
+	c = msh_compiled_open(out, NULL, 0);
+	SUNIT_ASSERT("opens", c != NULL);
+	for (int i = 0; i < 2; i++) {
+		struct msh_pipeline *p = msh_compiled_pipeline(c, 0);
+
+		SUNIT_ASSERT("as written", strcmp(msh_command_args(msh_pipeline_command(p, 0))[1], "$d/${f}.txt") == 0);
+		SUNIT_ASSERT("expands", msh_pipeline_expand(p, lookup, NULL) == 0);
+		cmd = msh_pipeline_command(p, 0);
+		msh_command_file_outputs(cmd, NULL, &err);
+		SUNIT_ASSERT("expanded argument", strcmp(msh_command_args(cmd)[1], "/tmp/x.txt") == 0);
+		SUNIT_ASSERT("expanded redirection", strcmp(err, ">>/tmp/err") == 0);
+		SUNIT_ASSERT("expanded program", strcmp(msh_command_program(msh_pipeline_command(p, 1)), "x") == 0);
+		SUNIT_ASSERT("expanded input", strcmp(msh_command_getdata(msh_pipeline_command(p, 1)), "/tmp/in") == 0);
+	}
+	msh_compiled_close(c);
+	teardown();
+
+	return SUNIT_SUCCESS;
+}
+
+sunit_ret_t
+compile_errors(void)
+{
+	size_t line;
+
+	setup("ls\n# fine\nls | | x\nls\n");
+	SUNIT_ASSERT("parse error", msh_script_compile(src, out, &line) == MSH_ERR_PIPE_MISSING_CMD);
+	SUNIT_ASSERT("on its line", line == 3);
+	SUNIT_ASSERT("nothing written", access(out, F_OK) != 0);
+	SUNIT_ASSERT("missing script", msh_script_compile("/nonexistent/script", out, &line) == MSH_ERR_NOMEM && line == 0);
+	teardown();
+
+	return SUNIT_SUCCESS;
+}
+
+sunit_ret_t
+compile_stale(void)
+{
+	char source[4096], real[4096];
+	size_t line;
+	FILE *f;
+
+	setup("ls\n");
+	SUNIT_ASSERT("compiles", msh_script_compile(src, out, &line) == 0);
+	SUNIT_ASSERT("a script isn't compiled", msh_compiled_open(src, source, sizeof(source)) == NULL && errno == ENOEXEC);
+
+	write_file(src, "ls -l\n");
+	SUNIT_ASSERT("changed script", msh_compiled_open(out, source, sizeof(source)) == NULL && errno == ESTALE);
+	SUNIT_ASSERT("source to rerun", realpath(src, real) != NULL && strcmp(source, real) == 0);
+
+	//another version of the layout
+	SUNIT_ASSERT("recompiles", msh_script_compile(src, out, &line) == 0);
+	f = fopen(out, "r+");
+	fseek(f, 4, SEEK_SET);
+	fputc(0x7f, f);
+	fclose(f);
+	source[0] = '\0';
+	SUNIT_ASSERT("other version", msh_compiled_open(out, source, sizeof(source)) == NULL && errno == ESTALE);
+	SUNIT_ASSERT("source to rerun", strcmp(source, real) == 0);
+
+	//cut short
+	SUNIT_ASSERT("recompiles", msh_script_compile(src, out, &line) == 0);
+	SUNIT_ASSERT("truncates", truncate(out, 150) == 0);
+	SUNIT_ASSERT("corrupt", msh_compiled_open(out, source, sizeof(source)) == NULL && errno == EINVAL);
+	teardown();
+
+	return SUNIT_SUCCESS;
+}
+
+int
+main(void)
+{
+	struct sunit_test tests[] = {
+		SUNIT_TEST("compiled script matches the parse", compile_roundtrip),
+		SUNIT_TEST("compiled commands can be shifted", compile_shift),
+		SUNIT_TEST("compiled variables expand", compile_templates),
+		SUNIT_TEST("compile errors", compile_errors),
+		SUNIT_TEST("stale and corrupt compiled scripts", compile_stale),
+		SUNIT_TEST_TERM
+	};
+
+	sunit_execute("Testing compiled scripts", tests);
+
+	return 0;
+}
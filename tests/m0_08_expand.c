@@ -0,0 +1,258 @@
+#include <sunit.h>
+#include <msh_parse.h>
+
+#include <string.h>
+#include <stdlib.h>
+
+//an allocator counting the calls and the bytes in use
+struct counting {
+	struct msh_allocator a;
+	size_t allocs;
+	size_t bytes;
+};
+
+static void *
+counting_alloc(struct msh_allocator *a, size_t size)
+{
+	struct counting *c = (struct counting *)a;
+
+	c->allocs++;
+	c->bytes += size;
+	return malloc(size);
+}
+
+static void
+counting_free(struct msh_allocator *a, void *ptr, size_t size)
+{
+	struct counting *c = (struct counting *)a;
+
+	c->bytes -= size;
+	free(ptr);
+}
+
+//variables are given as "name=value" strings
+static const char *
+lookup(const char *name, size_t len, void *data)
+{
+	for (char **v = data; *v != NULL; v++) {
+		if (strncmp(*v, name, len) == 0 && (*v)[len] == '=') {
+			return *v + len + 1;
+		}
+	}
+	return NULL;
+}
+
+static struct msh_pipeline *
+parse(struct msh_sequence *s, const char *line)
+{
+	char *str = strdup(line);
+	struct msh_pipeline *p = NULL;
+
+	if (msh_sequence_parse(str, s) == 0) {
+		p = msh_sequence_pipeline(s);
+	}
+	free(str);
+	return p;
+}
+
+static int
+args_are(struct msh_command *c, const char **expected)
+{
+	char **args = msh_command_args(c);
+	size_t i;
+
+	for (i = 0; expected[i] != NULL; i++) {
+		if (args[i] == NULL || strcmp(args[i], expected[i]) != 0) {
+			return 0;
+		}
+	}
+	return args[i] == NULL;
+}
+
+sunit_ret_t
+expand_args(void)
+{
+	struct msh_sequence *s = msh_sequence_alloc();
+	struct msh_pipeline *p = parse(s, "echo $a-${b}x $ c$ ${} $unset $a$a 1> $a");
+	struct msh_command *c = msh_pipeline_command(p, 0);
+	char *vars[] = { "a=1", "b=two", NULL };
+	char *out;
+
+	SUNIT_ASSERT("parses", p != NULL);
+	SUNIT_ASSERT("as written until expanded",
+		     args_are(c, (const char *[]) { "echo", "$a-${b}x", "$", "c$", "${}", "$unset", "$a$a", NULL }));
+	SUNIT_ASSERT("expands", msh_pipeline_expand(p, lookup, vars) == 0);
+	SUNIT_ASSERT("expanded",
+		     args_are(c, (const char *[]) { "echo", "1-twox", "$", "c$", "${}", "$unset", "11", NULL }));
+	msh_command_file_outputs(c, &out, NULL);
+	SUNIT_ASSERT("expanded redirection", strcmp(out, "1") == 0);
+
+	vars[0] = "a=longer than before";
+	SUNIT_ASSERT("expands again", msh_pipeline_expand(p, lookup, vars) == 0);
+	SUNIT_ASSERT("expanded again", args_are(c, (const char *[]) { "echo", "longer than before-twox", "$", "c$", "${}",
+								 "$unset", "longer than beforelonger than before", NULL }));
+	msh_pipeline_free(p);
+	msh_sequence_free(s);
+
+	return SUNIT_SUCCESS;
+}
+
+sunit_ret_t
+expand_program(void)
+{
+	struct msh_sequence *s = msh_sequence_alloc();
+	struct msh_pipeline *p = parse(s, "do $prog -l $dir");
+	struct msh_command *c = msh_pipeline_command(p, 0);
+	char *vars[] = { "prog=ls", "dir=/tmp", NULL };
+
+	SUNIT_ASSERT("parses", p != NULL);
+	SUNIT_ASSERT("shifts", msh_command_shift(c, 1) == 0);
+	SUNIT_ASSERT("program as written", strcmp(msh_command_program(c), "$prog") == 0);
+	SUNIT_ASSERT("expands", msh_command_expand(c, lookup, vars) == 0);
+	SUNIT_ASSERT("program expanded", strcmp(msh_command_program(c), "ls") == 0);
+	SUNIT_ASSERT("args expanded", args_are(c, (const char *[]) { "ls", "-l", "/tmp", NULL }));
+	SUNIT_ASSERT("shifts again", msh_command_shift(c, 1) == 0);
+	SUNIT_ASSERT("literal program", strcmp(msh_command_program(c), "-l") == 0);
+	SUNIT_ASSERT("still expands", msh_command_expand(c, lookup, vars) == 0);
+	SUNIT_ASSERT("shifted args expanded", args_are(c, (const char *[]) { "-l", "/tmp", NULL }));
+	msh_pipeline_free(p);
+	msh_sequence_free(s);
+
+	return SUNIT_SUCCESS;
+}
+
+sunit_ret_t
+expand_no_allocs(void)
+{
+	struct msh_sequence *s = msh_sequence_alloc();
+	struct counting c = { .a = { .alloc = counting_alloc, .free = counting_free } };
+	struct msh_pipeline *p;
+	char *vars[] = { "i=0", "dir=/var/tmp", NULL };
+	char value[32];
+	size_t before;
+
+	msh_sequence_allocator(s, &c.a);
+	p = parse(s, "cat $dir/$i.log | grep ${i}x");
+	SUNIT_ASSERT("parses", p != NULL);
+	//the first expansion sizes the buffers
+	SUNIT_ASSERT("expands", msh_pipeline_expand(p, lookup, vars) == 0);
+	before = c.allocs;
+	for (int i = 0; i < 1000; i++) {
+		snprintf(value, sizeof(value), "i=%d", i % 10);
+		vars[0] = value;
+		SUNIT_ASSERT("expands", msh_pipeline_expand(p, lookup, vars) == 0);
+	}
+	SUNIT_ASSERT("no allocations once warm", c.allocs == before);
+	SUNIT_ASSERT("last expansion",
+		     args_are(msh_pipeline_command(p, 0), (const char *[]) { "cat", "/var/tmp/9.log", NULL }) &&
+		     args_are(msh_pipeline_command(p, 1), (const char *[]) { "grep", "9x", NULL }));
+	msh_pipeline_free(p);
+	SUNIT_ASSERT("everything freed", c.bytes == 0);
+	msh_sequence_free(s);
+
+	return SUNIT_SUCCESS;
+}
+
+//a substitution's name is its pipeline in parentheses
+static const char *
+subst_lookup(const char *name, size_t len, void *data)
+{
+	if (len == strlen(data) && strncmp(name, data, len) == 0) {
+		return "out";
+	}
+	return NULL;
+}
+
+sunit_ret_t
+expand_subst(void)
+{
+	struct msh_sequence *s = msh_sequence_alloc();
+	struct msh_pipeline *p = parse(s, "echo <$(ls -l | wc ; x &)> $(a) ; b");
+	struct msh_command *c = msh_pipeline_command(p, 0);
+	char *str;
+
+	SUNIT_ASSERT("parses", p != NULL);
+	SUNIT_ASSERT("one pipeline, one command", msh_pipeline_command(p, 1) == NULL && !msh_pipeline_background(p));
+	SUNIT_ASSERT("input as written", strcmp(msh_pipeline_input(p), "echo <$(ls -l | wc ; x &)> $(a)") == 0);
+	SUNIT_ASSERT("kept whole", args_are(c, (const char *[]) { "echo", "<$(ls -l | wc ; x &)>", "$(a)", NULL }));
+	SUNIT_ASSERT("expands", msh_command_expand(c, subst_lookup, "(ls -l | wc ; x &)") == 0);
+	SUNIT_ASSERT("substituted", args_are(c, (const char *[]) { "echo", "<out>", "$(a)", NULL }));
+	msh_pipeline_free(p);
+	p = msh_sequence_pipeline(s);
+	SUNIT_ASSERT("then the next pipeline", p != NULL && strcmp(msh_pipeline_input(p), "b") == 0);
+	msh_pipeline_free(p);
+
+	str = strdup("echo $(ls $(pwd) ; echo a");
+	SUNIT_ASSERT("unterminated", msh_sequence_parse(str, s) == MSH_ERR_UNTERMINATED_SUBST);
+	SUNIT_ASSERT("nothing parsed", msh_sequence_pipeline(s) == NULL);
+	free(str);
+	msh_sequence_free(s);
+
+	return SUNIT_SUCCESS;
+}
+
+sunit_ret_t
+expand_here(void)
+{
+	struct counting c = { .a = { .alloc = counting_alloc, .free = counting_free } };
+	struct msh_sequence *s = msh_sequence_alloc();
+	struct msh_pipeline *p;
+	char *vars[] = { "x=1", NULL };
+	char *str;
+	int doc;
+
+	msh_sequence_allocator(s, &c.a);
+	str = strdup("cat <<< a$x | cat << END ; b");
+	SUNIT_ASSERT("parses", msh_sequence_parse(str, s) == 0);
+	free(str);
+	SUNIT_ASSERT("waits for the body", msh_sequence_heredoc(s) != NULL && strcmp(msh_sequence_heredoc(s), "END") == 0);
+	SUNIT_ASSERT("a line", msh_sequence_heredoc_line(s, "one $x") == 0);
+	SUNIT_ASSERT("an empty line", msh_sequence_heredoc_line(s, "") == 0);
+	SUNIT_ASSERT("the end", msh_sequence_heredoc_line(s, "END") == 0);
+	SUNIT_ASSERT("nothing more to read", msh_sequence_heredoc(s) == NULL);
+
+	p = msh_sequence_pipeline(s);
+	SUNIT_ASSERT("expands", msh_pipeline_expand(p, lookup, vars) == 0);
+	str = msh_command_here(msh_pipeline_command(p, 0), &doc);
+	SUNIT_ASSERT("here-string", str != NULL && strcmp(str, "a1\n") == 0 && !doc);
+	str = msh_command_here(msh_pipeline_command(p, 1), &doc);
+	SUNIT_ASSERT("here-document", str != NULL && strcmp(str, "one 1\n\n") == 0 && doc);
+	msh_pipeline_free(p);
+	p = msh_sequence_pipeline(s);
+	SUNIT_ASSERT("no input", msh_command_here(msh_pipeline_command(p, 0), NULL) == NULL);
+	msh_pipeline_free(p);
+
+	str = strdup("cat < f <<< x");
+	SUNIT_ASSERT("one input only", msh_sequence_parse(str, s) == MSH_ERR_MULT_REDIRECTIONS);
+	free(str);
+	str = strdup("cat <<");
+	SUNIT_ASSERT("needs its end", msh_sequence_parse(str, s) == MSH_ERR_NO_REDIR_FILE);
+	free(str);
+	//one still being read is freed with its sequence
+	str = strdup("cat <<END");
+	SUNIT_ASSERT("attached end", msh_sequence_parse(str, s) == 0 && strcmp(msh_sequence_heredoc(s), "END") == 0);
+	free(str);
+	SUNIT_ASSERT("a line", msh_sequence_heredoc_line(s, "unfinished") == 0);
+	msh_sequence_reset(s);
+	SUNIT_ASSERT("everything freed", c.bytes == 0);
+	msh_sequence_free(s);
+
+	return SUNIT_SUCCESS;
+}
+
+int
+main(void)
+{
+	struct sunit_test tests[] = {
+		SUNIT_TEST("variables in arguments", expand_args),
+		SUNIT_TEST("variables in the program, shifted", expand_program),
+		SUNIT_TEST("expanding again allocates nothing", expand_no_allocs),
+		SUNIT_TEST("command substitution", expand_subst),
+		SUNIT_TEST("here-strings and here-documents", expand_here),
+		SUNIT_TEST_TERM
+	};
+
+	sunit_execute("Testing variable expansion", tests);
+
+	return 0;
+}
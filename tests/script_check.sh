@@ -0,0 +1,109 @@
+#!/bin/sh
+
+# scripts run every line in order, compiled or not, and stop at a line
+# that doesn't parse
+SCRIPT=script_check.msh
+
+check() {
+    if [ "$2" = "$3" ]
+    then
+        echo "SUCCESS on script: $1"
+    else
+        echo "FAILURE on script: $1"
+        echo "--- got:"
+        echo "$2"
+        echo "--- expected:"
+        echo "$3"
+    fi
+}
+
+# far longer than the queue between the reader and the shell
+awk 'BEGIN {
+    print "# generated"
+    for (i = 0; i < 5000; i++) {
+        if (i % 1000 == 0) print "echo " i " | cat"; else print "cd ."
+        if (i % 7 == 0) print ""
+    }
+}' > $SCRIPT
+EXPECTED=`printf '0\n1000\n2000\n3000\n4000'`
+check "long script" "`./msh $SCRIPT`" "$EXPECTED"
+
+./msh --compile $SCRIPT -o $SCRIPT.c
+check "compiled script" "`./msh $SCRIPT.c`" "$EXPECTED"
+
+printf 'echo a ; echo b\nls | | x\necho c\n' > $SCRIPT
+check "parse error" "`./msh $SCRIPT`" "`printf 'a\nb\nMSH Error: Pipe with missing command'`"
+check "stale compiled script" "`./msh $SCRIPT.c`" "`printf 'a\nb\nMSH Error: Pipe with missing command'`"
+./msh $SCRIPT > /dev/null
+check "parse error status" "$?" "1"
+
+# variables come from the environment too, and expand in compiled scripts
+printf 'X=${MSH_CHECK}2\necho $MSH_CHECK $X\n' > $SCRIPT
+./msh --compile $SCRIPT -o $SCRIPT.c
+check "variables" "`MSH_CHECK=1 ./msh $SCRIPT`" "1 12"
+check "compiled variables" "`MSH_CHECK=1 ./msh $SCRIPT.c`" "1 12"
+
+# a here-document's body is the lines up to its end word, kept as they are
+printf 'X=v\ncat << END | wc -l\n# $X\n\nEND\ntr a-z A-Z <<< $X\n' > $SCRIPT
+./msh --compile $SCRIPT -o $SCRIPT.c
+check "here-documents" "`./msh $SCRIPT`" "`printf '2\nV'`"
+check "compiled here-documents" "`./msh $SCRIPT.c`" "`printf '2\nV'`"
+
+# the same pattern in another directory, with the same modification time
+GLOB=`mktemp -d`
+mkdir $GLOB/a $GLOB/b
+touch $GLOB/a/one.c $GLOB/b/two.c
+touch -d 2020-01-01 $GLOB/a $GLOB/b
+printf 'cd %s/a ; echo *.c ; cd ../b ; echo *.c\n' $GLOB > $SCRIPT
+check "glob after cd" "`./msh $SCRIPT`" "`printf 'one.c\ntwo.c'`"
+rm -rf $GLOB
+
+# a memoized pipeline is replayed until a file it reads changes
+MEMO=`mktemp -d`
+printf 'memo date +%%N\nmemo date +%%N\n' > $SCRIPT
+check "memo replays" "`MSH_MEMO_DIR=$MEMO ./msh $SCRIPT | uniq | wc -l`" "1"
+echo one > $MEMO/input
+printf 'memo cat %s\n' $MEMO/input > $SCRIPT
+MSH_MEMO_DIR=$MEMO ./msh $SCRIPT > /dev/null
+echo two > $MEMO/input
+check "memo sees changed inputs" "`MSH_MEMO_DIR=$MEMO ./msh $SCRIPT`" "two"
+printf '#!/bin/sh\ndate +%%N\nsleep 5\n' > $MEMO/slow
+chmod +x $MEMO/slow
+printf 'memo timeout 0.2 %s\nmemo timeout 0.2 %s\n' $MEMO/slow $MEMO/slow > $SCRIPT
+check "memo skips interrupted runs" "`MSH_MEMO_DIR=$MEMO ./msh $SCRIPT | uniq | wc -l`" "2"
+printf '#!/bin/sh\ndate +%%N\nexit 3\n' > $MEMO/fail
+chmod +x $MEMO/fail
+printf 'memo %s\nmemo %s\n' $MEMO/fail $MEMO/fail > $SCRIPT
+check "memo keeps failed runs" "`MSH_MEMO_DIR=$MEMO ./msh $SCRIPT | uniq | wc -l`" "1"
+printf 'memo echo one\nmemo echo two\nmemo echo three\n' > $SCRIPT
+mkdir $MEMO/small
+MSH_MEMO_DIR=$MEMO/small MSH_MEMO_SIZE=50 ./msh $SCRIPT > /dev/null
+check "memo stays within budget" "`ls $MEMO/small | grep -c '^[0-9a-f]*$'`" "1"
+rm -rf $MEMO
+
+# update skips a pipeline whose output is newer than its inputs
+UPDATE=`mktemp -d`
+echo one > $UPDATE/in
+printf 'update cat %s > %s\n' $UPDATE/in $UPDATE/out > $SCRIPT
+./msh $SCRIPT
+echo kept > $UPDATE/out
+check "update skips" "`./msh $SCRIPT; cat $UPDATE/out`" "kept"
+touch -d @`expr \`date +%s\` + 60` $UPDATE/in
+check "update runs when stale" "`./msh $SCRIPT; cat $UPDATE/out`" "one"
+rm -rf $UPDATE
+
+# a pipeline past its deadline is terminated, and jobs reports it
+printf 'timeout 0.2 sleep 5\necho ended\n' > $SCRIPT
+check "timeout" "`timeout 3 ./msh $SCRIPT`" "ended"
+printf 'sleep 5 &\nsleep 0.5\njobs\n' > $SCRIPT
+check "default timeout" "`MSH_TIMEOUT=0.2 timeout 3 ./msh $SCRIPT | grep timed`" "[-] sleep 5 (timed out)"
+
+# builtins in a substitution don't change the shell running it
+printf 'echo $(cd /)\npwd\n' > $SCRIPT
+check "cd in a substitution" "`./msh $SCRIPT`" "
+`pwd`"
+printf 'echo a$(exit)b\necho after\n' > $SCRIPT
+check "exit in a substitution" "`./msh $SCRIPT`" "ab
+after"
+
+rm -f $SCRIPT $SCRIPT.c
@@ -0,0 +1,37 @@
+#!/bin/sh
+
+# the time from main to the first prompt must stay within the budget (us)
+BUDGET=${MSH_STARTUP_BUDGET_US:-1000}
+BEST=""
+
+# an interactive start, on a terminal and with a long history to load
+HISTORY=`mktemp`
+awk 'BEGIN { for (i = 0; i < 60000; i++) print "echo line " i }' > $HISTORY
+
+profile() {
+    if command -v script > /dev/null
+    then
+        echo "" | MSH_HISTFILE=$HISTORY script -qec "./msh --startup-profile" /dev/null | tr -d '\r'
+    else
+        echo "" | MSH_HISTFILE=$HISTORY ./msh --startup-profile 2>&1 >/dev/null
+    fi
+}
+
+# the best of a few runs, so a busy machine doesn't fail the check
+for RUN in 1 2 3 4 5
+do
+    TOTAL=`profile | awk '$2 == "total" { printf "%d", $3 }'`
+    if [ -n "$TOTAL" ] && { [ -z "$BEST" ] || [ "$TOTAL" -lt "$BEST" ]; }; then
+        BEST=$TOTAL
+    fi
+done
+
+if [ -n "$BEST" ] && [ "$BEST" -le "$BUDGET" ]
+then
+    echo "SUCCESS on startup budget: ${BEST}us <= ${BUDGET}us"
+else
+    echo "FAILURE on startup budget: ${BEST}us > ${BUDGET}us"
+    echo "---"
+    profile
+fi
+rm -f $HISTORY
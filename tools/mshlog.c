@@ -0,0 +1,107 @@
+#include <msh_log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+/**
+ * `mshlog [FILE]` converts an execution log written by msh (see
+ * `MSH_EXECLOG`) into JSON lines on the standard output, one object
+ * per pipeline. It reads the standard input if no file is given.
+ */
+
+static void
+print_json_string(const char *s, size_t len)
+{
+    putchar('"');
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+
+        if (c == '"' || c == '\\') {
+            printf("\\%c", c);
+        } else if (c < 0x20) {
+            printf("\\u%04x", c);
+        } else {
+            putchar(c);
+        }
+    }
+    putchar('"');
+}
+
+static void
+print_stage(struct msh_log_stage *st)
+{
+    printf("{\"pid\":%d,\"status\":%d,", st->pid, st->status);
+    if (WIFEXITED(st->status)) {
+        printf("\"exit\":%d,", WEXITSTATUS(st->status));
+    } else if (WIFSIGNALED(st->status)) {
+        printf("\"signal\":%d,", WTERMSIG(st->status));
+    }
+    printf("\"utime_us\":%lld,\"stime_us\":%lld,\"maxrss_kb\":%lld,"
+           "\"minflt\":%lld,\"majflt\":%lld,\"nvcsw\":%lld,\"nivcsw\":%lld}",
+           (long long)st->utime_us, (long long)st->stime_us, (long long)st->maxrss_kb,
+           (long long)st->minflt, (long long)st->majflt, (long long)st->nvcsw, (long long)st->nivcsw);
+}
+
+int
+main(int argc, char *argv[])
+{
+    char magic[MSH_LOG_MAGICLEN];
+    struct msh_log_record rec;
+    char *buf = NULL;
+    size_t cap = 0;
+    FILE *f = stdin;
+
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [FILE]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (argc == 2 && (f = fopen(argv[1], "r")) == NULL) {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+    if (fread(magic, 1, sizeof(magic), f) != sizeof(magic) || memcmp(magic, MSH_LOG_MAGIC, sizeof(magic)) != 0) {
+        fprintf(stderr, "%s: not an msh execution log\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    while (fread(&rec, sizeof(rec), 1, f) == 1) {
+        size_t body = rec.len - sizeof(rec);
+        size_t stages_len = rec.num_stages * sizeof(struct msh_log_stage);
+
+        if (rec.len < sizeof(rec) || stages_len + rec.input_len > body) {
+            fprintf(stderr, "%s: corrupt record\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        if (body > cap) {
+            cap = body;
+            buf = realloc(buf, cap);
+            if (buf == NULL) {
+                perror("realloc");
+                return EXIT_FAILURE;
+            }
+        }
+        if (fread(buf, 1, body, f) != body) {
+            fprintf(stderr, "%s: truncated record\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        printf("{\"start_ns\":%lld,\"end_ns\":%lld,\"input\":", (long long)rec.start_ns, (long long)rec.end_ns);
+        print_json_string(buf + stages_len, rec.input_len);
+        printf(",\"stages\":[");
+        for (size_t i = 0; i < rec.num_stages; i++) {
+            struct msh_log_stage st;
+
+            //the stages aren't necessarily aligned in buf
+            memcpy(&st, buf + i * sizeof(st), sizeof(st));
+            if (i > 0) putchar(',');
+            print_stage(&st);
+        }
+        printf("]}\n");
+    }
+    free(buf);
+    if (f != stdin) fclose(f);
+
+    return 0;
+}
@@ -0,0 +1,223 @@
+#define _GNU_SOURCE
+
+#include <msh_shm.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+
+/**
+ * `mshtop [-1] [-d MS]` shows the jobs of every running msh. The
+ * shells' job tables are mapped from `/dev/shm`, which is only looked
+ * at again when inotify reports a region created or removed there. A
+ * refresh otherwise only reads the mappings (no system calls) and
+ * redraws the screen; a shell that has exited cleared its magic.
+ *
+ * - `-1` - print the jobs once and exit.
+ * - `-d MS` - refresh every `MS` milliseconds (default 1000).
+ */
+
+#define MSHTOP_MAXSHELLS 64
+
+struct shell {
+    struct msh_shm *region;
+    //from the region's name, the region itself may not be filled in yet
+    pid_t pid;
+    //still in /dev/shm, as of the last scan
+    int listed;
+};
+
+static struct shell shells[MSHTOP_MAXSHELLS];
+static size_t num_shells = 0;
+
+static struct shell *
+shell_find(pid_t pid)
+{
+    for (size_t i = 0; i < num_shells; i++) {
+        if (shells[i].pid == pid) {
+            return &shells[i];
+        }
+    }
+    return NULL;
+}
+
+//map the job table of each shell new to /dev/shm, and unmap those no longer there
+static void
+scan_shells(void)
+{
+    DIR *dir = opendir("/dev/shm");
+    struct dirent *d;
+
+    if (dir == NULL) {
+        perror("/dev/shm");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < num_shells; i++) {
+        shells[i].listed = 0;
+    }
+    while ((d = readdir(dir)) != NULL) {
+        char name[300];
+        struct shell *sh;
+        struct msh_shm *m;
+        pid_t pid;
+        int fd;
+
+        if (strncmp(d->d_name, MSH_SHM_PREFIX + 1, strlen(MSH_SHM_PREFIX) - 1) != 0) {
+            continue;
+        }
+        pid = (pid_t)strtol(d->d_name + strlen(MSH_SHM_PREFIX) - 1, NULL, 10);
+        if ((sh = shell_find(pid)) != NULL) {
+            sh->listed = 1;
+            continue;
+        }
+        //a region left behind by a shell that crashed, it never clears its magic
+        if (num_shells == MSHTOP_MAXSHELLS || (kill(pid, 0) == -1 && errno == ESRCH)) {
+            continue;
+        }
+        snprintf(name, sizeof(name), "/%s", d->d_name);
+        fd = shm_open(name, O_RDONLY, 0);
+        if (fd == -1) {
+            continue;
+        }
+        m = mmap(NULL, sizeof(struct msh_shm), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (m == MAP_FAILED) {
+            continue;
+        }
+        shells[num_shells++] = (struct shell) { .region = m, .pid = pid, .listed = 1 };
+    }
+    closedir(dir);
+    for (size_t i = 0; i < num_shells; ) {
+        if (!shells[i].listed) {
+            munmap(shells[i].region, sizeof(struct msh_shm));
+            memmove(&shells[i], &shells[i + 1], (num_shells - i - 1) * sizeof(shells[0]));
+            num_shells--;
+        } else {
+            i++;
+        }
+    }
+}
+
+static const char *
+state_name(int state)
+{
+    switch (state) {
+    case MSH_SHM_FOREGROUND: return "fg";
+    case MSH_SHM_BACKGROUND: return "bg";
+    case MSH_SHM_STOPPED:    return "stopped";
+    default:                 return "?";
+    }
+}
+
+//format one screen into out, nothing but memory reads
+static size_t
+render(char *out, size_t sz)
+{
+    struct timespec now;
+    size_t len = 0;
+    int64_t now_ns;
+
+    //clock_gettime is served by the vDSO, not a system call
+    clock_gettime(CLOCK_REALTIME, &now);
+    now_ns = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+
+    len += snprintf(out + len, sz - len, "%-8s %-4s %-8s %10s  %-24s %s\n", "SHELL", "JOB", "STATE", "ELAPSED", "PIDS", "PIPELINE");
+    for (size_t s = 0; s < num_shells; s++) {
+        struct msh_shm *m = shells[s].region;
+
+        //a shell still starting, one that has exited, or another version
+        if (__atomic_load_n(&m->magic, __ATOMIC_ACQUIRE) != MSH_SHM_MAGIC || m->version != MSH_SHM_VERSION) {
+            continue;
+        }
+        for (size_t j = 0; j < MSH_MAXJOBS && len < sz; j++) {
+            struct msh_shm_job job;
+            char pids[128];
+            size_t plen = 0;
+
+            msh_shm_read(&m->jobs[j], &job);
+            if (job.state == MSH_SHM_FREE) {
+                continue;
+            }
+            pids[0] = '\0';
+            for (size_t i = 0; i < job.num_stages && plen < sizeof(pids); i++) {
+                plen += snprintf(pids + plen, sizeof(pids) - plen, i ? ",%d" : "%d", job.pids[i]);
+            }
+            len += snprintf(out + len, sz - len, "%-8d %-4zu %-8s %9.1fs  %-24.24s %s\n", m->shell_pid, j,
+                            state_name(job.state), (double)(now_ns - job.start_ns) / 1e9, pids, job.input);
+        }
+    }
+
+    return len < sz ? len : sz - 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+    static char screen[1 << 16];
+    int once = 0, opt, watch;
+    long delay_ms = 1000;
+
+    while ((opt = getopt(argc, argv, "1d:")) != -1) {
+        switch (opt) {
+        case '1':
+            once = 1;
+            break;
+        case 'd':
+            delay_ms = strtol(optarg, NULL, 10);
+            if (delay_ms <= 0) delay_ms = 1000;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-1] [-d MS]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    //regions created or removed in /dev/shm, watched before the first scan so none are missed
+    watch = once ? -1 : inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch != -1 && inotify_add_watch(watch, "/dev/shm", IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO) == -1) {
+        close(watch);
+        watch = -1;
+    }
+    scan_shells();
+    while (1) {
+        struct timespec delay = { .tv_sec = delay_ms / 1000, .tv_nsec = (delay_ms % 1000) * 1000000 };
+        struct pollfd pfd = { .fd = watch, .events = POLLIN };
+        size_t len = render(screen, sizeof(screen));
+
+        if (!once) {
+            //clear the screen and home the cursor
+            fputs("\033[H\033[2J", stdout);
+        }
+        fwrite(screen, 1, len, stdout);
+        fflush(stdout);
+        if (once) {
+            break;
+        }
+        //without inotify, /dev/shm is looked at on every refresh
+        if (watch == -1) {
+            nanosleep(&delay, NULL);
+            scan_shells();
+            continue;
+        }
+        //wait for the next refresh, or for a shell to come or go
+        if (poll(&pfd, 1, (int)delay_ms) > 0) {
+            char events[4096];
+
+            while (read(watch, events, sizeof(events)) > 0) {
+                continue;
+            }
+            scan_shells();
+        }
+    }
+
+    return 0;
+}